@@ -0,0 +1,117 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __UWAN_CRYPTO_H__
+#define __UWAN_CRYPTO_H__
+
+#include <uwan/stack.h>
+
+#define UWAN_AES_ROUNDS 10
+
+enum uwan_aes_impl {
+    UWAN_AES_IMPL_AUTO,
+    UWAN_AES_IMPL_TABLE, // portable, always available
+    UWAN_AES_IMPL_AESNI, // x86 AES-NI, detected at runtime
+    UWAN_AES_IMPL_ARMV8, // ARMv8 Crypto Extension, if enabled by compiler
+};
+
+struct uwan_aes_ctx {
+    // round keys, the first byte of each column is the lowest
+    uint32_t rk[4 * (UWAN_AES_ROUNDS + 1)];
+};
+
+struct uwan_cmac_ctx {
+    struct uwan_aes_ctx aes;
+    uint8_t k1[UWAN_AES_BLOCK_SIZE];
+    uint8_t k2[UWAN_AES_BLOCK_SIZE];
+    uint8_t x[UWAN_AES_BLOCK_SIZE];
+    uint8_t last[UWAN_AES_BLOCK_SIZE];
+    uint8_t last_len;
+};
+
+/**
+ * \brief Select AES implementation
+ *
+ * All backends share the same key schedule, so contexts stay valid after
+ * switching. It's safe to switch while other threads encrypt. The first
+ * encryption selects UWAN_AES_IMPL_AUTO if nothing has been selected.
+ *
+ * \param impl implementation, UWAN_AES_IMPL_AUTO picks the fastest one
+ * \returns false if the implementation isn't supported by CPU or build
+ */
+bool uwan_aes_select_impl(enum uwan_aes_impl impl);
+
+/**
+ * \brief Get AES implementation in use
+ */
+enum uwan_aes_impl uwan_aes_get_impl(void);
+
+void uwan_aes_init(struct uwan_aes_ctx *ctx,
+    const uint8_t key[UWAN_AES_BLOCK_SIZE]);
+
+void uwan_aes_encrypt(const struct uwan_aes_ctx *ctx, void *dst,
+    const void *src);
+
+void uwan_aes_encrypt_blocks(const struct uwan_aes_ctx *ctx, void *dst,
+    const void *src, size_t count);
+
+void uwan_cmac_init(struct uwan_cmac_ctx *ctx,
+    const uint8_t key[UWAN_AES_BLOCK_SIZE]);
+
+void uwan_cmac_reset(struct uwan_cmac_ctx *ctx);
+
+void uwan_cmac_update(struct uwan_cmac_ctx *ctx, const void *src, size_t len);
+
+void uwan_cmac_finish(struct uwan_cmac_ctx *ctx,
+    uint8_t digest[UWAN_CMAC_DIGESTLEN]);
+
+/*
+ * Callbacks for struct stack_hal. Contexts are taken from static pools of
+ * UWAN_CRYPTO_AES_POOL_SIZE and UWAN_CRYPTO_CMAC_POOL_SIZE entries shared by
+ * all threads, create functions return NULL if a pool is exhausted.
+ */
+void *uwan_crypto_aes_create_context(const uint8_t key[UWAN_AES_BLOCK_SIZE]);
+void uwan_crypto_aes_encrypt(void *ctx, void *dst, const void *src);
+void uwan_crypto_aes_delete_context(void *ctx);
+void uwan_crypto_aes_encrypt_blocks(void *ctx, void *dst, const void *src,
+    size_t count);
+void *uwan_crypto_cmac_create_context(const uint8_t key[UWAN_AES_BLOCK_SIZE]);
+void uwan_crypto_cmac_update(void *ctx, const void *src, size_t len);
+void uwan_crypto_cmac_finish(void *ctx, uint8_t digest[UWAN_CMAC_DIGESTLEN]);
+void uwan_crypto_cmac_delete_context(void *ctx);
+void uwan_crypto_cmac_reset(void *ctx);
+
+/* Designated initializers to put into struct stack_hal definition */
+#define UWAN_CRYPTO_HAL \
+    .crypto_aes_create_context = uwan_crypto_aes_create_context, \
+    .crypto_aes_encrypt = uwan_crypto_aes_encrypt, \
+    .crypto_aes_delete_context = uwan_crypto_aes_delete_context, \
+    .crypto_cmac_create_context = uwan_crypto_cmac_create_context, \
+    .crypto_cmac_update = uwan_crypto_cmac_update, \
+    .crypto_cmac_finish = uwan_crypto_cmac_finish, \
+    .crypto_cmac_delete_context = uwan_crypto_cmac_delete_context, \
+    .crypto_cmac_reset = uwan_crypto_cmac_reset, \
+    .crypto_aes_encrypt_blocks = uwan_crypto_aes_encrypt_blocks
+
+#endif
@@ -36,7 +36,8 @@ struct uwan_clock_sync_callbacks {
     void (*force_device_resync_req)(void); // Required
 };
 
-void uwan_clock_sync_init(struct uwan_clock_sync_callbacks *cbs);
+void uwan_clock_sync_init(struct uwan_ctx *ctx,
+    struct uwan_clock_sync_callbacks *cbs);
 
 void uwan_clock_sync_handle_time_answ(enum uwan_errs err,
     enum uwan_mtypes m_type, const struct uwan_dl_packet *pkt);
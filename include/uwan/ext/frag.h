@@ -0,0 +1,53 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __UWAN_EXT_FRAG_H__
+#define __UWAN_EXT_FRAG_H__
+
+#include <uwan/stack.h>
+
+#define UWAN_EXT_FRAG_PORT 201
+
+/* Data block storage, usually flash. It keeps received fragments at
+ * offset (N - 1) * FragSize and the parity matrix right after them, so
+ * the decoder holds only a few rows in RAM. Erase is up to application.
+ */
+struct uwan_frag_callbacks {
+    void (*read)(uint32_t offset, uint8_t *buf, uint16_t len); // Required
+    void (*write)(uint32_t offset, const uint8_t *buf,
+        uint16_t len); // Required
+    void (*session_done)(uint32_t size, uint32_t descriptor); // Required
+};
+
+void uwan_frag_init(struct uwan_ctx *ctx, struct uwan_frag_callbacks *cbs,
+    uint32_t storage_size);
+
+void uwan_frag_handle_downlink(enum uwan_errs err,
+    enum uwan_mtypes m_type, const struct uwan_dl_packet *pkt);
+
+bool uwan_frag_is_answ_pending(void);
+
+enum uwan_errs uwan_frag_send_answ(void);
+
+#endif
@@ -0,0 +1,55 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __UWAN_EXT_MC_SETUP_H__
+#define __UWAN_EXT_MC_SETUP_H__
+
+#include <uwan/stack.h>
+
+#define UWAN_EXT_MC_SETUP_PORT 200
+
+/* Session callbacks return false if frequency isn't supported. Without
+ * them session requests are left unanswered.
+ */
+struct uwan_mc_setup_callbacks {
+    uint32_t (*get_unixtime)(void); // Required
+    bool (*class_c_session)(uint8_t id, uint32_t time_to_start,
+        uint32_t duration_s, uint32_t frequency,
+        enum uwan_dr dr); // Optional
+    bool (*class_b_session)(uint8_t id, uint32_t time_to_start,
+        uint32_t duration_s, uint32_t frequency, enum uwan_dr dr,
+        uint8_t periodicity); // Optional
+};
+
+void uwan_mc_setup_init(struct uwan_ctx *ctx,
+    struct uwan_mc_setup_callbacks *cbs);
+
+void uwan_mc_setup_handle_downlink(enum uwan_errs err,
+    enum uwan_mtypes m_type, const struct uwan_dl_packet *pkt);
+
+bool uwan_mc_setup_is_answ_pending(void);
+
+enum uwan_errs uwan_mc_setup_send_answ(void);
+
+#endif
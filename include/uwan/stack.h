@@ -38,6 +38,11 @@
 #define UWAN_RX_NO_TIMEOUT 0
 #define UWAN_RX_INFINITE 0xffffff
 
+/* 2^SF / BW in microseconds, sf and bw are enum uwan_sf and enum uwan_bw */
+#define UWAN_SYMBOL_TIME_US(sf, bw) ((1UL << ((sf) + 9)) >> (bw))
+
+#define UWAN_SESSION_SNAPSHOT_SIZE 161
+
 #define UWAN_AES_BLOCK_SIZE 16
 #define UWAN_CMAC_DIGESTLEN 16
 
@@ -98,6 +103,16 @@ enum uwan_errs {
     UWAN_ERR_MSG_MIC,
     UWAN_ERR_DEV_ADDR,
     UWAN_ERR_FCNT,
+    UWAN_ERR_DUTY_CYCLE,
+    UWAN_ERR_QUEUE_FULL,
+    UWAN_ERR_DEADLINE,
+    UWAN_ERR_NO_ACK,
+    UWAN_ERR_SNAPSHOT,
+    UWAN_ERR_NVM,
+    UWAN_ERR_DEV_NONCE,
+    UWAN_ERR_JOIN_NONCE,
+    UWAN_ERR_NO_BEACON,
+    UWAN_ERR_CRYPTO, // crypto context isn't available
 };
 
 enum uwan_mtypes {
@@ -113,8 +128,24 @@ enum uwan_mtypes {
 enum uwan_timer_ids {
     UWAN_TIMER_RX1,
     UWAN_TIMER_RX2,
+    UWAN_TIMER_TX, // next queued uplink, waits for duty cycle
+    UWAN_TIMER_BEACON, // class B only
+    UWAN_TIMER_PING_SLOT, // class B only
+    UWAN_TIMER_QUEUE, // the earliest lifetime of queued uplinks
 };
 
+enum uwan_class {
+    UWAN_CLASS_A,
+    UWAN_CLASS_B, // beacon tracking and ping slots
+    UWAN_CLASS_C, // RX2 is open while the stack is idle
+};
+
+/**
+ * Opaque stack instance. All device state (session, MAC, ADR, channels) lives
+ * here, so several end devices can be driven from one program.
+ */
+struct uwan_ctx;
+
 enum radio_irq_flags {
     RADIO_IRQF_RX_TIMEOUT = 0x1,
     RADIO_IRQF_RX_DONE = 0x2,
@@ -139,6 +170,23 @@ struct uwan_dl_packet {
     uint8_t f_port;
     int16_t rssi;
     int8_t snr;
+    bool ack; // confirmed uplink has been acknowledged
+    bool multicast; // sent to multicast group mc_group
+    uint8_t mc_group;
+};
+
+struct uwan_iovec {
+    const void *base;
+    uint8_t len;
+};
+
+struct uwan_uplink {
+    uint8_t f_port;
+    const uint8_t *payload;
+    uint8_t pld_len;
+    bool confirm;
+    uint8_t priority; // higher is sent first
+    uint32_t lifetime_ms; // dropped if not sent in time, 0 means no limit
 };
 
 struct uwan_packet_params {
@@ -170,15 +218,23 @@ struct radio_dev {
     void (*read_packet)(struct uwan_dl_packet *pkt);
     uint32_t (*rand)(void);
     uint8_t (*irq_handler)(void);
-    void (*set_evt_handler)(void (*handler)(uint8_t evt_mask));
+    void (*set_evt_handler)(void (*handler)(void *arg, uint8_t evt_mask),
+        void *arg);
     uint32_t (*get_tcxo_timeout)(void);
 };
 
+struct uwan_band {
+    uint32_t freq_min; // Hz, inclusive
+    uint32_t freq_max; // Hz, exclusive
+    uint16_t duty_cycle; // inverse, 100 means 1%
+};
+
 struct stack_hal {
-    void (*start_timer)(enum uwan_timer_ids timer_id, uint32_t timeout_ms);
-    void (*stop_timer)(enum uwan_timer_ids timer_id);
-    void (*downlink_callback)(enum uwan_errs err, enum uwan_mtypes m_type,
-        const struct uwan_dl_packet *pkt);
+    void (*start_timer)(struct uwan_ctx *ctx, enum uwan_timer_ids timer_id,
+        uint32_t timeout_ms);
+    void (*stop_timer)(struct uwan_ctx *ctx, enum uwan_timer_ids timer_id);
+    void (*downlink_callback)(struct uwan_ctx *ctx, enum uwan_errs err,
+        enum uwan_mtypes m_type, const struct uwan_dl_packet *pkt);
     void *(*crypto_aes_create_context)(const uint8_t key[UWAN_AES_BLOCK_SIZE]);
     void (*crypto_aes_encrypt)(void *ctx, void *dst, const void *src);
     void (*crypto_aes_delete_context)(void *ctx);
@@ -186,200 +242,636 @@ struct stack_hal {
     void (*crypto_cmac_update)(void *ctx, const void *src, size_t len);
     void (*crypto_cmac_finish)(void *ctx, uint8_t digest[UWAN_CMAC_DIGESTLEN]);
     void (*crypto_cmac_delete_context)(void *ctx);
+    void (*crypto_cmac_reset)(void *ctx); // optional, restart with same key
+    void (*crypto_aes_encrypt_blocks)(void *ctx, void *dst, const void *src,
+        size_t count); // optional, ECB over count blocks
+    uint32_t (*get_time_ms)(struct uwan_ctx *ctx); // optional, monotonic
+    void (*uplink_callback)(struct uwan_ctx *ctx, uint8_t id,
+        enum uwan_errs err); // optional, result of queued uplink
+    void (*event_callback)(struct uwan_ctx *ctx); // optional, deferred mode
+    bool (*nvm_reserve_f_cnt)(struct uwan_ctx *ctx,
+        uint32_t f_cnt_up); // optional, store uplink counter limit
+    bool (*nvm_store_join_nonces)(struct uwan_ctx *ctx, uint32_t dev_nonce,
+        uint32_t join_nonce); // optional, enables LoRaWAN 1.0.4 nonces
+    void (*beacon_callback)(struct uwan_ctx *ctx, enum uwan_errs err,
+        uint32_t gps_time); // optional, class B beacon status
 };
 
 struct uwan_region {
-    void (*init)(void);
-    void (*handle_cflist)(const uint8_t *cflist);
-    bool (*handle_adr_ch_mask)(uint16_t ch_mask, uint8_t ch_mask_cntl,
-        bool dry_run);
+    void (*init)(struct uwan_ctx *ctx);
+    void (*handle_cflist)(struct uwan_ctx *ctx, const uint8_t *cflist);
+    bool (*handle_adr_ch_mask)(struct uwan_ctx *ctx, uint16_t ch_mask,
+        uint8_t ch_mask_cntl, bool dry_run);
+    const struct uwan_band *bands; // sub-bands with duty cycle limits
+    uint8_t bands_count;
+    uint32_t beacon_frequency; // default channel of beacons
+    uint32_t ping_frequency; // default channel of ping slots
+    enum uwan_dr beacon_dr;
 };
 
 /**
  * \brief Initialize stack
  *
+ * Takes a free instance from the static pool of UWAN_MAX_CONTEXTS entries.
+ * Instances can be created and released from different threads.
+ *
  * \param radio pointer to radio device (sx127x_dev or sx126x_dev)
  * \param stack pointer to hal struct that contains pointers to application
                 specific funcs
  * \param region pointer to region struct (region_eu868 for example)
+ * \returns pointer to stack instance or NULL if the pool is exhausted
  */
-void uwan_init(const struct radio_dev *radio, const struct stack_hal *stack,
-    const struct uwan_region *region);
+struct uwan_ctx *uwan_init(const struct radio_dev *radio,
+    const struct stack_hal *stack, const struct uwan_region *region);
+
+/**
+ * \brief Release stack instance
+ *
+ * \param ctx pointer to stack instance returned by uwan_init
+ */
+void uwan_deinit(struct uwan_ctx *ctx);
+
+/**
+ * \brief Attach application data to stack instance
+ *
+ * \param ctx pointer to stack instance
+ * \param user_data pointer to application data
+ */
+void uwan_set_user_data(struct uwan_ctx *ctx, void *user_data);
+
+/**
+ * \brief Get application data attached to stack instance
+ *
+ * \param ctx pointer to stack instance
+ */
+void *uwan_get_user_data(struct uwan_ctx *ctx);
 
 /**
  * \brief Set keys for OTAA activation
  *
+ * \param ctx pointer to stack instance
  * \param dev_eui pointer to device EUI
  * \param app_eui pointer to application EUI
  * \param app_key pointer to application key
+ * \returns UWAN_ERR_CRYPTO if crypto contexts of AppKey can't be created
  */
-void uwan_set_otaa_keys(const uint8_t *dev_eui, const uint8_t *app_eui,
-    const uint8_t *app_key);
+enum uwan_errs uwan_set_otaa_keys(struct uwan_ctx *ctx,
+    const uint8_t *dev_eui, const uint8_t *app_eui, const uint8_t *app_key);
+
+/**
+ * \brief Restore OTAA nonces
+ *
+ * Used if stack_hal provides nvm_store_join_nonces. Then DevNonce is a
+ * counter instead of a random value, and join-accept is dropped unless its
+ * JoinNonce is greater than the one of the previous join. The stack calls
+ * nvm_store_join_nonces before every join-request and after join, pass
+ * the last stored values here after reset. Both are 0 for a new device.
+ *
+ * \param ctx pointer to stack instance
+ * \param dev_nonce DevNonce of the next join-request
+ * \param join_nonce lowest JoinNonce to accept
+ */
+void uwan_set_join_nonces(struct uwan_ctx *ctx, uint32_t dev_nonce,
+    uint32_t join_nonce);
 
 /**
  * \brief Set keys for ABP activation
  *
+ * \param ctx pointer to stack instance
  * \param dev_addr device address
  * \param f_cnt_up uplink fCnt
  * \param f_cnt_down downlinks fCnt
  * \param nwk_s_key pointer to network session key
  * \param app_s_key pointer to application session key
+ * \returns UWAN_ERR_CRYPTO if crypto contexts of session keys can't be
+ *          created, the stack isn't joined then
+ */
+enum uwan_errs uwan_set_session(struct uwan_ctx *ctx, uint32_t dev_addr,
+    uint32_t f_cnt_up, uint32_t f_cnt_down, const uint8_t *nwk_s_key,
+    const uint8_t *app_s_key);
+
+/**
+ * \brief Save session to a compact versioned snapshot
+ *
+ * The snapshot keeps session keys and counters, data rate, TX power,
+ * NbTrans, RX windows settings, channels, duty cycle and ADR state.
+ * Store it after join and after changes made by MAC commands. Uplink
+ * counter doesn't need to be saved every time if stack_hal provides
+ * nvm_reserve_f_cnt: the stack asks to store a counter limit once per
+ * UWAN_F_CNT_RESERVE uplinks.
+ *
+ * \param ctx pointer to stack instance
+ * \param buf buffer for snapshot
+ * \param size size of buffer, UWAN_SESSION_SNAPSHOT_SIZE at least
+ * \returns size of snapshot, 0 if stack isn't joined or buffer is small
+ */
+size_t uwan_session_save(struct uwan_ctx *ctx, uint8_t *buf, size_t size);
+
+/**
+ * \brief Restore session from snapshot
+ *
+ * \param ctx pointer to stack instance
+ * \param buf snapshot made by uwan_session_save
+ * \param len size of snapshot
+ * \param f_cnt_reserved last value stored by nvm_reserve_f_cnt, 0 if not
+ *                       used. Uplink counter continues from it.
+ * \returns UWAN_ERR_SNAPSHOT if snapshot is corrupted or has other version,
+ *          UWAN_ERR_CRYPTO if session keys can't get crypto contexts
  */
-void uwan_set_session(uint32_t dev_addr, uint32_t f_cnt_up, uint32_t f_cnt_down,
-    const uint8_t *nwk_s_key, const uint8_t *app_s_key);
+enum uwan_errs uwan_session_restore(struct uwan_ctx *ctx, const uint8_t *buf,
+    size_t len, uint32_t f_cnt_reserved);
 
 /**
  * \brief Check for stack is joined
  *
+ * \param ctx pointer to stack instance
  * \returns true if activation is OTAA and stack is joined
  */
-bool uwan_is_joined(void);
+bool uwan_is_joined(struct uwan_ctx *ctx);
 
 /**
  * \brief Enable or disable channel
  *
+ * \param ctx pointer to stack instance
  * \param index index of channel in range 0..(MAX_CHANNELS - 1)
  * \param enable state of channel. true for enable, false for disable
  */
-enum uwan_errs uwan_enable_channel(uint8_t index, bool enable);
+enum uwan_errs uwan_enable_channel(struct uwan_ctx *ctx, uint8_t index,
+    bool enable);
 
 /**
  * \brief Set and enable channel
  *
+ * \param ctx pointer to stack instance
  * \param index index of channel in range 0..(MAX_CHANNELS - 1)
  * \param frequency actual channel frequency in Hz
  */
-enum uwan_errs uwan_set_channel(uint8_t index, uint32_t frequency);
+enum uwan_errs uwan_set_channel(struct uwan_ctx *ctx, uint8_t index,
+    uint32_t frequency);
+
+/**
+ * \brief Set RX1 downlink frequency of channel
+ *
+ * By default RX1 uses uplink frequency. uwan_set_channel restores it.
+ *
+ * \param ctx pointer to stack instance
+ * \param index index of existing channel
+ * \param frequency downlink frequency in Hz
+ */
+enum uwan_errs uwan_set_dl_channel(struct uwan_ctx *ctx, uint8_t index,
+    uint32_t frequency);
+
+/**
+ * \brief Get time until the next uplink is allowed by duty cycle
+ *
+ * Duty cycle is tracked only if stack_hal provides get_time_ms. When no
+ * channel is available uwan_join and uwan_send_frame return
+ * UWAN_ERR_DUTY_CYCLE.
+ *
+ * \param ctx pointer to stack instance
+ * \returns delay in milliseconds, 0 if uplink can be sent now
+ */
+uint32_t uwan_get_next_tx_delay(struct uwan_ctx *ctx);
 
 /**
  * \brief Send join-request message
  *
  * Network parameters must be set by uwan_set_otaa_keys
  *
+ * \param ctx pointer to stack instance
  * \returns UWAN_ERR_NO if the join-request has been sent
  */
-enum uwan_errs uwan_join(void);
+enum uwan_errs uwan_join(struct uwan_ctx *ctx);
+
+/**
+ * \brief Start join procedure
+ *
+ * Join-requests are repeated until join-accept is received or attempts
+ * are exhausted. Each attempt goes over another channel, data rate steps
+ * from the default one down to DR0 and then starts over. The attempts are
+ * spaced by the retransmission backoff of LoRaWAN: 36 s of time on air
+ * during the first hour after uwan_init, 36 s per 10 hours during the next
+ * 10 hours and 8.7 s per 24 hours after that. The backoff is applied to
+ * uwan_join too. downlink_callback is called once, when the procedure is
+ * over. Requires get_time_ms of stack_hal.
+ *
+ * \param ctx pointer to stack instance
+ * \param attempts maximum number of join-requests
+ * \returns UWAN_ERR_NO if the procedure has been started
+ */
+enum uwan_errs uwan_join_start(struct uwan_ctx *ctx, uint16_t attempts);
 
 /**
  * \brief Return maximum payload size available for application
  *
- * The application payload size depends on fOpts field size
+ * The application payload size depends on fOpts field size. It's zero
+ * while pending MAC answers exceed 15 bytes: they are sent on FPort 0 by an
+ * uplink without payload first. Queued uplinks do it automatically.
+ *
+ * \param ctx pointer to stack instance
  */
-uint8_t uwan_get_max_payload_size(void);
+uint8_t uwan_get_max_payload_size(struct uwan_ctx *ctx);
 
 /**
  * \brief Send uplink
  *
+ * \param ctx pointer to stack instance
  * \param f_port application-specific port field (1..223)
  * \param payload pointer to payload, can be null if pld_len == 0
  * \param pld_len size of payload, can be zero to send MAC payload only
  * \param confirm send uplink with confirmation if true
  */
-enum uwan_errs uwan_send_frame(uint8_t f_port, const uint8_t *payload,
+enum uwan_errs uwan_send_frame(struct uwan_ctx *ctx, uint8_t f_port,
+    const uint8_t *payload, uint8_t pld_len, bool confirm);
+
+/**
+ * \brief Send uplink gathered from several buffers
+ *
+ * Fragments are copied directly into the frame buffer of the stack
+ *
+ * \param ctx pointer to stack instance
+ * \param f_port application-specific port field (1..223)
+ * \param iov array of payload fragments
+ * \param iov_cnt number of fragments, can be zero to send MAC payload only
+ * \param confirm send uplink with confirmation if true
+ */
+enum uwan_errs uwan_send_frame_iov(struct uwan_ctx *ctx, uint8_t f_port,
+    const struct uwan_iovec *iov, uint8_t iov_cnt, bool confirm);
+
+/**
+ * \brief Reserve space for payload in the frame buffer of the stack
+ *
+ * The application writes up to pld_len bytes of plain payload into the
+ * returned buffer and sends it by uwan_frame_commit. The reservation is
+ * dropped by any other uplink.
+ *
+ * \param ctx pointer to stack instance
+ * \param pld_len maximum size of payload
+ * \returns pointer to payload buffer or NULL if uplink isn't possible
+ */
+uint8_t *uwan_frame_reserve(struct uwan_ctx *ctx, uint8_t pld_len);
+
+/**
+ * \brief Send uplink with payload written to reserved buffer
+ *
+ * \param ctx pointer to stack instance
+ * \param f_port application-specific port field (1..223)
+ * \param pld_len actual size of payload, not greater than reserved
+ * \param confirm send uplink with confirmation if true
+ */
+enum uwan_errs uwan_frame_commit(struct uwan_ctx *ctx, uint8_t f_port,
     uint8_t pld_len, bool confirm);
 
+/**
+ * \brief Put uplink into the queue of the stack
+ *
+ * The queued uplink is sent as soon as the stack is idle, joined and duty
+ * cycle allows it. Pending MAC answers are carried by the next uplink. The
+ * payload is copied, so the buffer can be reused right away. The result is
+ * reported by uplink_callback of stack_hal, which can be called before the
+ * function returns. Lifetime is taken into account only if stack_hal
+ * provides get_time_ms, expired uplinks are reported with UWAN_ERR_DEADLINE
+ * when UWAN_TIMER_QUEUE fires, even while the stack is busy.
+ *
+ * The queue is also served by the state machine. Call the function from the
+ * context where the stack runs: the radio and timer interrupts without
+ * deferred mode, the task of uwan_process with it.
+ *
+ * \param ctx pointer to stack instance
+ * \param uplink port, payload and delivery options of uplink
+ * \param id pointer to store id of uplink, can be null
+ * \returns UWAN_ERR_NO if uplink has been queued
+ */
+enum uwan_errs uwan_queue_frame(struct uwan_ctx *ctx,
+    const struct uwan_uplink *uplink, uint8_t *id);
+
+/**
+ * \brief Calculate time on air of uplink
+ *
+ * Uses the packet settings of the stack: CR 4/5, 8 symbols preamble,
+ * explicit header and CRC. The function has no side effects.
+ *
+ * \param dr data rate
+ * \param len size of PHYPayload (MHDR, MACPayload and MIC)
+ * \returns time on air in microseconds, 0 if dr isn't valid
+ */
+uint32_t uwan_time_on_air(enum uwan_dr dr, uint8_t len);
+
+/**
+ * \brief Calculate time on air of LoRa packet
+ *
+ * \param params packet settings
+ * \param len size of payload
+ * \returns time on air in microseconds
+ */
+uint32_t uwan_time_on_air_params(const struct uwan_packet_params *params,
+    uint8_t len);
+
+/**
+ * \brief Defer handling of radio and timer events out of interrupt context
+ *
+ * Radio interrupts and uwan_timer_callback only put events with their time
+ * into a lock-free ring, then event_callback of stack_hal is called if
+ * provided. The state machine runs in uwan_process: reading the downlink,
+ * decryption, MAC commands and downlink_callback. RX windows are scheduled
+ * from the recorded TX done time if stack_hal provides get_time_ms, and
+ * uwan_timer_callback of RX1 and RX2 timers starts the radio right away,
+ * so the latency of uwan_process doesn't shift the windows. Radio and
+ * timer interrupts must not preempt each other, the ring has a single
+ * producer.
+ *
+ * Without deferred mode the events are processed right in the interrupt.
+ *
+ * \param ctx pointer to stack instance
+ * \param enable true to defer events
+ */
+void uwan_set_deferred(struct uwan_ctx *ctx, bool enable);
+
+/**
+ * \brief Set device class
+ *
+ * In class C the radio listens continuously on RX2 frequency and data rate
+ * whenever the stack is joined and idle. Uplinks and their RX windows
+ * preempt the reception, it's resumed when the uplink is finished. Each
+ * valid downlink is passed to downlink_callback as it arrives. A reserved
+ * frame (uwan_frame_reserve) pauses the reception until it's sent.
+ *
+ * Class B needs get_time_ms of stack_hal and a joined stack. It starts with
+ * beacon acquisition: the radio waits for the next beacon if network time
+ * is known from DeviceTimeAns, otherwise it searches for a beacon period.
+ * Then beacons are tracked and ping slots are opened with UWAN_TIMER_BEACON
+ * and UWAN_TIMER_PING_SLOT. Windows are widened while beacons are missed.
+ * beacon_callback reports each beacon, UWAN_ERR_NO_BEACON means that
+ * acquisition failed or 2 hours passed without beacon and the stack fell
+ * back to class A. Uplinks carry Class B bit while beacon is locked.
+ *
+ * \param ctx pointer to stack instance
+ * \param dev_class device class
+ * \returns false if class isn't supported or class B can't get a crypto
+ *          context, the stack stays in class A then
+ */
+bool uwan_set_class(struct uwan_ctx *ctx, enum uwan_class dev_class);
+
+/**
+ * \brief Set ping slot periodicity of class B
+ *
+ * There are 2^(7 - periodicity) ping slots per beacon period, announce the
+ * value to the network by uwan_mac_ping_slot_info_req. Takes effect from
+ * the next beacon period.
+ *
+ * \param ctx pointer to stack instance
+ * \param periodicity 0 to 7, 7 by default
+ * \returns false if periodicity is invalid
+ */
+bool uwan_set_ping_slot_periodicity(struct uwan_ctx *ctx,
+    uint8_t periodicity);
+
+/**
+ * \brief Set multicast group session
+ *
+ * Frames sent to mc_addr are checked against a lookup table of group
+ * addresses before MIC, they are reported by downlink_callback with
+ * multicast flag of the packet set. Groups are received in class B and C
+ * windows. Confirmed frames, MAC commands and frames above f_cnt_max are
+ * rejected.
+ *
+ * \param ctx pointer to stack instance
+ * \param id group ID, less than UWAN_MC_GROUPS (4 by default)
+ * \param mc_addr multicast address
+ * \param mc_nwk_s_key pointer to McNwkSKey
+ * \param mc_app_s_key pointer to McAppSKey
+ * \param f_cnt_min first accepted fCnt
+ * \param f_cnt_max last accepted fCnt
+ * \returns false if ID is invalid, address is used by another session or
+ *          crypto contexts aren't available, the group is deleted then
+ */
+bool uwan_mc_set_group(struct uwan_ctx *ctx, uint8_t id, uint32_t mc_addr,
+    const uint8_t *mc_nwk_s_key, const uint8_t *mc_app_s_key,
+    uint32_t f_cnt_min, uint32_t f_cnt_max);
+
+/**
+ * \brief Set GenAppKey, the root key of remote multicast setup
+ *
+ * McKEKey is derived from it to decrypt McKey of uwan_mc_setup_group.
+ *
+ * \param ctx pointer to stack instance
+ * \param gen_app_key pointer to GenAppKey
+ * \returns false if crypto contexts aren't available, the key is unset then
+ */
+bool uwan_mc_set_gen_app_key(struct uwan_ctx *ctx, const uint8_t *gen_app_key);
+
+/**
+ * \brief Set multicast group from McGroupSetupReq
+ *
+ * McAppSKey and McNwkSKey are derived from McKey as TS005 defines.
+ *
+ * \param ctx pointer to stack instance
+ * \param id group ID
+ * \param mc_addr multicast address
+ * \param mc_key_encrypted pointer to McKey encrypted with McKEKey
+ * \param f_cnt_min first accepted fCnt
+ * \param f_cnt_max last accepted fCnt
+ * \returns false if GenAppKey isn't set or group can't be set, the group
+ *          is deleted in the latter case
+ */
+bool uwan_mc_setup_group(struct uwan_ctx *ctx, uint8_t id, uint32_t mc_addr,
+    const uint8_t *mc_key_encrypted, uint32_t f_cnt_min, uint32_t f_cnt_max);
+
+/**
+ * \brief Delete multicast group
+ *
+ * \param ctx pointer to stack instance
+ * \param id group ID
+ * \returns false if group isn't defined
+ */
+bool uwan_mc_delete_group(struct uwan_ctx *ctx, uint8_t id);
+
+/**
+ * \brief Get multicast address of group
+ *
+ * \param ctx pointer to stack instance
+ * \param id group ID
+ * \param mc_addr multicast address is returned here
+ * \returns false if group isn't defined
+ */
+bool uwan_mc_get_group(struct uwan_ctx *ctx, uint8_t id, uint32_t *mc_addr);
+
+/**
+ * \brief Handle pending events in deferred mode
+ *
+ * Call it from the main loop or from a single task, the function does
+ * nothing if there is no pending event.
+ *
+ * \param ctx pointer to stack instance
+ */
+void uwan_process(struct uwan_ctx *ctx);
+
 /**
  * \brief Timer callback
+ *
+ * \param ctx pointer to stack instance
+ * \param timer_id identifier of expired timer
  */
-void uwan_timer_callback(enum uwan_timer_ids timer_id);
+void uwan_timer_callback(struct uwan_ctx *ctx, enum uwan_timer_ids timer_id);
 
 /**
  * \brief Get current fcnt
  *
+ * \param ctx pointer to stack instance
  * \param f_cnt_up pointer to store fCnt up value
  * \param f_cnt_down pointer to store fCnt down value
  */
-void uwan_get_f_cnt(uint32_t *f_cnt_up, uint32_t *f_cnt_down);
+void uwan_get_f_cnt(struct uwan_ctx *ctx, uint32_t *f_cnt_up,
+    uint32_t *f_cnt_down);
 
 /**
  * \brief Set default datarate
+ *
+ * \param ctx pointer to stack instance
  */
-void uwan_set_dr(enum uwan_dr dr);
+void uwan_set_dr(struct uwan_ctx *ctx, enum uwan_dr dr);
 
 /**
  * \brief Set number of repeats for unconfirmed transmissions
  *
+ * Repetitions carry the same FCnt and go over another channel when it's
+ * possible. They stop once anything is received in RX windows, and
+ * downlink_callback is called after the last one only.
+ *
+ * \param ctx pointer to stack instance
  * \param nb_trans number of repeats, valid values range from 1 to 15
  */
-bool uwan_set_nb_trans(uint8_t nb_trans);
+bool uwan_set_nb_trans(struct uwan_ctx *ctx, uint8_t nb_trans);
+
+/**
+ * \brief Set number of retransmissions for confirmed uplinks
+ *
+ * Unacknowledged uplink is sent again with the same FCnt after random
+ * ACK_TIMEOUT (1..3 s), data rate is lowered every second transmission.
+ * downlink_callback is called once: pkt->ack is set if the uplink has been
+ * acknowledged, err is UWAN_ERR_RX_TIMEOUT if all attempts got no answer.
+ *
+ * \param ctx pointer to stack instance
+ * \param retries number of retransmissions, valid values range from 0 to 15,
+ *                default is 7
+ */
+bool uwan_set_confirm_retries(struct uwan_ctx *ctx, uint8_t retries);
 
 /**
  * \brief Set Max EIRP
  *
+ * \param ctx pointer to stack instance
  * \param max_eirp value of Max EIRP
  */
-void uwan_set_max_eirp(int8_t max_eirp);
+void uwan_set_max_eirp(struct uwan_ctx *ctx, int8_t max_eirp);
 
 /**
  * \brief Set index of tx power
  *
+ * \param ctx pointer to stack instance
  * \param tx_power index of tx power, 0 equals max
  */
-bool uwan_set_tx_power(uint8_t tx_power);
+bool uwan_set_tx_power(struct uwan_ctx *ctx, uint8_t tx_power);
 
 /**
  * \brief Setup RX2 window
  *
+ * \param ctx pointer to stack instance
  * \param frequency frequency in Hz
  * \param dr data rate
  */
-enum uwan_errs uwan_set_rx2(uint32_t frequency, enum uwan_dr dr);
+enum uwan_errs uwan_set_rx2(struct uwan_ctx *ctx, uint32_t frequency,
+    enum uwan_dr dr);
 
 /**
  * \brief Set RX1 datarate offset
  *
+ * \param ctx pointer to stack instance
  * \param rx1_dr_offset offset index from 0 to 5
  */
-bool uwan_set_rx1_dr_offset(uint8_t rx1_dr_offset);
+bool uwan_set_rx1_dr_offset(struct uwan_ctx *ctx, uint8_t rx1_dr_offset);
+
+/**
+ * \brief Set timing accuracy of host for RX windows
+ *
+ * RX window open time and symbol timeout are calculated for each window
+ * from the symbol time of its data rate, so that the window catches the
+ * preamble in spite of the clock error.
+ *
+ * \param ctx pointer to stack instance
+ * \param clock_error_ppm maximum error of the clock driving hal timers
+ * \param wakeup_time time in microseconds needed by MCU and radio to start
+ *                    receiving after timer expiration (TCXO startup is
+ *                    taken from radio driver)
+ */
+void uwan_set_rx_timing(struct uwan_ctx *ctx, uint16_t clock_error_ppm,
+    uint32_t wakeup_time);
 
 /**
  * \brief Set RX1 delay
  *
+ * \param ctx pointer to stack instance
  * \param delay new delay in seconds from 1 to 15
  */
-bool uwan_set_rx1_delay(uint8_t delay);
+bool uwan_set_rx1_delay(struct uwan_ctx *ctx, uint8_t delay);
 
 /**
  * \brief Check for ADR is enabled
+ *
+ * \param ctx pointer to stack instance
  */
-bool uwan_adr_is_enabled(void);
+bool uwan_adr_is_enabled(struct uwan_ctx *ctx);
 
 /**
  * \brief Enable ADR
  *
+ * \param ctx pointer to stack instance
  * \param enable pass true to enable
  */
-void uwan_adr_enable(bool enable);
+void uwan_adr_enable(struct uwan_ctx *ctx, bool enable);
 
 /**
  * \brief Setup ADR ACK limit and delay
  *
  * See adr.c for details
  *
+ * \param ctx pointer to stack instance
  * \param limit set ADRACKReq bit after limit uplinks, 64 by default
  * \param delay reduce DR if possible after limit+delay uplinks, 32 by default
  */
-void uwan_adr_setup_ack(uint8_t limit, uint8_t delay);
+void uwan_adr_setup_ack(struct uwan_ctx *ctx, uint8_t limit, uint8_t delay);
 
 /**
  * \brief Set callback for properly handling MAC commands
  *
+ * \param ctx pointer to stack instance
  * \param cbs pointer to struct with callbacks
  */
-void uwan_mac_set_handlers(const struct uwan_mac_callbacks *cbs);
+void uwan_mac_set_handlers(struct uwan_ctx *ctx,
+    const struct uwan_mac_callbacks *cbs);
 
 /**
  * \brief Queue LinkCheckReq command
  *
+ * \param ctx pointer to stack instance
  * \returns false if there is no available space in MAC buffer
  */
-bool uwan_mac_link_check_req(void);
+bool uwan_mac_link_check_req(struct uwan_ctx *ctx);
 
 /**
  * \brief Queue DeviceTimeReq command
  *
+ * \param ctx pointer to stack instance
+ * \returns false if there is no available space in MAC buffer
+ */
+bool uwan_mac_device_time_req(struct uwan_ctx *ctx);
+
+/**
+ * \brief Queue PingSlotInfoReq command with current ping slot periodicity
+ *
+ * \param ctx pointer to stack instance
  * \returns false if there is no available space in MAC buffer
  */
-bool uwan_mac_device_time_req(void);
+bool uwan_mac_ping_slot_info_req(struct uwan_ctx *ctx);
 
 #endif
@@ -23,7 +23,6 @@
  */
 
 #include "adr.h"
-#include "mac.h"
 #include "stack.h"
 
 /* Fields of LinkADRReq command */
@@ -45,37 +44,41 @@
 #define ADR_ACK_LIMIT 64
 #define ADR_ACK_DELAY 32
 
-static uint32_t ack_cnt;
-static uint8_t ack_limit = ADR_ACK_LIMIT;
-static uint8_t ack_delay = ADR_ACK_DELAY;
-static bool adr_is_enabled;
+bool uwan_adr_is_enabled(struct uwan_ctx *ctx)
+{
+    return ctx->adr.is_enabled;
+}
 
-bool uwan_adr_is_enabled()
+void uwan_adr_enable(struct uwan_ctx *ctx, bool enable)
 {
-    return adr_is_enabled;
+    ctx->adr.is_enabled = enable;
+    ctx->adr.ack_cnt = 0;
 }
 
-void uwan_adr_enable(bool enable)
+void uwan_adr_setup_ack(struct uwan_ctx *ctx, uint8_t limit, uint8_t delay)
 {
-    adr_is_enabled = enable;
-    ack_cnt = 0;
+    ctx->adr.ack_limit = limit;
+    ctx->adr.ack_delay = delay;
 }
 
-void uwan_adr_setup_ack(uint8_t limit, uint8_t delay)
+void adr_init(struct uwan_ctx *ctx)
 {
-    ack_limit = limit;
-    ack_delay = delay;
+    ctx->adr.ack_cnt = 0;
+    ctx->adr.ack_limit = ADR_ACK_LIMIT;
+    ctx->adr.ack_delay = ADR_ACK_DELAY;
+    ctx->adr.is_enabled = false;
 }
 
-bool adr_get_req_bit()
+bool adr_get_req_bit(struct uwan_ctx *ctx)
 {
-    if (adr_is_enabled == false || uw_session.dr == UWAN_DR_0)
+    if (ctx->adr.is_enabled == false || ctx->session.dr == UWAN_DR_0)
         return false;
 
-    return ack_cnt >= ack_limit;
+    return ctx->adr.ack_cnt >= ctx->adr.ack_limit;
 }
 
-bool adr_handle_link_req(uint8_t dr_txpow,uint16_t ch_mask, uint8_t redundancy)
+uint8_t adr_handle_link_req(struct uwan_ctx *ctx, uint8_t dr_txpow,
+    uint16_t ch_mask, uint8_t redundancy)
 {
     uint8_t result = 0;
 
@@ -85,7 +88,7 @@ bool adr_handle_link_req(uint8_t dr_txpow,uint16_t ch_mask, uint8_t redundancy)
 
     uint8_t ch_mask_cntl = (redundancy >> REDUNDANCY_CH_MASK_CNTL_SHIFT) &
         REDUNDANCY_CH_MASK_CNTL_SHIFT;
-    if (uw_region->handle_adr_ch_mask(ch_mask, ch_mask_cntl, true))
+    if (ctx->region->handle_adr_ch_mask(ctx, ch_mask, ch_mask_cntl, true))
         result |= STATUS_CH_MASK_ACK;
 
     uint8_t tx_power = dr_txpow & DRTX_TX_POWER_MASK;
@@ -95,28 +98,31 @@ bool adr_handle_link_req(uint8_t dr_txpow,uint16_t ch_mask, uint8_t redundancy)
 
     if (result == STATUS_OK) {
         uint8_t nb_trans = redundancy & REDUNDANCY_NB_TRANS_MASK;
-        if (set_nb_trans(nb_trans) == false)
-            reset_nb_trans();
+        if (set_nb_trans(ctx, nb_trans) == false)
+            reset_nb_trans(ctx);
 
-        set_tx_power(tx_power);
-        uw_session.dr = (enum uwan_dr)dr;
-        uw_region->handle_adr_ch_mask(ch_mask, ch_mask_cntl, false);
+        set_tx_power(ctx, tx_power);
+        ctx->session.dr = (enum uwan_dr)dr;
+        ctx->region->handle_adr_ch_mask(ctx, ch_mask, ch_mask_cntl, false);
     }
 
-    return mac_enqueue(CID_LINK_ADR, &result, sizeof(result));
+    return result;
 }
 
-void adr_handle_uplink()
+void adr_handle_uplink(struct uwan_ctx *ctx)
 {
-    ack_cnt++;
+    struct adr_state *adr = &ctx->adr;
+
+    adr->ack_cnt++;
 
-    if (uw_session.dr != UWAN_DR_0 && ack_cnt > (ack_limit + ack_delay)) {
-        uw_session.dr--;
-        ack_cnt = 0;
+    if (ctx->session.dr != UWAN_DR_0 &&
+        adr->ack_cnt > (adr->ack_limit + adr->ack_delay)) {
+        ctx->session.dr--;
+        adr->ack_cnt = 0;
     }
 }
 
-void adr_handle_downlink()
+void adr_handle_downlink(struct uwan_ctx *ctx)
 {
-    ack_cnt = 0;
+    ctx->adr.ack_cnt = 0;
 }
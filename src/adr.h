@@ -27,12 +27,27 @@
 
 #include <uwan/stack.h>
 
-bool adr_get_req_bit(void);
+struct adr_state {
+    uint32_t ack_cnt;
+    uint8_t ack_limit;
+    uint8_t ack_delay;
+    bool is_enabled;
+};
 
-bool adr_handle_link_req(uint8_t dr_txpow, uint16_t ch_mask, uint8_t redundancy);
+void adr_init(struct uwan_ctx *ctx);
 
-void adr_handle_uplink(void);
+bool adr_get_req_bit(struct uwan_ctx *ctx);
 
-void adr_handle_downlink(void);
+/**
+ * \brief Apply LinkADRReq
+ *
+ * \returns status of LinkADRAns
+ */
+uint8_t adr_handle_link_req(struct uwan_ctx *ctx, uint8_t dr_txpow,
+    uint16_t ch_mask, uint8_t redundancy);
+
+void adr_handle_uplink(struct uwan_ctx *ctx);
+
+void adr_handle_downlink(struct uwan_ctx *ctx);
 
 #endif
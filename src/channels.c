@@ -31,73 +31,205 @@
 #include "stack.h"
 #include "utils.h"
 
-#define MAX_CHANNELS 16
+static bool get_time(struct uwan_ctx *ctx, uint32_t *now)
+{
+    if (ctx->stack_hal == NULL || ctx->stack_hal->get_time_ms == NULL)
+        return false;
+
+    *now = ctx->stack_hal->get_time_ms(ctx);
+    return true;
+}
+
+static uint32_t band_wait(struct band_state *bs, uint32_t now)
+{
+    uint32_t elapsed = now - bs->tx_time; // handles timer overflow
+
+    if (elapsed >= bs->off_time) {
+        bs->off_time = 0;
+        return 0;
+    }
 
-static uint8_t uw_channels_max_count;
-static uint8_t uw_channels_mask[BYTES_FOR_BITS(MAX_CHANNELS)];
-static uint32_t uw_channels[MAX_CHANNELS];
+    return bs->off_time - elapsed;
+}
 
-void channels_init()
+static uint32_t channel_wait(struct uwan_ctx *ctx, uint8_t ch, uint32_t now)
 {
-    memset(uw_channels_mask, 0, sizeof(uw_channels_mask));
-    uw_channels_max_count = 0;
+    struct channels_state *chs = &ctx->channels;
+    uint8_t band = chs->bands[ch];
+
+    if (band == NO_BAND)
+        return 0;
+
+    return band_wait(&chs->band_states[band], now);
 }
 
-uint32_t channels_get_next()
+static uint8_t find_band(struct uwan_ctx *ctx, uint32_t freq)
 {
+    const struct uwan_region *region = ctx->region;
+
+    if (region == NULL || region->bands_count == 0)
+        return NO_BAND;
+
+    for (uint8_t i = 0; i < region->bands_count && i < MAX_BANDS; i++) {
+        if (freq >= region->bands[i].freq_min &&
+            freq < region->bands[i].freq_max)
+            return i;
+    }
+
+    // channels of NewChannelReq or CFList might fall between bands
+    return OTHER_BAND;
+}
+
+void channels_init(struct uwan_ctx *ctx)
+{
+    memset(&ctx->channels, 0, sizeof(ctx->channels));
+}
+
+uint32_t channels_get_next(struct uwan_ctx *ctx)
+{
+    return channels_get_next_except(ctx, 0);
+}
+
+uint32_t channels_get_next_except(struct uwan_ctx *ctx, uint32_t frequency)
+{
+    struct channels_state *chs = &ctx->channels;
     uint8_t ch;
     uint8_t start_ch;
+    uint32_t now = 0;
+    uint32_t fallback = 0;
+    bool dc_enabled = get_time(ctx, &now);
 
-    if (uw_channels_max_count == 0)
+    if (chs->max_count == 0)
         return 0;
 
-    ch = start_ch = utils_get_random(uw_channels_max_count);
+    if (dc_enabled && band_wait(&chs->aggregated, now))
+        return 0;
+
+    ch = start_ch = utils_get_random(&ctx->random, chs->max_count);
 
     do {
-        if (BIT_IS_SET(uw_channels_mask, ch))
-            return uw_channels[ch];
-        ch = (ch + 1) % uw_channels_max_count;
+        if (BIT_IS_SET(chs->mask, ch) &&
+            (!dc_enabled || channel_wait(ctx, ch, now) == 0)) {
+            if (chs->freqs[ch] != frequency)
+                return chs->freqs[ch];
+            fallback = chs->freqs[ch];
+        }
+        ch = (ch + 1) % chs->max_count;
     } while (start_ch != ch);
 
-    return 0;
+    return fallback;
+}
+
+void channels_on_tx(struct uwan_ctx *ctx, uint32_t frequency,
+    uint32_t time_on_air)
+{
+    struct channels_state *chs = &ctx->channels;
+    uint32_t now;
+
+    if (!get_time(ctx, &now))
+        return;
+
+    uint32_t toa_ms = (time_on_air + 999) / 1000;
+    uint8_t band = find_band(ctx, frequency);
+
+    if (band != NO_BAND) {
+        uint16_t duty_cycle = band == OTHER_BAND ? OTHER_BAND_DUTY_CYCLE :
+            ctx->region->bands[band].duty_cycle;
+
+        chs->band_states[band].tx_time = now;
+        chs->band_states[band].off_time = toa_ms * duty_cycle;
+    }
+
+    if (chs->max_dcycle) {
+        chs->aggregated.tx_time = now;
+        chs->aggregated.off_time = toa_ms << chs->max_dcycle;
+    }
+}
+
+void channels_set_max_dcycle(struct uwan_ctx *ctx, uint8_t max_dcycle)
+{
+    ctx->channels.max_dcycle = max_dcycle;
+    if (max_dcycle == 0)
+        ctx->channels.aggregated.off_time = 0;
+}
+
+uint32_t uwan_get_next_tx_delay(struct uwan_ctx *ctx)
+{
+    struct channels_state *chs = &ctx->channels;
+    uint32_t delay = UINT32_MAX;
+    uint32_t now;
+
+    if (!get_time(ctx, &now))
+        return 0;
+
+    // the band available soonest
+    for (uint8_t ch = 0; ch < chs->max_count; ch++) {
+        if (BIT_IS_SET(chs->mask, ch)) {
+            uint32_t wait = channel_wait(ctx, ch, now);
+            if (wait < delay)
+                delay = wait;
+        }
+    }
+
+    if (delay == UINT32_MAX)
+        return 0; // there are no channels, uplink fails anyway
+
+    return MAX(delay, band_wait(&chs->aggregated, now));
 }
 
-void channels_enable_all()
+void channels_enable_all(struct uwan_ctx *ctx)
 {
+    struct channels_state *chs = &ctx->channels;
+
     for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
-        if (uw_channels[i] != 0) {
-            uw_channels_max_count = MAX(uw_channels_max_count, i + 1);
-            BIT_SET(uw_channels_mask, i);
+        if (chs->freqs[i] != 0) {
+            chs->max_count = MAX(chs->max_count, i + 1);
+            BIT_SET(chs->mask, i);
         }
     }
 }
 
-bool channel_is_exist(uint8_t index)
+bool channel_is_exist(struct uwan_ctx *ctx, uint8_t index)
 {
     if (index >= MAX_CHANNELS)
         return false;
 
-    return uw_channels[index] != 0;
+    return ctx->channels.freqs[index] != 0;
 }
 
-enum uwan_errs uwan_enable_channel(uint8_t index, bool enable)
+uint32_t channels_get_rx1_frequency(struct uwan_ctx *ctx, uint32_t frequency)
 {
+    struct channels_state *chs = &ctx->channels;
+
+    for (uint8_t i = 0; i < chs->max_count; i++) {
+        if (chs->freqs[i] == frequency && chs->dl_freqs[i] != 0)
+            return chs->dl_freqs[i];
+    }
+
+    return frequency;
+}
+
+enum uwan_errs uwan_enable_channel(struct uwan_ctx *ctx, uint8_t index,
+    bool enable)
+{
+    struct channels_state *chs = &ctx->channels;
+
     if (index >= MAX_CHANNELS)
         return UWAN_ERR_CHANNEL;
 
     if (enable) {
-        if (uw_channels[index] == 0)
+        if (chs->freqs[index] == 0)
             return UWAN_ERR_CHANNEL;
 
-        uw_channels_max_count = MAX(uw_channels_max_count, index + 1);
-        BIT_SET(uw_channels_mask, index);
+        chs->max_count = MAX(chs->max_count, index + 1);
+        BIT_SET(chs->mask, index);
     }
     else {
-        BIT_CLEAR(uw_channels_mask, index);
-        if (uw_channels_max_count == index + 1) {
+        BIT_CLEAR(chs->mask, index);
+        if (chs->max_count == index + 1) {
             for (uint8_t i = 0; i < index; i++) {
-                if (BIT_IS_SET(uw_channels_mask, i))
-                    uw_channels_max_count = i + 1;
+                if (BIT_IS_SET(chs->mask, i))
+                    chs->max_count = i + 1;
             }
         }
     }
@@ -105,7 +237,8 @@ enum uwan_errs uwan_enable_channel(uint8_t index, bool enable)
     return UWAN_ERR_NO;
 }
 
-enum uwan_errs uwan_set_channel(uint8_t index, uint32_t frequency)
+enum uwan_errs uwan_set_channel(struct uwan_ctx *ctx, uint8_t index,
+    uint32_t frequency)
 {
     if (index >= MAX_CHANNELS)
         return UWAN_ERR_CHANNEL;
@@ -113,8 +246,24 @@ enum uwan_errs uwan_set_channel(uint8_t index, uint32_t frequency)
     if (!is_valid_frequency(frequency))
         return UWAN_ERR_FREQUENCY;
 
-    uw_channels[index] = frequency;
-    uwan_enable_channel(index, true);
+    ctx->channels.freqs[index] = frequency;
+    ctx->channels.dl_freqs[index] = 0;
+    ctx->channels.bands[index] = find_band(ctx, frequency);
+    uwan_enable_channel(ctx, index, true);
+
+    return UWAN_ERR_NO;
+}
+
+enum uwan_errs uwan_set_dl_channel(struct uwan_ctx *ctx, uint8_t index,
+    uint32_t frequency)
+{
+    if (!channel_is_exist(ctx, index))
+        return UWAN_ERR_CHANNEL;
+
+    if (!is_valid_frequency(frequency))
+        return UWAN_ERR_FREQUENCY;
+
+    ctx->channels.dl_freqs[index] = frequency;
 
     return UWAN_ERR_NO;
 }
@@ -25,17 +25,76 @@
 #ifndef __CHANNELS_H__
 #define __CHANNELS_H__
 
+#include <stdbool.h>
 #include <stdint.h>
 
-void channels_init(void);
+#include "utils.h"
 
-uint32_t channels_get_next(void);
+#define MAX_CHANNELS 16
+#define MAX_BANDS 6
+#define NO_BAND 0xff // region has no bands
+#define OTHER_BAND MAX_BANDS // gaps between bands of region
+#define OTHER_BAND_DUTY_CYCLE 1000 // 0.1%, the strictest limit
 
-bool channel_is_exist(uint8_t index);
+struct uwan_ctx;
+
+struct band_state {
+    uint32_t tx_time; // ms
+    uint32_t off_time; // ms, 0 if band is available
+};
+
+struct channels_state {
+    uint8_t max_count;
+    uint8_t mask[BYTES_FOR_BITS(MAX_CHANNELS)];
+    uint32_t freqs[MAX_CHANNELS];
+    uint32_t dl_freqs[MAX_CHANNELS]; // RX1 frequency, 0 if it's uplink one
+    uint8_t bands[MAX_CHANNELS];
+    struct band_state band_states[MAX_BANDS + 1]; // the last is OTHER_BAND
+    struct band_state aggregated;
+    uint8_t max_dcycle;
+};
+
+void channels_init(struct uwan_ctx *ctx);
+
+/**
+ * \brief Pick random enabled channel which is allowed by duty cycle
+ *
+ * \returns frequency of channel or 0 if there is no available channel
+ */
+uint32_t channels_get_next(struct uwan_ctx *ctx);
+
+/**
+ * \brief Pick channel like channels_get_next, but prefer other than given
+ *
+ * \param frequency frequency to avoid, it's returned if nothing else is
+ *                  available
+ */
+uint32_t channels_get_next_except(struct uwan_ctx *ctx, uint32_t frequency);
+
+/**
+ * \brief Start time-off of sub-band after transmission
+ *
+ * \param frequency frequency of used channel
+ * \param time_on_air time on air in microseconds
+ */
+void channels_on_tx(struct uwan_ctx *ctx, uint32_t frequency,
+    uint32_t time_on_air);
+
+/**
+ * \brief Set aggregated duty cycle 1/2^max_dcycle, 0 means no limit
+ */
+void channels_set_max_dcycle(struct uwan_ctx *ctx, uint8_t max_dcycle);
+
+bool channel_is_exist(struct uwan_ctx *ctx, uint8_t index);
+
+/**
+ * \brief Return RX1 frequency for uplink sent on given frequency
+ */
+uint32_t channels_get_rx1_frequency(struct uwan_ctx *ctx, uint32_t frequency);
 
 /**
  * \brief Enable all defined channels
  */
-void channels_enable_all(void);
+void channels_enable_all(struct uwan_ctx *ctx);
 
 #endif
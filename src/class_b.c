@@ -0,0 +1,438 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <string.h>
+
+#include "class_b.h"
+#include "stack.h"
+
+/* See LoRaWAN 1.0.3 Class B and Regional Parameters */
+#define BEACON_PERIOD_S 128
+#define BEACON_PERIOD_MS (BEACON_PERIOD_S * 1000UL)
+#define BEACON_RESERVED_MS 2120
+#define BEACON_PREAMBLE_LEN 10
+#define BEACON_SIZE 17 // EU868 and RU864 layout
+#define BEACON_TIME_OFFSET 2
+#define BEACON_CRC_OFFSET 6
+#define BEACONLESS_MAX 56 // missed beacons, 2 hours of beacon-less operation
+#define BEACON_ACQ_MARGIN_MS 100 // accuracy of network time
+#define BEACON_RETRY_MS 1000 // radio is busy with uplink
+#define PING_SLOT_MS 30
+#define PING_PERIODICITY_MAX 7
+
+/* slots between two ping slots and ping slots per beacon period */
+#define PING_PERIOD(periodicity) (32U << (periodicity))
+#define PING_NB(periodicity) (128U >> (periodicity))
+
+static const uint8_t ping_key[UWAN_AES_BLOCK_SIZE];
+
+static uint32_t get_time(struct uwan_ctx *ctx)
+{
+    return ctx->stack_hal->get_time_ms(ctx);
+}
+
+/* CRC-16 with polynomial 0x1021 and zero initial value */
+static uint16_t calc_crc(const uint8_t *buf, size_t len)
+{
+    uint16_t crc = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)buf[i] << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
+
+static void get_beacon_params(struct uwan_ctx *ctx,
+    struct uwan_packet_params *params)
+{
+    *params = ctx->pkt_params;
+    set_dr_params(params, ctx->class_b.beacon_dr);
+    params->preamble_len = BEACON_PREAMBLE_LEN;
+    params->crc_on = false;
+    params->inverted_iq = false;
+    params->implicit_header = true;
+}
+
+static uint32_t get_beacon_toa(struct uwan_ctx *ctx)
+{
+    struct uwan_packet_params params;
+
+    get_beacon_params(ctx, &params);
+    return uwan_time_on_air_params(&params, BEACON_SIZE) / 1000;
+}
+
+static void report(struct uwan_ctx *ctx, enum uwan_errs err,
+    uint32_t gps_time)
+{
+    if (ctx->stack_hal->beacon_callback)
+        ctx->stack_hal->beacon_callback(ctx, err, gps_time);
+}
+
+static void stop_rx(struct uwan_ctx *ctx)
+{
+    if (ctx->class_b.rx == CLASS_B_RX_NONE)
+        return;
+
+    ctx->class_b.rx = CLASS_B_RX_NONE;
+    ctx->radio->sleep();
+}
+
+static void open_beacon_rx(struct uwan_ctx *ctx, uint16_t symb_timeout,
+    uint32_t timeout)
+{
+    struct uwan_packet_params params;
+
+    get_beacon_params(ctx, &params);
+    ctx->radio->set_frequency(ctx->class_b.beacon_frequency);
+    ctx->radio->setup(&params);
+    ctx->radio->rx(BEACON_SIZE, symb_timeout, timeout);
+    ctx->class_b.rx = CLASS_B_RX_BEACON;
+}
+
+/*
+ * Window of the next beacon is opened at expected time if network time is
+ * known, otherwise the search starts after delay and lasts a beacon period
+ */
+static void acquire(struct uwan_ctx *ctx, uint32_t delay)
+{
+    struct class_b_state *b = &ctx->class_b;
+
+    if (b->time_valid) {
+        uint32_t elapsed = get_time(ctx) - b->gps_time_ref;
+        uint32_t phase = ((b->gps_time % BEACON_PERIOD_S) * 1000 +
+            elapsed % BEACON_PERIOD_MS) % BEACON_PERIOD_MS;
+
+        delay = BEACON_PERIOD_MS - phase;
+        if (delay < BEACON_ACQ_MARGIN_MS)
+            delay += BEACON_PERIOD_MS;
+        delay -= BEACON_ACQ_MARGIN_MS;
+    }
+
+    ctx->stack_hal->start_timer(ctx, UWAN_TIMER_BEACON, delay);
+}
+
+static void lose_beacon(struct uwan_ctx *ctx)
+{
+    class_b_stop(ctx);
+    ctx->dev_class = UWAN_CLASS_A;
+    report(ctx, UWAN_ERR_NO_BEACON, 0);
+}
+
+/* returns false if beacon-less operation is over */
+static bool on_beacon_missed(struct uwan_ctx *ctx)
+{
+    if (++ctx->class_b.missed > BEACONLESS_MAX) {
+        lose_beacon(ctx);
+        return false;
+    }
+
+    report(ctx, UWAN_ERR_RX_TIMEOUT, ctx->class_b.beacon_time);
+    return true;
+}
+
+static uint16_t calc_ping_offset(struct uwan_ctx *ctx)
+{
+    struct class_b_state *b = &ctx->class_b;
+    uint8_t block[UWAN_AES_BLOCK_SIZE] = {0};
+
+    block[0] = b->beacon_time & 0xff;
+    block[1] = (b->beacon_time >> 8) & 0xff;
+    block[2] = (b->beacon_time >> 16) & 0xff;
+    block[3] = (b->beacon_time >> 24) & 0xff;
+    block[4] = ctx->session.dev_addr & 0xff;
+    block[5] = (ctx->session.dev_addr >> 8) & 0xff;
+    block[6] = (ctx->session.dev_addr >> 16) & 0xff;
+    block[7] = (ctx->session.dev_addr >> 24) & 0xff;
+    ctx->stack_hal->crypto_aes_encrypt(b->ping_key_aes, block, block);
+
+    return (block[0] | (block[1] << 8)) % b->ping_period;
+}
+
+/*
+ * Windows are widened by the clock error accumulated since the last received
+ * beacon, returns false if it's too late to open the window
+ */
+static bool schedule_rx(struct uwan_ctx *ctx, enum uwan_timer_ids timer_id,
+    uint32_t start, enum uwan_dr dr, uint16_t *symb_timeout)
+{
+    struct class_b_state *b = &ctx->class_b;
+    uint32_t open = b->beacon_ref + calc_rx_window(ctx, dr,
+        start - b->beacon_ref, symb_timeout);
+    int32_t delay = (int32_t)(open - get_time(ctx));
+
+    if (delay < 0)
+        return false;
+
+    ctx->stack_hal->start_timer(ctx, timer_id, delay);
+    return true;
+}
+
+static void schedule_ping_slot(struct uwan_ctx *ctx)
+{
+    struct class_b_state *b = &ctx->class_b;
+
+    for (; b->slot < b->ping_nb; b->slot++) {
+        uint32_t start = b->period_start + BEACON_RESERVED_MS +
+            (b->ping_offset + b->slot * b->ping_period) * PING_SLOT_MS;
+
+        if (schedule_rx(ctx, UWAN_TIMER_PING_SLOT, start, b->ping_dr,
+                &b->ping_symb_timeout))
+            return;
+    }
+}
+
+static void start_period(struct uwan_ctx *ctx)
+{
+    struct class_b_state *b = &ctx->class_b;
+
+    b->ping_period = PING_PERIOD(b->periodicity);
+    b->ping_nb = PING_NB(b->periodicity);
+    b->ping_offset = calc_ping_offset(ctx);
+    b->slot = 0;
+    schedule_ping_slot(ctx);
+
+    if (!schedule_rx(ctx, UWAN_TIMER_BEACON, b->period_start +
+            BEACON_PERIOD_MS, b->beacon_dr, &b->beacon_symb_timeout))
+        ctx->stack_hal->start_timer(ctx, UWAN_TIMER_BEACON, 0);
+}
+
+static bool is_radio_free(struct uwan_ctx *ctx)
+{
+    return ctx->state == UWAN_STATE_IDLE &&
+        ctx->class_b.rx == CLASS_B_RX_NONE;
+}
+
+static void on_beacon_timer(struct uwan_ctx *ctx)
+{
+    struct class_b_state *b = &ctx->class_b;
+
+    if (!b->locked) {
+        if (b->rx == CLASS_B_RX_BEACON) {
+            // acquisition window is over
+            stop_rx(ctx);
+            lose_beacon(ctx);
+        }
+        else if (!is_radio_free(ctx)) {
+            acquire(ctx, BEACON_RETRY_MS);
+        }
+        else {
+            uint32_t window = b->time_valid ? 2 * BEACON_ACQ_MARGIN_MS :
+                BEACON_PERIOD_MS;
+
+            open_beacon_rx(ctx, 0, UWAN_RX_INFINITE);
+            ctx->stack_hal->start_timer(ctx, UWAN_TIMER_BEACON,
+                window + get_beacon_toa(ctx));
+        }
+        return;
+    }
+
+    b->period_start += BEACON_PERIOD_MS;
+    b->beacon_time += BEACON_PERIOD_S;
+
+    if (is_radio_free(ctx))
+        open_beacon_rx(ctx, b->beacon_symb_timeout, 0);
+    else if (on_beacon_missed(ctx))
+        start_period(ctx);
+}
+
+static void on_ping_timer(struct uwan_ctx *ctx)
+{
+    struct class_b_state *b = &ctx->class_b;
+
+    // downlink would overwrite reserved frame
+    if (!is_radio_free(ctx) || ctx->frame_rsv_offset) {
+        b->slot++;
+        schedule_ping_slot(ctx);
+        return;
+    }
+
+    set_dr_params(&ctx->pkt_params, b->ping_dr);
+    ctx->pkt_params.inverted_iq = true;
+    ctx->radio->set_frequency(b->ping_frequency);
+    ctx->radio->setup(&ctx->pkt_params);
+    ctx->radio->rx(FRAME_MAX_SIZE, b->ping_symb_timeout, 0);
+    b->rx = CLASS_B_RX_PING;
+}
+
+void class_b_init(struct uwan_ctx *ctx)
+{
+    memset(&ctx->class_b, 0, sizeof(ctx->class_b));
+
+    ctx->class_b.periodicity = PING_PERIODICITY_MAX;
+    class_b_set_beacon_frequency(ctx, 0);
+    class_b_set_ping_channel(ctx, 0, ctx->region->beacon_dr);
+}
+
+bool class_b_start(struct uwan_ctx *ctx)
+{
+    struct class_b_state *b = &ctx->class_b;
+
+    if (!b->ping_key_aes)
+        b->ping_key_aes = ctx->stack_hal->crypto_aes_create_context(ping_key);
+    if (!b->ping_key_aes)
+        return false;
+
+    b->locked = false;
+    b->missed = 0;
+    acquire(ctx, 0);
+
+    return true;
+}
+
+void class_b_stop(struct uwan_ctx *ctx)
+{
+    struct class_b_state *b = &ctx->class_b;
+
+    ctx->stack_hal->stop_timer(ctx, UWAN_TIMER_BEACON);
+    ctx->stack_hal->stop_timer(ctx, UWAN_TIMER_PING_SLOT);
+    stop_rx(ctx);
+    b->locked = false;
+
+    if (b->ping_key_aes) {
+        ctx->stack_hal->crypto_aes_delete_context(b->ping_key_aes);
+        b->ping_key_aes = NULL;
+    }
+}
+
+void class_b_set_time(struct uwan_ctx *ctx, uint32_t gps_time,
+    uint32_t ref_ms)
+{
+    ctx->class_b.gps_time = gps_time;
+    ctx->class_b.gps_time_ref = ref_ms;
+    ctx->class_b.time_valid = true;
+}
+
+void class_b_set_ping_channel(struct uwan_ctx *ctx, uint32_t frequency,
+    enum uwan_dr dr)
+{
+    ctx->class_b.ping_frequency = frequency ? frequency :
+        ctx->region->ping_frequency;
+    ctx->class_b.ping_dr = dr;
+}
+
+void class_b_set_beacon_frequency(struct uwan_ctx *ctx, uint32_t frequency)
+{
+    ctx->class_b.beacon_frequency = frequency ? frequency :
+        ctx->region->beacon_frequency;
+    ctx->class_b.beacon_dr = ctx->region->beacon_dr;
+}
+
+void class_b_on_timer(struct uwan_ctx *ctx, enum uwan_timer_ids timer_id)
+{
+    if (ctx->dev_class != UWAN_CLASS_B)
+        return;
+
+    if (timer_id == UWAN_TIMER_BEACON)
+        on_beacon_timer(ctx);
+    else if (timer_id == UWAN_TIMER_PING_SLOT)
+        on_ping_timer(ctx);
+}
+
+void class_b_on_beacon(struct uwan_ctx *ctx, uint8_t evt_mask,
+    uint32_t elapsed)
+{
+    struct class_b_state *b = &ctx->class_b;
+    uint8_t buf[BEACON_SIZE];
+    struct uwan_dl_packet pkt = {
+        .data = buf,
+        .size = sizeof(buf),
+    };
+    uint32_t time = 0;
+    bool valid = false;
+
+    if ((evt_mask & RADIO_IRQF_RX_DONE) &&
+        !(evt_mask & RADIO_IRQF_CRC_ERROR)) {
+        ctx->radio->read_packet(&pkt);
+
+        const uint8_t *p = &buf[BEACON_TIME_OFFSET];
+        time = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+        valid = pkt.size == BEACON_SIZE && time % BEACON_PERIOD_S == 0 &&
+            calc_crc(buf, BEACON_CRC_OFFSET) ==
+            (buf[BEACON_CRC_OFFSET] | (buf[BEACON_CRC_OFFSET + 1] << 8));
+    }
+
+    if (!b->locked) {
+        if (!valid) {
+            // keep searching until the acquisition window is over
+            ctx->radio->rx(BEACON_SIZE, 0, UWAN_RX_INFINITE);
+            return;
+        }
+        ctx->stack_hal->stop_timer(ctx, UWAN_TIMER_BEACON);
+    }
+
+    stop_rx(ctx);
+
+    if (valid) {
+        b->beacon_ref = get_time(ctx) - elapsed - get_beacon_toa(ctx);
+        b->period_start = b->beacon_ref;
+        b->beacon_time = time;
+        b->missed = 0;
+        b->locked = true;
+        class_b_set_time(ctx, time, b->beacon_ref);
+        report(ctx, UWAN_ERR_NO, time);
+    }
+    else if (!on_beacon_missed(ctx)) {
+        return;
+    }
+
+    start_period(ctx);
+}
+
+void class_b_on_ping_end(struct uwan_ctx *ctx)
+{
+    stop_rx(ctx);
+    ctx->class_b.slot++;
+    schedule_ping_slot(ctx);
+}
+
+void class_b_preempt(struct uwan_ctx *ctx)
+{
+    struct class_b_state *b = &ctx->class_b;
+
+    if (b->rx == CLASS_B_RX_PING) {
+        class_b_on_ping_end(ctx);
+    }
+    else if (b->rx == CLASS_B_RX_BEACON && !b->locked) {
+        stop_rx(ctx);
+        acquire(ctx, BEACON_RETRY_MS);
+    }
+    else if (b->rx == CLASS_B_RX_BEACON) {
+        stop_rx(ctx);
+        if (on_beacon_missed(ctx))
+            start_period(ctx);
+    }
+}
+
+bool uwan_set_ping_slot_periodicity(struct uwan_ctx *ctx,
+    uint8_t periodicity)
+{
+    if (periodicity > PING_PERIODICITY_MAX)
+        return false;
+
+    ctx->class_b.periodicity = periodicity;
+
+    return true;
+}
@@ -0,0 +1,111 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __CLASS_B_H__
+#define __CLASS_B_H__
+
+#include <uwan/stack.h>
+
+enum class_b_rx {
+    CLASS_B_RX_NONE,
+    CLASS_B_RX_BEACON,
+    CLASS_B_RX_PING,
+};
+
+struct class_b_state {
+    enum class_b_rx rx; // what the radio is receiving now
+    bool locked; // false while beacon is acquired
+    bool time_valid;
+    uint32_t gps_time; // s, network time at gps_time_ref
+    uint32_t gps_time_ref; // ms, local time
+    uint32_t beacon_time; // s, GPS time of current beacon period
+    uint32_t period_start; // ms, local time of current beacon
+    uint32_t beacon_ref; // ms, local time of last received beacon
+    uint8_t missed; // beacons missed in a row
+    uint8_t periodicity;
+    uint8_t ping_nb; // ping slots of current period
+    uint16_t ping_period; // slots between ping slots
+    uint8_t slot; // next ping slot of current period
+    uint16_t ping_offset;
+    uint16_t beacon_symb_timeout;
+    uint16_t ping_symb_timeout;
+    uint32_t beacon_frequency;
+    enum uwan_dr beacon_dr;
+    uint32_t ping_frequency;
+    enum uwan_dr ping_dr;
+    void *ping_key_aes; // zero key for ping slot offset
+};
+
+void class_b_init(struct uwan_ctx *ctx);
+
+/**
+ * \brief Start beacon acquisition
+ *
+ * \returns false if crypto context of ping slot offset isn't available
+ */
+bool class_b_start(struct uwan_ctx *ctx);
+
+void class_b_stop(struct uwan_ctx *ctx);
+
+/**
+ * \brief Set network time, used by beacon acquisition
+ *
+ * \param gps_time GPS time in seconds
+ * \param ref_ms local time of gps_time
+ */
+void class_b_set_time(struct uwan_ctx *ctx, uint32_t gps_time,
+    uint32_t ref_ms);
+
+/**
+ * \brief Set ping slot channel, 0 frequency means default one
+ */
+void class_b_set_ping_channel(struct uwan_ctx *ctx, uint32_t frequency,
+    enum uwan_dr dr);
+
+/**
+ * \brief Set beacon frequency, 0 means default one
+ */
+void class_b_set_beacon_frequency(struct uwan_ctx *ctx, uint32_t frequency);
+
+void class_b_on_timer(struct uwan_ctx *ctx, enum uwan_timer_ids timer_id);
+
+/**
+ * \brief Handle radio event of beacon reception
+ *
+ * \param elapsed time in ms since the radio raised the event
+ */
+void class_b_on_beacon(struct uwan_ctx *ctx, uint8_t evt_mask,
+    uint32_t elapsed);
+
+/**
+ * \brief Finish ping slot reception and schedule the next slot
+ */
+void class_b_on_ping_end(struct uwan_ctx *ctx);
+
+/**
+ * \brief Abort reception because the radio is needed for uplink
+ */
+void class_b_preempt(struct uwan_ctx *ctx);
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <uwan/crypto.h>
+
+/* See RFC 4493 */
+
+#define CMAC_RB 0x87
+
+static void gen_subkey(uint8_t *dst, const uint8_t *src)
+{
+    uint8_t msb = src[0] & 0x80;
+
+    for (int i = 0; i < UWAN_AES_BLOCK_SIZE - 1; i++)
+        dst[i] = (src[i] << 1) | (src[i + 1] >> 7);
+    dst[UWAN_AES_BLOCK_SIZE - 1] = src[UWAN_AES_BLOCK_SIZE - 1] << 1;
+
+    if (msb)
+        dst[UWAN_AES_BLOCK_SIZE - 1] ^= CMAC_RB;
+}
+
+static void xor_block(uint8_t *dst, const uint8_t *src)
+{
+    for (int i = 0; i < UWAN_AES_BLOCK_SIZE; i++)
+        dst[i] ^= src[i];
+}
+
+void uwan_cmac_init(struct uwan_cmac_ctx *ctx,
+    const uint8_t key[UWAN_AES_BLOCK_SIZE])
+{
+    uint8_t l[UWAN_AES_BLOCK_SIZE] = {0};
+
+    uwan_aes_init(&ctx->aes, key);
+    uwan_aes_encrypt(&ctx->aes, l, l);
+    gen_subkey(ctx->k1, l);
+    gen_subkey(ctx->k2, ctx->k1);
+
+    uwan_cmac_reset(ctx);
+}
+
+void uwan_cmac_reset(struct uwan_cmac_ctx *ctx)
+{
+    memset(ctx->x, 0, sizeof(ctx->x));
+    ctx->last_len = 0;
+}
+
+void uwan_cmac_update(struct uwan_cmac_ctx *ctx, const void *src, size_t len)
+{
+    const uint8_t *data = src;
+
+    while (len > 0) {
+        // the last block is processed by finish with one of subkeys
+        if (ctx->last_len == UWAN_AES_BLOCK_SIZE) {
+            xor_block(ctx->x, ctx->last);
+            uwan_aes_encrypt(&ctx->aes, ctx->x, ctx->x);
+            ctx->last_len = 0;
+        }
+
+        size_t chunk = UWAN_AES_BLOCK_SIZE - ctx->last_len;
+        if (chunk > len)
+            chunk = len;
+
+        memcpy(ctx->last + ctx->last_len, data, chunk);
+        ctx->last_len += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+void uwan_cmac_finish(struct uwan_cmac_ctx *ctx,
+    uint8_t digest[UWAN_CMAC_DIGESTLEN])
+{
+    if (ctx->last_len == UWAN_AES_BLOCK_SIZE) {
+        xor_block(ctx->last, ctx->k1);
+    }
+    else {
+        ctx->last[ctx->last_len] = 0x80;
+        memset(ctx->last + ctx->last_len + 1, 0,
+            UWAN_AES_BLOCK_SIZE - ctx->last_len - 1);
+        xor_block(ctx->last, ctx->k2);
+    }
+
+    xor_block(ctx->x, ctx->last);
+    uwan_aes_encrypt(&ctx->aes, digest, ctx->x);
+
+    uwan_cmac_reset(ctx);
+}
@@ -0,0 +1,113 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <uwan/crypto.h>
+#include "../stack.h"
+#include "../utils.h"
+
+/*
+ * Each stack instance keeps 3 AES and 2 CMAC contexts of the session, AES
+ * and CMAC of each multicast group, AES of McKEKey and of the class B ping
+ * slot offset. One context of each kind is spare for temporary keys.
+ */
+#ifndef UWAN_CRYPTO_AES_POOL_SIZE
+#define UWAN_CRYPTO_AES_POOL_SIZE \
+    ((6 + UWAN_MC_GROUPS) * UWAN_MAX_CONTEXTS)
+#endif
+
+#ifndef UWAN_CRYPTO_CMAC_POOL_SIZE
+#define UWAN_CRYPTO_CMAC_POOL_SIZE \
+    ((3 + UWAN_MC_GROUPS) * UWAN_MAX_CONTEXTS)
+#endif
+
+static struct uwan_aes_ctx aes_pool[UWAN_CRYPTO_AES_POOL_SIZE];
+static bool aes_pool_used[UWAN_CRYPTO_AES_POOL_SIZE];
+static struct uwan_cmac_ctx cmac_pool[UWAN_CRYPTO_CMAC_POOL_SIZE];
+static bool cmac_pool_used[UWAN_CRYPTO_CMAC_POOL_SIZE];
+
+void *uwan_crypto_aes_create_context(const uint8_t key[UWAN_AES_BLOCK_SIZE])
+{
+    for (int i = 0; i < UWAN_CRYPTO_AES_POOL_SIZE; i++) {
+        if (UTILS_CLAIM(&aes_pool_used[i])) {
+            uwan_aes_init(&aes_pool[i], key);
+            return &aes_pool[i];
+        }
+    }
+
+    return NULL;
+}
+
+void uwan_crypto_aes_encrypt(void *ctx, void *dst, const void *src)
+{
+    uwan_aes_encrypt(ctx, dst, src);
+}
+
+void uwan_crypto_aes_encrypt_blocks(void *ctx, void *dst, const void *src,
+    size_t count)
+{
+    uwan_aes_encrypt_blocks(ctx, dst, src, count);
+}
+
+void uwan_crypto_aes_delete_context(void *ctx)
+{
+    struct uwan_aes_ctx *aes = ctx;
+    memset(aes, 0, sizeof(*aes));
+    UTILS_RELEASE(&aes_pool_used[aes - aes_pool]);
+}
+
+void *uwan_crypto_cmac_create_context(const uint8_t key[UWAN_AES_BLOCK_SIZE])
+{
+    for (int i = 0; i < UWAN_CRYPTO_CMAC_POOL_SIZE; i++) {
+        if (UTILS_CLAIM(&cmac_pool_used[i])) {
+            uwan_cmac_init(&cmac_pool[i], key);
+            return &cmac_pool[i];
+        }
+    }
+
+    return NULL;
+}
+
+void uwan_crypto_cmac_update(void *ctx, const void *src, size_t len)
+{
+    uwan_cmac_update(ctx, src, len);
+}
+
+void uwan_crypto_cmac_finish(void *ctx, uint8_t digest[UWAN_CMAC_DIGESTLEN])
+{
+    uwan_cmac_finish(ctx, digest);
+}
+
+void uwan_crypto_cmac_delete_context(void *ctx)
+{
+    struct uwan_cmac_ctx *cmac = ctx;
+    memset(cmac, 0, sizeof(*cmac));
+    UTILS_RELEASE(&cmac_pool_used[cmac - cmac_pool]);
+}
+
+void uwan_crypto_cmac_reset(void *ctx)
+{
+    uwan_cmac_reset(ctx);
+}
@@ -41,7 +41,8 @@ static void sx126x_rx(uint8_t len, uint16_t symb_timeout, uint32_t timeout);
 static void sx126x_read_packet(struct uwan_dl_packet *pkt);
 static uint32_t sx126x_rand(void);
 static uint8_t sx126x_irq_handler(void);
-static void sx126x_set_evt_handler(void (*handler)(uint8_t evt_mask));
+static void sx126x_set_evt_handler(void (*handler)(void *arg, uint8_t evt_mask),
+    void *arg);
 static uint32_t sx126x_get_tcxo_timeout(void);
 
 /* private pointer to actual HAL */
@@ -50,7 +51,8 @@ static const struct radio_hal *hal;
 static const struct sx126x_opts *dev_opts;
 
 static bool is_sleep;
-static void (*user_evt_handler)(uint8_t evt_mask);
+static void (*user_evt_handler)(void *arg, uint8_t evt_mask);
+static void *user_evt_arg;
 static struct uwan_packet_params pkt_params;
 
 /* export radio driver */
@@ -513,14 +515,16 @@ static uint8_t sx126x_irq_handler()
         result |= RADIO_IRQF_CRC_ERROR;
 
     if (user_evt_handler)
-        user_evt_handler(result);
+        user_evt_handler(user_evt_arg, result);
 
     return result;
 }
 
-static void sx126x_set_evt_handler(void (*handler)(uint8_t evt_mask))
+static void sx126x_set_evt_handler(void (*handler)(void *arg, uint8_t evt_mask),
+    void *arg)
 {
     user_evt_handler = handler;
+    user_evt_arg = arg;
 }
 
 static uint32_t sx126x_get_tcxo_timeout()
@@ -36,7 +36,8 @@ static void sx127x_rx(uint8_t len, uint16_t symb_timeout, uint32_t timeout);
 static void sx127x_read_packet(struct uwan_dl_packet *pkt);
 static uint32_t sx127x_rand(void);
 static uint8_t sx127x_irq_handler(void);
-static void sx127x_set_evt_handler(void (*handler)(uint8_t evt_mask));
+static void sx127x_set_evt_handler(void (*handler)(void *arg, uint8_t evt_mask),
+    void *arg);
 
 /* lookup table for spreading factor */
 static const uint8_t sf_table[] = {
@@ -68,7 +69,8 @@ static const uint8_t cr_table[] = {
 static const struct radio_hal *hal;
 
 static int16_t rssi_offset;
-static void (*user_evt_handler)(uint8_t evt_mask);
+static void (*user_evt_handler)(void *arg, uint8_t evt_mask);
+static void *user_evt_arg;
 
 /* export radio driver */
 const struct radio_dev sx127x_dev = {
@@ -450,12 +452,14 @@ static uint8_t sx127x_irq_handler()
     write_reg(SX127X_REG_LR_IRQ_FLAGS, cflags);
 
     if (user_evt_handler)
-        user_evt_handler(result);
+        user_evt_handler(user_evt_arg, result);
 
     return result;
 }
 
-static void sx127x_set_evt_handler(void (*handler)(uint8_t evt_mask))
+static void sx127x_set_evt_handler(void (*handler)(void *arg, uint8_t evt_mask),
+    void *arg)
 {
     user_evt_handler = handler;
+    user_evt_arg = arg;
 }
@@ -0,0 +1,73 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "event.h"
+
+#define RING_MASK (UWAN_EVENT_RING_SIZE - 1)
+
+typedef char ring_size_check[
+    (UWAN_EVENT_RING_SIZE & RING_MASK) == 0 &&
+    UWAN_EVENT_RING_SIZE <= 128 ? 1 : -1];
+
+void event_ring_init(struct event_ring *ring)
+{
+    memset(ring, 0, sizeof(*ring));
+}
+
+bool event_push(struct event_ring *ring, const struct event *evt)
+{
+    uint8_t head = EVENT_LOAD_RELAXED(&ring->head);
+    uint8_t tail = EVENT_LOAD_ACQUIRE(&ring->tail);
+
+    if ((uint8_t)(head - tail) == UWAN_EVENT_RING_SIZE)
+        return false;
+
+    ring->events[head & RING_MASK] = *evt;
+    // publish the event after it has been written
+    EVENT_STORE_RELEASE(&ring->head, (uint8_t)(head + 1));
+
+    return true;
+}
+
+bool event_pop(struct event_ring *ring, struct event *evt)
+{
+    uint8_t tail = EVENT_LOAD_RELAXED(&ring->tail);
+    uint8_t head = EVENT_LOAD_ACQUIRE(&ring->head);
+
+    if (head == tail)
+        return false;
+
+    *evt = ring->events[tail & RING_MASK];
+    // release the slot after it has been read
+    EVENT_STORE_RELEASE(&ring->tail, (uint8_t)(tail + 1));
+
+    return true;
+}
+
+bool event_pending(struct event_ring *ring)
+{
+    return EVENT_LOAD_ACQUIRE(&ring->head) != EVENT_LOAD_RELAXED(&ring->tail);
+}
@@ -0,0 +1,86 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __EVENT_H__
+#define __EVENT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef UWAN_EVENT_RING_SIZE
+#define UWAN_EVENT_RING_SIZE 8 // power of two, 128 at most
+#endif
+
+/* GCC and Clang builtins, define them for other compilers */
+#ifndef EVENT_LOAD_RELAXED
+#define EVENT_LOAD_RELAXED(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#endif
+#ifndef EVENT_LOAD_ACQUIRE
+#define EVENT_LOAD_ACQUIRE(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#endif
+#ifndef EVENT_STORE_RELEASE
+#define EVENT_STORE_RELEASE(ptr, val) \
+    __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#endif
+
+enum event_types {
+    EVENT_RADIO,
+    EVENT_TIMER,
+};
+
+struct event {
+    uint8_t type;
+    uint8_t data; // radio IRQ flags or timer id
+    uint32_t time; // ms, 0 if time isn't available
+};
+
+/* single producer (interrupts) and single consumer (stack task) */
+struct event_ring {
+    struct event events[UWAN_EVENT_RING_SIZE];
+    uint8_t head; // written by producer only
+    uint8_t tail; // written by consumer only
+};
+
+void event_ring_init(struct event_ring *ring);
+
+/**
+ * \brief Put event into ring, producer side
+ *
+ * \returns false if the ring is full
+ */
+bool event_push(struct event_ring *ring, const struct event *evt);
+
+/**
+ * \brief Take the oldest event from ring, consumer side
+ *
+ * \returns false if the ring is empty
+ */
+bool event_pop(struct event_ring *ring, struct event *evt);
+
+/**
+ * \brief Check if ring has events, consumer side
+ */
+bool event_pending(struct event_ring *ring);
+
+#endif
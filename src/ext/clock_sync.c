@@ -51,6 +51,7 @@ static int nb_trans_prev;
 static bool app_time_req_pending;
 static uint8_t state_token_req;
 
+static struct uwan_ctx *cs_ctx;
 static struct uwan_clock_sync_callbacks *cs_callbacks;
 static uint8_t ans_buf[BUF_SIZE];
 static uint8_t ans_buf_data_size;
@@ -172,8 +173,10 @@ static void handle_answ(const uint8_t *buf, uint8_t size)
     ans_pending = ans_buf_offset != 0;
 }
 
-void uwan_clock_sync_init(struct uwan_clock_sync_callbacks *cbs)
+void uwan_clock_sync_init(struct uwan_ctx *ctx,
+    struct uwan_clock_sync_callbacks *cbs)
 {
+    cs_ctx = ctx;
     cs_callbacks = cbs;
     state_token_req = 0;
     app_time_req_pending = false;
@@ -233,7 +236,8 @@ enum uwan_errs uwan_clock_sync_send_time_req(bool ans_required)
     rq_buf[offset++] = cur_time >> 24;
     rq_buf[offset++] = state_token_req | (ans_required << 4);
 
-    return uwan_send_frame(UWAN_EXT_CLOCK_SYNC_PORT, rq_buf, offset, false);
+    return uwan_send_frame(cs_ctx, UWAN_EXT_CLOCK_SYNC_PORT, rq_buf, offset,
+        false);
 }
 
 bool uwan_clock_sync_is_answ_pending()
@@ -246,6 +250,6 @@ enum uwan_errs uwan_clock_sync_send_answ()
     if (ans_pending == false)
         return UWAN_ERR_STATE;
 
-    return uwan_send_frame(UWAN_EXT_CLOCK_SYNC_PORT, ans_buf, ans_buf_data_size,
-        false);
+    return uwan_send_frame(cs_ctx, UWAN_EXT_CLOCK_SYNC_PORT, ans_buf,
+        ans_buf_data_size, false);
 }
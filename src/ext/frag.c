@@ -0,0 +1,483 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <uwan/ext/frag.h>
+#include "../utils.h"
+
+#define PACKAGE_ID 3
+#define PACKAGE_VERSION 1
+
+/* Commands transmitted by end device */
+#define PACKAGE_VERSION_ANS 0x0
+#define FRAG_SESSION_STATUS_ANS 0x1
+#define FRAG_SESSION_SETUP_ANS 0x2
+#define FRAG_SESSION_DELETE_ANS 0x3
+
+/* Commands transmitted by server */
+#define PACKAGE_VERSION_REQ 0x0
+#define FRAG_SESSION_STATUS_REQ 0x1
+#define FRAG_SESSION_SETUP_REQ 0x2
+#define FRAG_SESSION_DELETE_REQ 0x3
+#define DATA_FRAGMENT 0x8
+
+#define BUF_SIZE 32
+#define FRAG_SESSION_SETUP_REQ_LEN 10
+#define DATA_FRAGMENT_HDR_LEN 2
+
+/* FragSessionSetupAns status bits */
+#define SETUP_ENCODING_UNSUPPORTED (1 << 0)
+#define SETUP_NOT_ENOUGH_MEMORY (1 << 1)
+#define SETUP_INDEX_UNSUPPORTED (1 << 2)
+
+/* FragSessionDeleteAns status bits */
+#define DELETE_NO_SESSION (1 << 2)
+
+/* FragSessionStatusAns status bits */
+#define STATUS_NO_MATRIX_MEMORY (1 << 0)
+
+#define FRAG_INDEX_MASK 0x3
+#define FRAG_COUNTER_MASK 0x3fff
+#define FRAG_INDEX_SHIFT 14
+
+#ifndef UWAN_FRAG_MAX_NB
+#define UWAN_FRAG_MAX_NB 1024
+#endif
+#ifndef UWAN_FRAG_MAX_SIZE
+#define UWAN_FRAG_MAX_SIZE 128
+#endif
+
+#define ROW_BUF_SIZE BYTES_FOR_BITS(UWAN_FRAG_MAX_NB)
+
+static struct uwan_ctx *frag_ctx;
+static struct uwan_frag_callbacks *frag_callbacks;
+static uint32_t frag_storage_size;
+static uint8_t ans_buf[BUF_SIZE];
+static uint8_t ans_buf_data_size;
+static bool ans_pending;
+
+/* Only one session is supported, FragIndex 0 */
+static struct {
+    bool active;
+    bool done;
+    bool decoding; // parity fragments arrive, the lost set is fixed
+    bool no_matrix_memory;
+    uint16_t nb_frag;
+    uint8_t frag_size;
+    uint8_t padding;
+    uint32_t descriptor;
+    uint16_t nb_received; // including parity fragments
+    uint16_t nb_missing; // uncoded fragments not received yet
+    uint16_t nb_lost; // uncoded fragments missing when decoding started
+    uint16_t nb_pivots; // rows stored in the matrix
+} session;
+
+/* Bit i is fragment i + 1, set until the fragment is received */
+static uint8_t missing[ROW_BUF_SIZE];
+/* Bit p is set when the matrix has a row starting at lost fragment p */
+static uint8_t pivots[ROW_BUF_SIZE];
+/* Parity matrix line, later reused for a row read from the storage */
+static uint8_t line[ROW_BUF_SIZE];
+/* Parity fragment equation over the lost fragments */
+static uint8_t row[ROW_BUF_SIZE];
+static uint8_t data[UWAN_FRAG_MAX_SIZE];
+static uint8_t tmp[UWAN_FRAG_MAX_SIZE];
+
+static uint32_t prbs23(uint32_t x)
+{
+    uint32_t b0 = x & 0x01;
+    uint32_t b1 = (x & 0x20) >> 5;
+
+    return (x >> 1) + ((b0 ^ b1) << 22);
+}
+
+/* Line n (from 1) of the parity matrix for m fragments, TS004 annex */
+static void get_matrix_line(uint16_t n, uint16_t m, uint8_t *buf)
+{
+    uint32_t x = 1 + 1001 * (uint32_t)n;
+    uint32_t mod = m + ((m & (m - 1)) == 0 ? 1 : 0);
+
+    memset(buf, 0, BYTES_FOR_BITS(m));
+
+    for (uint16_t nb_coeff = 0; nb_coeff < m / 2; nb_coeff++) {
+        uint32_t r = 1 << 16;
+        while (r >= m) {
+            x = prbs23(x);
+            r = x % mod;
+        }
+        BIT_SET(buf, r);
+    }
+}
+
+static void xor_buf(uint8_t *dst, const uint8_t *src, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++)
+        dst[i] ^= src[i];
+}
+
+static uint32_t frag_offset(uint16_t i)
+{
+    return (uint32_t)i * session.frag_size;
+}
+
+static uint16_t row_size(void)
+{
+    return BYTES_FOR_BITS(session.nb_lost);
+}
+
+/* Row p has no bits below p, so it is stored from byte p / 8 */
+static uint32_t row_offset(uint16_t p)
+{
+    return frag_offset(session.nb_frag) + (uint32_t)p * row_size() +
+        p / BITS_PER_BYTE;
+}
+
+static void finish_session(void)
+{
+    session.done = true;
+    session.nb_missing = 0;
+    frag_callbacks->session_done(
+        frag_offset(session.nb_frag) - session.padding, session.descriptor);
+}
+
+static void start_decoding(void)
+{
+    session.decoding = true;
+    session.nb_lost = session.nb_missing;
+    session.nb_pivots = 0;
+    memset(pivots, 0, sizeof(pivots));
+
+    uint32_t matrix_size = (uint32_t)session.nb_lost * row_size();
+    session.no_matrix_memory =
+        frag_offset(session.nb_frag) + matrix_size > frag_storage_size;
+}
+
+/* Rows are already reduced: row p has ones at p and higher lost fragments
+ * only. Going from the last row each lost fragment is substituted in place.
+ */
+static void solve(void)
+{
+    uint16_t p = session.nb_lost;
+
+    for (uint16_t c = session.nb_frag; c-- > 0;) {
+        if (!BIT_IS_SET(missing, c))
+            continue;
+        p--;
+
+        uint16_t len = row_size() - p / BITS_PER_BYTE;
+        frag_callbacks->read(row_offset(p), &line[p / BITS_PER_BYTE], len);
+        frag_callbacks->read(frag_offset(c), data, session.frag_size);
+
+        uint16_t q = p + 1;
+        for (uint16_t k = c + 1; k < session.nb_frag; k++) {
+            if (!BIT_IS_SET(missing, k))
+                continue;
+            if (BIT_IS_SET(line, q)) {
+                frag_callbacks->read(frag_offset(k), tmp, session.frag_size);
+                xor_buf(data, tmp, session.frag_size);
+            }
+            q++;
+        }
+
+        frag_callbacks->write(frag_offset(c), data, session.frag_size);
+    }
+
+    finish_session();
+}
+
+static void handle_parity(uint16_t n, const uint8_t *buf)
+{
+    uint16_t size = session.frag_size;
+    uint16_t p = 0;
+
+    /* Received fragments are moved to the data side of the equation */
+    memcpy(data, buf, size);
+    memset(row, 0, row_size());
+    get_matrix_line(n, session.nb_frag, line);
+
+    for (uint16_t c = 0; c < session.nb_frag; c++) {
+        bool lost = BIT_IS_SET(missing, c);
+
+        if (BIT_IS_SET(line, c)) {
+            if (lost)
+                BIT_SET(row, p);
+            else {
+                frag_callbacks->read(frag_offset(c), tmp, size);
+                xor_buf(data, tmp, size);
+            }
+        }
+        if (lost)
+            p++;
+    }
+
+    /* Forward elimination. The row is stored in the slot of its first lost
+     * fragment, the data goes to the storage in place of that fragment.
+     */
+    p = 0;
+    for (uint16_t c = 0; c < session.nb_frag; c++) {
+        if (!BIT_IS_SET(missing, c))
+            continue;
+
+        if (BIT_IS_SET(row, p)) {
+            uint16_t start = p / BITS_PER_BYTE;
+            uint16_t len = row_size() - start;
+
+            if (!BIT_IS_SET(pivots, p)) {
+                frag_callbacks->write(row_offset(p), &row[start], len);
+                frag_callbacks->write(frag_offset(c), data, size);
+                BIT_SET(pivots, p);
+
+                if (++session.nb_pivots == session.nb_lost)
+                    solve();
+                return;
+            }
+
+            frag_callbacks->read(row_offset(p), &line[start], len);
+            xor_buf(&row[start], &line[start], len);
+            frag_callbacks->read(frag_offset(c), tmp, size);
+            xor_buf(data, tmp, size);
+        }
+        p++;
+    }
+
+    // The fragment is a combination of previous ones
+}
+
+static void handle_fragment(uint16_t n, const uint8_t *buf)
+{
+    if (n == 0 || session.done)
+        return;
+
+    session.nb_received++;
+
+    if (n <= session.nb_frag) {
+        uint16_t i = n - 1;
+
+        // Late uncoded fragments are dropped, the matrix relies on lost set
+        if (session.decoding || !BIT_IS_SET(missing, i))
+            return;
+
+        frag_callbacks->write(frag_offset(i), buf, session.frag_size);
+        BIT_CLEAR(missing, i);
+        if (--session.nb_missing == 0)
+            finish_session();
+        return;
+    }
+
+    if (!session.decoding)
+        start_decoding();
+
+    if (!session.no_matrix_memory)
+        handle_parity(n - session.nb_frag, buf);
+}
+
+static uint8_t setup_session(const uint8_t *buf)
+{
+    uint8_t index = (buf[0] >> 4) & FRAG_INDEX_MASK;
+    uint16_t nb_frag = buf[1] | (buf[2] << 8);
+    uint8_t frag_size = buf[3];
+    uint8_t matrix = (buf[4] >> 3) & 0x7;
+    uint8_t status = 0;
+
+    if (matrix != 0)
+        status |= SETUP_ENCODING_UNSUPPORTED;
+
+    if (nb_frag == 0 || nb_frag > UWAN_FRAG_MAX_NB || frag_size == 0 ||
+        frag_size > UWAN_FRAG_MAX_SIZE ||
+        (uint32_t)nb_frag * frag_size > frag_storage_size)
+        status |= SETUP_NOT_ENOUGH_MEMORY;
+
+    if (index != 0)
+        status |= SETUP_INDEX_UNSUPPORTED;
+
+    if (status == 0) {
+        memset(&session, 0, sizeof(session));
+        session.active = true;
+        session.nb_frag = nb_frag;
+        session.frag_size = frag_size;
+        session.padding = buf[5];
+        session.descriptor = buf[6] | (buf[7] << 8) | (buf[8] << 16) |
+            ((uint32_t)buf[9] << 24);
+        session.nb_missing = nb_frag;
+
+        memset(missing, 0, sizeof(missing));
+        for (uint16_t i = 0; i < nb_frag; i++)
+            BIT_SET(missing, i);
+    }
+
+    return status | (index << 6);
+}
+
+static uint16_t frags_needed(void)
+{
+    if (session.done)
+        return 0;
+
+    if (session.decoding)
+        return session.nb_lost - session.nb_pivots;
+
+    return session.nb_missing;
+}
+
+static void handle_req(const uint8_t *buf, uint8_t size)
+{
+    uint8_t offset = 0;
+    uint8_t ans_buf_offset = 0;
+    uint16_t exec_cmd_mask = 0;
+    uint8_t index;
+    uint16_t value;
+    uint16_t needed;
+    bool participants;
+
+    if (frag_callbacks == NULL)
+        return;
+
+    while (offset < size)
+    {
+        uint8_t cmd = buf[offset++];
+
+        // Prevent re-execute command and buffer overflow
+        if (cmd > DATA_FRAGMENT)
+            break;
+        uint16_t cmd_mask = (1 << cmd);
+        if (exec_cmd_mask & cmd_mask)
+            break;
+        exec_cmd_mask |= cmd_mask;
+
+        switch (cmd)
+        {
+        case PACKAGE_VERSION_REQ:
+            ans_buf[ans_buf_offset++] = PACKAGE_VERSION_ANS;
+            ans_buf[ans_buf_offset++] = PACKAGE_ID;
+            ans_buf[ans_buf_offset++] = PACKAGE_VERSION;
+            break;
+
+        case FRAG_SESSION_STATUS_REQ:
+            if (size - offset < 1)
+                break;
+            participants = buf[offset] & 0x1;
+            index = (buf[offset++] >> 1) & FRAG_INDEX_MASK;
+
+            if (!session.active || index != 0)
+                break;
+
+            needed = frags_needed();
+            if (!participants && needed == 0)
+                break;
+
+            value = (session.nb_received & FRAG_COUNTER_MASK) |
+                (index << FRAG_INDEX_SHIFT);
+            ans_buf[ans_buf_offset++] = FRAG_SESSION_STATUS_ANS;
+            ans_buf[ans_buf_offset++] = value;
+            ans_buf[ans_buf_offset++] = value >> 8;
+            ans_buf[ans_buf_offset++] = needed > 0xff ? 0xff : needed;
+            ans_buf[ans_buf_offset++] =
+                session.no_matrix_memory ? STATUS_NO_MATRIX_MEMORY : 0;
+            break;
+
+        case FRAG_SESSION_SETUP_REQ:
+            if (size - offset < FRAG_SESSION_SETUP_REQ_LEN)
+                break;
+            ans_buf[ans_buf_offset++] = FRAG_SESSION_SETUP_ANS;
+            ans_buf[ans_buf_offset++] = setup_session(&buf[offset]);
+            offset += FRAG_SESSION_SETUP_REQ_LEN;
+            break;
+
+        case FRAG_SESSION_DELETE_REQ:
+            if (size - offset < 1)
+                break;
+            index = buf[offset++] & FRAG_INDEX_MASK;
+
+            ans_buf[ans_buf_offset++] = FRAG_SESSION_DELETE_ANS;
+            if (!session.active || index != 0)
+                ans_buf[ans_buf_offset++] = index | DELETE_NO_SESSION;
+            else {
+                session.active = false;
+                ans_buf[ans_buf_offset++] = index;
+            }
+            break;
+
+        case DATA_FRAGMENT:
+            if (size - offset < DATA_FRAGMENT_HDR_LEN)
+                break;
+            value = buf[offset] | (buf[offset + 1] << 8);
+            offset += DATA_FRAGMENT_HDR_LEN;
+
+            // Fragment takes the rest of the frame
+            if (session.active && size - offset == session.frag_size &&
+                (value >> FRAG_INDEX_SHIFT) == 0)
+                handle_fragment(value & FRAG_COUNTER_MASK, &buf[offset]);
+            offset = size;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    ans_buf_data_size = ans_buf_offset;
+    ans_pending = ans_buf_offset != 0;
+}
+
+void uwan_frag_init(struct uwan_ctx *ctx, struct uwan_frag_callbacks *cbs,
+    uint32_t storage_size)
+{
+    frag_ctx = ctx;
+    frag_callbacks = cbs;
+    frag_storage_size = storage_size;
+    ans_pending = false;
+    ans_buf_data_size = 0;
+    memset(&session, 0, sizeof(session));
+}
+
+void uwan_frag_handle_downlink(enum uwan_errs err,
+    enum uwan_mtypes m_type, const struct uwan_dl_packet *pkt)
+{
+    (void)m_type;
+
+    if (err != UWAN_ERR_NO)
+        return;
+
+    if (pkt->size && pkt->f_port == UWAN_EXT_FRAG_PORT)
+        handle_req(pkt->data, pkt->size);
+}
+
+bool uwan_frag_is_answ_pending()
+{
+    return ans_pending;
+}
+
+enum uwan_errs uwan_frag_send_answ()
+{
+    if (ans_pending == false)
+        return UWAN_ERR_STATE;
+
+    enum uwan_errs err = uwan_send_frame(frag_ctx, UWAN_EXT_FRAG_PORT,
+        ans_buf, ans_buf_data_size, false);
+    if (err == UWAN_ERR_NO)
+        ans_pending = false;
+
+    return err;
+}
@@ -0,0 +1,275 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <uwan/ext/mc_setup.h>
+#include "../utils.h"
+
+#define PACKAGE_ID 2
+#define PACKAGE_VERSION 1
+
+/* Commands transmitted by end device */
+#define PACKAGE_VERSION_ANS 0x0
+#define MC_GROUP_STATUS_ANS 0x1
+#define MC_GROUP_SETUP_ANS 0x2
+#define MC_GROUP_DELETE_ANS 0x3
+#define MC_CLASS_C_SESSION_ANS 0x4
+#define MC_CLASS_B_SESSION_ANS 0x5
+
+/* Commands transmitted by server */
+#define PACKAGE_VERSION_REQ 0x0
+#define MC_GROUP_STATUS_REQ 0x1
+#define MC_GROUP_SETUP_REQ 0x2
+#define MC_GROUP_DELETE_REQ 0x3
+#define MC_CLASS_C_SESSION_REQ 0x4
+#define MC_CLASS_B_SESSION_REQ 0x5
+
+#define BUF_SIZE 48 // every answer once, status of 4 groups
+#define MC_GROUPS_MAX 4
+#define MC_GROUP_SETUP_REQ_LEN 29
+#define MC_SESSION_REQ_LEN 10
+#define MC_KEY_SIZE 16
+
+#define MC_GROUP_ID_MASK 0x3
+#define MC_GROUP_ID_ERROR (1 << 2)
+#define MC_GROUP_UNDEFINED (1 << 2)
+#define SESSION_DR_ERROR (1 << 2)
+#define SESSION_FREQ_ERROR (1 << 3)
+#define SESSION_GROUP_UNDEFINED (1 << 4)
+
+static struct uwan_ctx *mc_ctx;
+static struct uwan_mc_setup_callbacks *mc_callbacks;
+static uint8_t ans_buf[BUF_SIZE];
+static uint8_t ans_buf_data_size;
+static bool ans_pending;
+
+static uint32_t get_u32(const uint8_t *buf)
+{
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static uint8_t put_group_status(uint8_t *buf, uint8_t req_mask)
+{
+    uint8_t offset = 1;
+    uint8_t ans_mask = 0;
+    uint8_t nb_groups = 0;
+    uint32_t mc_addr;
+
+    for (uint8_t id = 0; id < MC_GROUPS_MAX; id++) {
+        if (!uwan_mc_get_group(mc_ctx, id, &mc_addr))
+            continue;
+
+        nb_groups++;
+        if (!(req_mask & (1 << id)))
+            continue;
+
+        ans_mask |= 1 << id;
+        buf[offset++] = id;
+        buf[offset++] = mc_addr;
+        buf[offset++] = mc_addr >> 8;
+        buf[offset++] = mc_addr >> 16;
+        buf[offset++] = mc_addr >> 24;
+    }
+
+    buf[0] = ans_mask | (nb_groups << 4);
+    return offset;
+}
+
+/* Returns answer size, 0 if session request is ignored */
+static uint8_t handle_session_req(uint8_t *ans, const uint8_t *buf,
+    bool class_b)
+{
+    uint8_t id = buf[0] & MC_GROUP_ID_MASK;
+    uint32_t session_time = get_u32(&buf[1]);
+    uint8_t timeout = buf[5] & 0xf;
+    uint8_t periodicity = (buf[5] >> 4) & 0x7;
+    uint32_t frequency = (buf[6] | (buf[7] << 8) | (buf[8] << 16)) * 100;
+    uint8_t dr = buf[9];
+    uint8_t status = id;
+    uint32_t mc_addr;
+
+    if ((class_b && !mc_callbacks->class_b_session) ||
+        (!class_b && !mc_callbacks->class_c_session))
+        return 0;
+
+    uint32_t now = utils_unix_to_gps(mc_callbacks->get_unixtime());
+    int32_t time_to_start = session_time - now;
+    if (time_to_start < 0)
+        time_to_start = 0;
+
+    if (dr >= UWAN_DR_COUNT)
+        status |= SESSION_DR_ERROR;
+    if (!uwan_mc_get_group(mc_ctx, id, &mc_addr))
+        status |= SESSION_GROUP_UNDEFINED;
+
+    if (status == id) {
+        bool ok;
+
+        if (class_b) {
+            ok = mc_callbacks->class_b_session(id, time_to_start,
+                1 << timeout, frequency, dr, periodicity);
+        }
+        else {
+            ok = mc_callbacks->class_c_session(id, time_to_start,
+                1 << timeout, frequency, dr);
+        }
+        if (!ok)
+            status |= SESSION_FREQ_ERROR;
+    }
+
+    uint8_t offset = 0;
+    ans[offset++] = class_b ? MC_CLASS_B_SESSION_ANS : MC_CLASS_C_SESSION_ANS;
+    ans[offset++] = status;
+    if (status == id) {
+        ans[offset++] = time_to_start;
+        ans[offset++] = time_to_start >> 8;
+        ans[offset++] = time_to_start >> 16;
+    }
+
+    return offset;
+}
+
+static void handle_req(const uint8_t *buf, uint8_t size)
+{
+    uint8_t offset = 0;
+    uint8_t ans_buf_offset = 0;
+    uint8_t exec_cmd_mask = 0;
+    uint8_t id;
+    bool ok;
+
+    if (mc_callbacks == NULL)
+        return;
+
+    while (offset < size)
+    {
+        uint8_t cmd = buf[offset++];
+
+        // Prevent re-execute command and buffer overflow
+        if (cmd > MC_CLASS_B_SESSION_REQ)
+            break;
+        uint8_t cmd_mask = (1 << cmd);
+        if (exec_cmd_mask & cmd_mask)
+            break;
+        exec_cmd_mask |= cmd_mask;
+
+        switch (cmd)
+        {
+        case PACKAGE_VERSION_REQ:
+            ans_buf[ans_buf_offset++] = PACKAGE_VERSION_ANS;
+            ans_buf[ans_buf_offset++] = PACKAGE_ID;
+            ans_buf[ans_buf_offset++] = PACKAGE_VERSION;
+            break;
+
+        case MC_GROUP_STATUS_REQ:
+            if (size - offset < 1)
+                break;
+            ans_buf[ans_buf_offset++] = MC_GROUP_STATUS_ANS;
+            ans_buf_offset += put_group_status(&ans_buf[ans_buf_offset],
+                buf[offset++] & 0xf);
+            break;
+
+        case MC_GROUP_SETUP_REQ:
+            if (size - offset < MC_GROUP_SETUP_REQ_LEN)
+                break;
+            id = buf[offset] & MC_GROUP_ID_MASK;
+
+            ok = uwan_mc_setup_group(mc_ctx, id,
+                get_u32(&buf[offset + 1]), &buf[offset + 5],
+                get_u32(&buf[offset + 5 + MC_KEY_SIZE]),
+                get_u32(&buf[offset + 9 + MC_KEY_SIZE]));
+            offset += MC_GROUP_SETUP_REQ_LEN;
+
+            ans_buf[ans_buf_offset++] = MC_GROUP_SETUP_ANS;
+            ans_buf[ans_buf_offset++] = ok ? id : id | MC_GROUP_ID_ERROR;
+            break;
+
+        case MC_GROUP_DELETE_REQ:
+            if (size - offset < 1)
+                break;
+            id = buf[offset++] & MC_GROUP_ID_MASK;
+
+            ans_buf[ans_buf_offset++] = MC_GROUP_DELETE_ANS;
+            ans_buf[ans_buf_offset++] = uwan_mc_delete_group(mc_ctx, id) ?
+                id : id | MC_GROUP_UNDEFINED;
+            break;
+
+        case MC_CLASS_C_SESSION_REQ:
+        case MC_CLASS_B_SESSION_REQ:
+            if (size - offset < MC_SESSION_REQ_LEN)
+                break;
+            ans_buf_offset += handle_session_req(&ans_buf[ans_buf_offset],
+                &buf[offset], cmd == MC_CLASS_B_SESSION_REQ);
+            offset += MC_SESSION_REQ_LEN;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    ans_buf_data_size = ans_buf_offset;
+    ans_pending = ans_buf_offset != 0;
+}
+
+void uwan_mc_setup_init(struct uwan_ctx *ctx,
+    struct uwan_mc_setup_callbacks *cbs)
+{
+    mc_ctx = ctx;
+    mc_callbacks = cbs;
+    ans_pending = false;
+    ans_buf_data_size = 0;
+}
+
+void uwan_mc_setup_handle_downlink(enum uwan_errs err,
+    enum uwan_mtypes m_type, const struct uwan_dl_packet *pkt)
+{
+    (void)m_type;
+
+    if (err != UWAN_ERR_NO)
+        return;
+
+    // setup comes in unicast frames only
+    if (pkt->size && pkt->f_port == UWAN_EXT_MC_SETUP_PORT &&
+        !pkt->multicast)
+        handle_req(pkt->data, pkt->size);
+}
+
+bool uwan_mc_setup_is_answ_pending()
+{
+    return ans_pending;
+}
+
+enum uwan_errs uwan_mc_setup_send_answ()
+{
+    if (ans_pending == false)
+        return UWAN_ERR_STATE;
+
+    enum uwan_errs err = uwan_send_frame(mc_ctx, UWAN_EXT_MC_SETUP_PORT,
+        ans_buf, ans_buf_data_size, false);
+    if (err == UWAN_ERR_NO)
+        ans_pending = false;
+
+    return err;
+}
@@ -0,0 +1,156 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "join.h"
+#include "stack.h"
+#include "utils.h"
+
+/* Retransmission backoff, see ch. 7 of LoRaWAN 1.0.3 */
+#define BACKOFF_PHASE_1 3600000UL // 36 s per hour, 1%
+#define BACKOFF_PHASE_2 39600000UL // 36 s per 10 hours, 0.1%
+#define BACKOFF_DUTY_CYCLE_1 100
+#define BACKOFF_DUTY_CYCLE_2 1000
+#define BACKOFF_DUTY_CYCLE_3 10000 // 8.7 s per 24 hours
+
+#define JOIN_JITTER 1000 // ms, spreads join-requests of many devices
+
+static uint16_t get_backoff_duty_cycle(uint32_t elapsed)
+{
+    if (elapsed < BACKOFF_PHASE_1)
+        return BACKOFF_DUTY_CYCLE_1;
+
+    if (elapsed < BACKOFF_PHASE_2)
+        return BACKOFF_DUTY_CYCLE_2;
+
+    return BACKOFF_DUTY_CYCLE_3;
+}
+
+void join_init(struct uwan_ctx *ctx)
+{
+    memset(&ctx->join, 0, sizeof(ctx->join));
+
+    if (ctx->stack_hal->get_time_ms)
+        ctx->join.init_time = ctx->stack_hal->get_time_ms(ctx);
+}
+
+uint32_t join_get_backoff(struct uwan_ctx *ctx)
+{
+    struct band_state *backoff = &ctx->join.backoff;
+
+    if (!ctx->stack_hal->get_time_ms || !backoff->off_time)
+        return 0;
+
+    uint32_t elapsed = ctx->stack_hal->get_time_ms(ctx) - backoff->tx_time;
+    if (elapsed >= backoff->off_time) {
+        backoff->off_time = 0;
+        return 0;
+    }
+
+    return backoff->off_time - elapsed;
+}
+
+void join_on_tx(struct uwan_ctx *ctx, uint32_t time_on_air)
+{
+    struct join_state *join = &ctx->join;
+
+    if (!ctx->stack_hal->get_time_ms)
+        return;
+
+    uint32_t now = ctx->stack_hal->get_time_ms(ctx);
+    uint32_t toa_ms = (time_on_air + 999) / 1000;
+
+    join->backoff.tx_time = now;
+    join->backoff.off_time = toa_ms *
+        get_backoff_duty_cycle(now - join->init_time);
+}
+
+static enum uwan_errs send_attempt(struct uwan_ctx *ctx)
+{
+    struct join_state *join = &ctx->join;
+
+    // sweep from the fastest data rate to the most robust one
+    enum uwan_dr dr = join->start_dr - join->attempt % (join->start_dr + 1);
+
+    enum uwan_errs err = send_join_request(ctx, dr);
+    if (err == UWAN_ERR_NO) {
+        join->attempt++;
+        join->attempts_left--;
+    }
+
+    return err;
+}
+
+bool join_retry(struct uwan_ctx *ctx)
+{
+    struct join_state *join = &ctx->join;
+
+    if (!join->attempts_left)
+        return false;
+
+    uint32_t delay = MAX(join_get_backoff(ctx), uwan_get_next_tx_delay(ctx));
+    delay += utils_get_random(&ctx->random, JOIN_JITTER);
+
+    ctx->state = UWAN_STATE_JOIN_WAIT;
+    ctx->stack_hal->start_timer(ctx, UWAN_TIMER_TX, delay);
+
+    return true;
+}
+
+enum uwan_errs join_on_timer(struct uwan_ctx *ctx)
+{
+    ctx->state = UWAN_STATE_IDLE;
+
+    enum uwan_errs err = send_attempt(ctx);
+    if (err == UWAN_ERR_DUTY_CYCLE && join_retry(ctx))
+        return UWAN_ERR_NO;
+
+    if (err != UWAN_ERR_NO)
+        ctx->join.attempts_left = 0;
+
+    return err;
+}
+
+enum uwan_errs uwan_join_start(struct uwan_ctx *ctx, uint16_t attempts)
+{
+    struct join_state *join = &ctx->join;
+
+    if (ctx->state != UWAN_STATE_IDLE || !ctx->app_key_aes ||
+        !ctx->stack_hal->get_time_ms || !attempts)
+        return UWAN_ERR_STATE;
+
+    join->attempts_left = attempts;
+    join->attempt = 0;
+    join->start_dr = ctx->default_dr;
+
+    enum uwan_errs err = send_attempt(ctx);
+    if (err == UWAN_ERR_DUTY_CYCLE && join_retry(ctx))
+        return UWAN_ERR_NO;
+
+    if (err != UWAN_ERR_NO)
+        join->attempts_left = 0;
+
+    return err;
+}
@@ -0,0 +1,67 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __JOIN_H__
+#define __JOIN_H__
+
+#include <uwan/stack.h>
+#include "channels.h"
+
+struct join_state {
+    uint16_t attempts_left; // 0 if join procedure isn't running
+    uint16_t attempt;
+    enum uwan_dr start_dr;
+    uint32_t init_time; // ms, backoff phases are counted from it
+    struct band_state backoff;
+};
+
+void join_init(struct uwan_ctx *ctx);
+
+/**
+ * \brief Get time until the next join-request is allowed by backoff
+ */
+uint32_t join_get_backoff(struct uwan_ctx *ctx);
+
+/**
+ * \brief Account join-request in backoff
+ *
+ * \param time_on_air time on air in microseconds
+ */
+void join_on_tx(struct uwan_ctx *ctx, uint32_t time_on_air);
+
+/**
+ * \brief Schedule next attempt after failed join-request
+ *
+ * \returns false if join procedure is over
+ */
+bool join_retry(struct uwan_ctx *ctx);
+
+/**
+ * \brief Send scheduled join-request
+ *
+ * \returns error if join procedure has failed
+ */
+enum uwan_errs join_on_timer(struct uwan_ctx *ctx);
+
+#endif
@@ -29,6 +29,8 @@
 #include "stack.h"
 #include "utils.h"
 
+/* Downlink payload sizes, also of commands without handler */
+#define RESET_CONF_PAYLOAD_SIZE 1
 #define LINK_CHECK_ANS_PAYLOAD_SIZE 2
 #define LINK_ADR_REQ_PAYLOAD_SIZE 4
 #define DUTY_CYCLE_REQ_PAYLOAD_SIZE 1
@@ -38,7 +40,28 @@
 #define RX_TIMING_SETUP_REQ_PAYLOAD_SIZE 1
 #define TX_PARAM_SETUP_REQ_PAYLOAD_SIZE 1
 #define DI_CHANNEL_REQ_PAYLOAD_SIZE 4
-#define CID_DEVICE_TIME_ANS_PAYLOAD_SIZE 5
+#define REKEY_CONF_PAYLOAD_SIZE 1
+#define ADR_PARAM_SETUP_REQ_PAYLOAD_SIZE 1
+#define DEVICE_TIME_ANS_PAYLOAD_SIZE 5
+#define FORCE_REJOIN_REQ_PAYLOAD_SIZE 2
+#define REJOIN_PARAM_SETUP_REQ_PAYLOAD_SIZE 1
+#define PING_SLOT_INFO_ANS_PAYLOAD_SIZE 0
+#define PING_SLOT_CHANNEL_REQ_PAYLOAD_SIZE 4
+#define BEACON_TIMING_ANS_PAYLOAD_SIZE 3
+#define BEACON_FREQ_REQ_PAYLOAD_SIZE 3
+#define DEVICE_MODE_CONF_PAYLOAD_SIZE 1
+
+/* Uplink answer sizes */
+#define NO_ANS 0xff
+#define LINK_ADR_ANS_PAYLOAD_SIZE 1
+#define DUTY_CYCLE_ANS_PAYLOAD_SIZE 0
+#define RX_PARAM_SETUP_ANS_PAYLOAD_SIZE 1
+#define DEV_STATUS_ANS_PAYLOAD_SIZE 2
+#define NEW_CHANNEL_ANS_PAYLOAD_SIZE 1
+#define RX_TIMING_SETUP_ANS_PAYLOAD_SIZE 0
+#define DI_CHANNEL_ANS_PAYLOAD_SIZE 1
+#define PING_SLOT_CHANNEL_ANS_PAYLOAD_SIZE 1
+#define BEACON_FREQ_ANS_PAYLOAD_SIZE 1
 
 #define FREQ_STEP 100
 #define DEV_STATUS_MARGIN_MASK 0x3f
@@ -49,66 +72,112 @@
 #define NEW_CHANNEL_STATUS_FREQ_ACK (1 << 0)
 #define NEW_CHANNEL_STATUS_DR_RANGE_ACK (1 << 1)
 #define NEW_CHANNEL_STATUS_OK 3
-
-#define MAC_BUF_SIZE 15
-
-static bool link_check(const uint8_t *pld);
-static bool link_adr(const uint8_t *pld);
-static bool duty_cycle(const uint8_t *pld);
-static bool rx_param_setup(const uint8_t *pld);
-static bool dev_status(const uint8_t *pld);
-static bool new_channel(const uint8_t *pld);
-static bool rx_timing_setup(const uint8_t *pld);
-static bool tx_param_setup(const uint8_t *pld);
-static bool di_channel(const uint8_t *pld);
-static bool device_time(const uint8_t *pld);
-
-static uint8_t mac_buf[MAC_BUF_SIZE];
-static uint8_t mac_buf_pos;
-static bool mac_save_dev_time;
-static uint32_t mac_dev_time;
-static const struct uwan_mac_callbacks *mac_cbs;
-
-const struct {
-    bool (*handler)(const uint8_t *pld);
-    uint8_t cid;
+#define DI_CHANNEL_STATUS_FREQ_ACK (1 << 0)
+#define DI_CHANNEL_STATUS_UPLINK_FREQ_ACK (1 << 1)
+#define DI_CHANNEL_STATUS_OK 3
+#define PING_SLOT_CHANNEL_STATUS_FREQ_ACK (1 << 0)
+#define PING_SLOT_CHANNEL_STATUS_DR_ACK (1 << 1)
+#define PING_SLOT_CHANNEL_STATUS_OK 3
+#define BEACON_FREQ_STATUS_FREQ_ACK (1 << 0)
+#define FRACTION_PER_SECOND 256
+
+typedef void (*mac_handler_t)(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans);
+
+static void link_check(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans);
+static void link_adr(struct uwan_ctx *ctx, const uint8_t *pld, uint8_t *ans);
+static void duty_cycle(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans);
+static void rx_param_setup(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans);
+static void dev_status(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans);
+static void new_channel(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans);
+static void rx_timing_setup(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans);
+static void di_channel(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans);
+static void device_time(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans);
+static void ping_slot_channel(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans);
+static void beacon_freq(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans);
+
+/* Indexed by CID. Commands without handler are skipped, CIDs missing here
+ * have unknown length and stop parsing.
+ */
+static const struct mac_command {
+    mac_handler_t handler;
     uint8_t pld_size;
-} mac_commands[] = {
-    {link_check, CID_LINK_CHECK, LINK_CHECK_ANS_PAYLOAD_SIZE},
-    {link_adr, CID_LINK_ADR, LINK_ADR_REQ_PAYLOAD_SIZE},
-    {duty_cycle, CID_DUTY_CYCLE, DUTY_CYCLE_REQ_PAYLOAD_SIZE},
-    {rx_param_setup, CID_RX_PARAM_SETUP, RX_PARAM_SETUP_REQ_PAYLOAD_SIZE},
-    {dev_status, CID_DEV_STATUS, DEV_STATUS_REQ_PAYLOAD_SIZE},
-    {new_channel, CID_NEW_CHANNEL, NEW_CHANNEL_REQ_PAYLOAD_SIZE},
-    {rx_timing_setup, CID_RX_TIMING_SETUP, RX_TIMING_SETUP_REQ_PAYLOAD_SIZE},
-    {tx_param_setup, CID_TX_PARAM_SETUP, TX_PARAM_SETUP_REQ_PAYLOAD_SIZE},
-    {di_channel, CID_DI_CHANNEL, DI_CHANNEL_REQ_PAYLOAD_SIZE},
-    {device_time, CID_DEVICE_TIME, CID_DEVICE_TIME_ANS_PAYLOAD_SIZE},
+    uint8_t ans_size; // NO_ANS if nothing is sent back
+    bool sticky; // answer is repeated until class A downlink
+} mac_commands[CID_DOWNLINK_MAX + 1] = {
+    [CID_RESET] = {NULL, RESET_CONF_PAYLOAD_SIZE, NO_ANS},
+    [CID_LINK_CHECK] = {link_check, LINK_CHECK_ANS_PAYLOAD_SIZE, NO_ANS},
+    [CID_LINK_ADR] = {link_adr, LINK_ADR_REQ_PAYLOAD_SIZE,
+        LINK_ADR_ANS_PAYLOAD_SIZE},
+    [CID_DUTY_CYCLE] = {duty_cycle, DUTY_CYCLE_REQ_PAYLOAD_SIZE,
+        DUTY_CYCLE_ANS_PAYLOAD_SIZE},
+    [CID_RX_PARAM_SETUP] = {rx_param_setup, RX_PARAM_SETUP_REQ_PAYLOAD_SIZE,
+        RX_PARAM_SETUP_ANS_PAYLOAD_SIZE, true},
+    [CID_DEV_STATUS] = {dev_status, DEV_STATUS_REQ_PAYLOAD_SIZE,
+        DEV_STATUS_ANS_PAYLOAD_SIZE},
+    [CID_NEW_CHANNEL] = {new_channel, NEW_CHANNEL_REQ_PAYLOAD_SIZE,
+        NEW_CHANNEL_ANS_PAYLOAD_SIZE},
+    [CID_RX_TIMING_SETUP] = {rx_timing_setup,
+        RX_TIMING_SETUP_REQ_PAYLOAD_SIZE, RX_TIMING_SETUP_ANS_PAYLOAD_SIZE,
+        true},
+    // not supported in EU868 and RU864, no answer is expected then
+    [CID_TX_PARAM_SETUP] = {NULL, TX_PARAM_SETUP_REQ_PAYLOAD_SIZE, NO_ANS},
+    [CID_DI_CHANNEL] = {di_channel, DI_CHANNEL_REQ_PAYLOAD_SIZE,
+        DI_CHANNEL_ANS_PAYLOAD_SIZE, true},
+    [CID_REKEY] = {NULL, REKEY_CONF_PAYLOAD_SIZE, NO_ANS},
+    [CID_ADR_PARAM_SETUP] = {NULL, ADR_PARAM_SETUP_REQ_PAYLOAD_SIZE, NO_ANS},
+    [CID_DEVICE_TIME] = {device_time, DEVICE_TIME_ANS_PAYLOAD_SIZE, NO_ANS},
+    [CID_FORCE_REJOIN] = {NULL, FORCE_REJOIN_REQ_PAYLOAD_SIZE, NO_ANS},
+    [CID_REJOIN_PARAM_SETUP] = {NULL, REJOIN_PARAM_SETUP_REQ_PAYLOAD_SIZE,
+        NO_ANS},
+    [CID_PING_SLOT_INFO] = {NULL, PING_SLOT_INFO_ANS_PAYLOAD_SIZE, NO_ANS},
+    [CID_PING_SLOT_CHANNEL] = {ping_slot_channel,
+        PING_SLOT_CHANNEL_REQ_PAYLOAD_SIZE,
+        PING_SLOT_CHANNEL_ANS_PAYLOAD_SIZE},
+    [CID_BEACON_TIMING] = {NULL, BEACON_TIMING_ANS_PAYLOAD_SIZE, NO_ANS},
+    [CID_BEACON_FREQ] = {beacon_freq, BEACON_FREQ_REQ_PAYLOAD_SIZE,
+        BEACON_FREQ_ANS_PAYLOAD_SIZE},
+    [CID_DEVICE_MODE] = {NULL, DEVICE_MODE_CONF_PAYLOAD_SIZE, NO_ANS},
 };
 
-static bool link_check(const uint8_t *pld)
+static void link_check(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans)
 {
-    if (mac_cbs && mac_cbs->link_check_result) {
+    (void)ans;
+
+    if (ctx->mac.cbs && ctx->mac.cbs->link_check_result) {
         uint8_t margin = pld[0];
         uint8_t gw_cnt = pld[1];
-        mac_cbs->link_check_result(margin, gw_cnt);
+        ctx->mac.cbs->link_check_result(margin, gw_cnt);
     }
-
-    return true;
 }
 
-static bool link_adr(const uint8_t *pld)
+static void link_adr(struct uwan_ctx *ctx, const uint8_t *pld, uint8_t *ans)
 {
-    return adr_handle_link_req(pld[0], pld[1] | pld[2] << 8, pld[3]);
+    ans[0] = adr_handle_link_req(ctx, pld[0], pld[1] | pld[2] << 8, pld[3]);
 }
 
-static bool duty_cycle(const uint8_t *pld)
+static void duty_cycle(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans)
 {
-    // TODO handle DutyCyclePL
-    return mac_enqueue(CID_DUTY_CYCLE, NULL, 0);
+    (void)ans;
+
+    uint8_t max_dcycle = pld[0] & 0xf; // bits 7:4 are RFU
+    channels_set_max_dcycle(ctx, max_dcycle);
 }
 
-static bool rx_param_setup(const uint8_t *pld)
+static void rx_param_setup(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans)
 {
     uint8_t dl_settings = pld[0];
     uint8_t rx1_dr_offset = (dl_settings >> 4) & 7;
@@ -126,29 +195,27 @@ static bool rx_param_setup(const uint8_t *pld)
         status |= RX_PARAM_STATUS_CHANNEL_ACK;
 
     if (status == RX_PARAM_STATUS_OK) {
-        uwan_set_rx1_dr_offset(rx1_dr_offset);
-        uwan_set_rx2(rx2_freq, (enum uwan_dr)rx2_dr);
+        uwan_set_rx1_dr_offset(ctx, rx1_dr_offset);
+        uwan_set_rx2(ctx, rx2_freq, (enum uwan_dr)rx2_dr);
     }
 
-    // TODO command should be added in the FOpt field of all uplinks until a
-    // class A downlink is received by the end-device
-    return mac_enqueue(CID_RX_PARAM_SETUP, &status, sizeof(status));
+    ans[0] = status;
 }
 
-static bool dev_status(const uint8_t *pld)
+static void dev_status(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans)
 {
-    uint8_t status[] = {
-        LORAWAN_MAC_BAT_LEVEL_UNKNOWN,
-        (get_snr() & DEV_STATUS_MARGIN_MASK),
-    };
+    (void)pld;
 
-    if (mac_cbs && mac_cbs->get_battery_level)
-        status[0] = mac_cbs->get_battery_level();
+    ans[0] = LORAWAN_MAC_BAT_LEVEL_UNKNOWN;
+    ans[1] = get_snr(ctx) & DEV_STATUS_MARGIN_MASK;
 
-    return mac_enqueue(CID_DEV_STATUS, status, sizeof(status));
+    if (ctx->mac.cbs && ctx->mac.cbs->get_battery_level)
+        ans[0] = ctx->mac.cbs->get_battery_level();
 }
 
-static bool new_channel(const uint8_t *pld)
+static void new_channel(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans)
 {
     uint8_t ch_index = pld[0];
     uint32_t freq = (pld[1] | (pld[2] << 8) | (pld[3] << 16)) * FREQ_STEP;
@@ -162,135 +229,267 @@ static bool new_channel(const uint8_t *pld)
         status |= NEW_CHANNEL_STATUS_DR_RANGE_ACK;
 
     if (status == NEW_CHANNEL_STATUS_OK) {
-        if (uwan_set_channel(ch_index, freq) != UWAN_ERR_NO)
+        if (uwan_set_channel(ctx, ch_index, freq) != UWAN_ERR_NO)
             status = 0;
     }
 
-    return mac_enqueue(CID_NEW_CHANNEL, &status, sizeof(status));
+    ans[0] = status;
 }
 
-static bool rx_timing_setup(const uint8_t *pld)
+static void rx_timing_setup(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans)
 {
+    (void)ans;
+
     uint8_t delay = pld[0] & 0xf;
 
     if (delay == 0)
         delay = 1;
-    uwan_set_rx1_delay(delay);
+    uwan_set_rx1_delay(ctx, delay);
+}
+
+static void di_channel(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans)
+{
+    uint8_t ch_index = pld[0];
+    uint32_t freq = (pld[1] | (pld[2] << 8) | (pld[3] << 16)) * FREQ_STEP;
+    uint8_t status = 0;
+
+    if (is_valid_frequency(freq))
+        status |= DI_CHANNEL_STATUS_FREQ_ACK;
+
+    if (channel_is_exist(ctx, ch_index))
+        status |= DI_CHANNEL_STATUS_UPLINK_FREQ_ACK;
+
+    if (status == DI_CHANNEL_STATUS_OK)
+        uwan_set_dl_channel(ctx, ch_index, freq);
 
-    // TODO command should be added in the FOpt field of all uplinks until a
-    // class A downlink is received by the end-device
-    return mac_enqueue(CID_RX_TIMING_SETUP, NULL, 0);
+    ans[0] = status;
 }
 
-static bool device_time(const uint8_t *pld)
+static void device_time(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans)
 {
-    if (mac_cbs && mac_cbs->device_time_result) {
-        uint32_t gps_seconds;
-        gps_seconds = pld[0] | (pld[1] << 8) | (pld[2] << 16) | (pld[3] << 24);
-        uint32_t unixtime = utils_gps_to_unix(gps_seconds);
-        uint8_t fraq = pld[4];
-        mac_cbs->device_time_result(mac_dev_time, unixtime, fraq);
+    (void)ans;
+
+    uint32_t gps_seconds;
+    gps_seconds = pld[0] | (pld[1] << 8) | (pld[2] << 16) | (pld[3] << 24);
+    uint8_t fraq = pld[4];
+
+    // network time is taken at the end of uplink, it helps to find beacon
+    if (ctx->stack_hal->get_time_ms) {
+        class_b_set_time(ctx, gps_seconds,
+            ctx->mac.dev_time_ms - fraq * 1000 / FRACTION_PER_SECOND);
     }
 
-    return true;
+    if (ctx->mac.cbs && ctx->mac.cbs->device_time_result) {
+        uint32_t unixtime = utils_gps_to_unix(gps_seconds);
+        ctx->mac.cbs->device_time_result(ctx->mac.dev_time, unixtime, fraq);
+    }
 }
 
-static bool tx_param_setup(const uint8_t *pld)
+static void ping_slot_channel(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans)
 {
-    return true; // not supported, skip silently
+    uint32_t freq = (pld[0] | (pld[1] << 8) | (pld[2] << 16)) * FREQ_STEP;
+    uint8_t dr = pld[3] & 0xf;
+    uint8_t status = 0;
+
+    // zero frequency restores the default one
+    if (freq == 0 || is_valid_frequency(freq))
+        status |= PING_SLOT_CHANNEL_STATUS_FREQ_ACK;
+
+    if (is_valid_dr(dr))
+        status |= PING_SLOT_CHANNEL_STATUS_DR_ACK;
+
+    if (status == PING_SLOT_CHANNEL_STATUS_OK)
+        class_b_set_ping_channel(ctx, freq, (enum uwan_dr)dr);
+
+    ans[0] = status;
 }
 
-static bool di_channel(const uint8_t *pld)
+static void beacon_freq(struct uwan_ctx *ctx, const uint8_t *pld,
+    uint8_t *ans)
 {
-    return true; // not supported, skip silently
+    uint32_t freq = (pld[0] | (pld[1] << 8) | (pld[2] << 16)) * FREQ_STEP;
+    uint8_t status = 0;
+
+    if (freq == 0 || is_valid_frequency(freq)) {
+        status |= BEACON_FREQ_STATUS_FREQ_ACK;
+        class_b_set_beacon_frequency(ctx, freq);
+    }
+
+    ans[0] = status;
 }
 
-void uwan_mac_set_handlers(const struct uwan_mac_callbacks *cbs)
+void uwan_mac_set_handlers(struct uwan_ctx *ctx,
+    const struct uwan_mac_callbacks *cbs)
 {
-    mac_cbs = cbs;
+    ctx->mac.cbs = cbs;
 }
 
-bool uwan_mac_link_check_req()
+bool uwan_mac_link_check_req(struct uwan_ctx *ctx)
 {
-    return mac_enqueue(CID_LINK_CHECK, NULL, 0);
+    return mac_enqueue(ctx, CID_LINK_CHECK, NULL, 0);
 }
 
-bool uwan_mac_device_time_req()
+bool uwan_mac_device_time_req(struct uwan_ctx *ctx)
 {
-    bool result = mac_enqueue(CID_DEVICE_TIME, NULL, 0);
-    mac_save_dev_time = result;
+    bool result = mac_enqueue(ctx, CID_DEVICE_TIME, NULL, 0);
+    ctx->mac.save_dev_time = result;
     return result;
 }
 
-void mac_init()
+bool uwan_mac_ping_slot_info_req(struct uwan_ctx *ctx)
+{
+    uint8_t periodicity = ctx->class_b.periodicity;
+
+    return mac_enqueue(ctx, CID_PING_SLOT_INFO, &periodicity,
+        sizeof(periodicity));
+}
+
+/* new answer replaces the previous one to the same request */
+static uint8_t *reserve_sticky(struct uwan_ctx *ctx, uint8_t cid,
+    uint8_t size)
 {
-    mac_buf_pos = 0;
-    mac_save_dev_time = false;
+    struct mac_state *mac = &ctx->mac;
+    uint8_t pos = 0;
+
+    while (pos < mac->sticky_pos) {
+        uint8_t len = sizeof(cid) + mac_commands[mac->sticky_buf[pos]].ans_size;
+
+        if (mac->sticky_buf[pos] == cid) {
+            memmove(&mac->sticky_buf[pos], &mac->sticky_buf[pos + len],
+                mac->sticky_pos - pos - len);
+            mac->sticky_pos -= len;
+            break;
+        }
+        pos += len;
+    }
+
+    uint8_t free = MAC_BUF_SIZE - mac->sticky_pos - mac->buf_pos;
+    if ((sizeof(cid) + size) > free ||
+        (sizeof(cid) + size) > sizeof(mac->sticky_buf) - mac->sticky_pos)
+        return NULL;
+
+    mac->sticky_buf[mac->sticky_pos++] = cid;
+    uint8_t *ans = mac->sticky_buf + mac->sticky_pos;
+    mac->sticky_pos += size;
+    mac->sticky_sent = false;
+
+    return ans;
+}
+
+void mac_init(struct uwan_ctx *ctx)
+{
+    ctx->mac.buf_pos = 0;
+    ctx->mac.sticky_pos = 0;
+    ctx->mac.sticky_sent = false;
+    ctx->mac.save_dev_time = false;
 }
 
-void mac_handle_commands(const uint8_t *buf, uint8_t len)
+void mac_handle_commands(struct uwan_ctx *ctx, const uint8_t *buf,
+    uint8_t len)
 {
     const uint8_t *start = buf;
     const uint8_t *end = start + len;
-    const int mac_cmds_count = sizeof(mac_commands) / sizeof(mac_commands[0]);
 
     while (start < end) {
         uint8_t cid = *start++;
-        bool status = false;
-
-        for (int i = 0; i < mac_cmds_count; i++) {
-            if (cid == mac_commands[i].cid) {
-                if ((end - start) >= mac_commands[i].pld_size) {
-                    status = mac_commands[i].handler(start);
-                    start += mac_commands[i].pld_size;
-                }
-                break;
-            }
-        }
 
-        if (status != true)
+        if (cid > CID_DOWNLINK_MAX)
+            break; // proprietary or unknown, its length isn't known
+
+        const struct mac_command *cmd = &mac_commands[cid];
+
+        // an answer needs a handler, so this is a hole of the table
+        if (cmd->handler == NULL && cmd->ans_size != NO_ANS)
             break;
+
+        if (end - start < cmd->pld_size)
+            break;
+
+        if (cmd->handler) {
+            uint8_t *ans = NULL;
+
+            // answer is written in place, the command waits for a retry
+            // from the server if there is no room, the following ones
+            // are still applied
+            if (cmd->ans_size != NO_ANS)
+                ans = cmd->sticky ? reserve_sticky(ctx, cid, cmd->ans_size) :
+                    mac_reserve(ctx, cid, cmd->ans_size);
+            if (ans != NULL || cmd->ans_size == NO_ANS)
+                cmd->handler(ctx, start, ans);
+        }
+
+        start += cmd->pld_size;
     }
 }
 
-bool mac_enqueue(uint8_t cid, const uint8_t *data, uint8_t size)
+uint8_t *mac_reserve(struct uwan_ctx *ctx, uint8_t cid, uint8_t size)
 {
-    uint8_t free = sizeof(mac_buf) - mac_buf_pos;
+    uint8_t free = MAC_BUF_SIZE - ctx->mac.sticky_pos - ctx->mac.buf_pos;
 
     if ((sizeof(cid) + size) > free)
+        return NULL;
+
+    ctx->mac.buf[ctx->mac.buf_pos++] = cid;
+    uint8_t *ans = ctx->mac.buf + ctx->mac.buf_pos;
+    ctx->mac.buf_pos += size;
+
+    return ans;
+}
+
+bool mac_enqueue(struct uwan_ctx *ctx, uint8_t cid, const uint8_t *data,
+    uint8_t size)
+{
+    uint8_t *ans = mac_reserve(ctx, cid, size);
+
+    if (ans == NULL)
         return false;
 
-    mac_buf[mac_buf_pos++] = cid;
-    if (size) {
-        memcpy(mac_buf + mac_buf_pos, data, size);
-        mac_buf_pos += size;
-    }
+    if (size)
+        memcpy(ans, data, size);
 
     return true;
 }
 
-void mac_on_tx_complete()
+void mac_on_tx_complete(struct uwan_ctx *ctx)
+{
+    if (ctx->mac.save_dev_time) {
+        ctx->mac.save_dev_time = false;
+        if (ctx->stack_hal->get_time_ms)
+            ctx->mac.dev_time_ms = ctx->stack_hal->get_time_ms(ctx);
+        if (ctx->mac.cbs && ctx->mac.cbs->get_device_time)
+            ctx->mac.dev_time = ctx->mac.cbs->get_device_time();
+    }
+}
+
+void mac_handle_downlink(struct uwan_ctx *ctx)
 {
-    if (mac_save_dev_time) {
-        mac_save_dev_time = false;
-        if (mac_cbs->get_device_time)
-            mac_dev_time = mac_cbs->get_device_time();
+    if (ctx->mac.sticky_sent) {
+        ctx->mac.sticky_pos = 0;
+        ctx->mac.sticky_sent = false;
     }
 }
 
-uint8_t mac_get_payload_size()
+uint8_t mac_get_payload_size(struct uwan_ctx *ctx)
 {
-    return mac_buf_pos;
+    return ctx->mac.sticky_pos + ctx->mac.buf_pos;
 }
 
-uint8_t mac_get_payload(uint8_t *buf, uint8_t buf_size)
+uint8_t mac_get_payload(struct uwan_ctx *ctx, uint8_t *buf,
+    uint8_t buf_size)
 {
+    struct mac_state *mac = &ctx->mac;
     uint8_t result = 0;
 
-    if (buf_size >= mac_buf_pos) {
-        memcpy(buf, mac_buf, mac_buf_pos);
-        result = mac_buf_pos;
-        mac_buf_pos = 0;
+    if (buf_size >= mac->sticky_pos + mac->buf_pos) {
+        memcpy(buf, mac->sticky_buf, mac->sticky_pos);
+        memcpy(buf + mac->sticky_pos, mac->buf, mac->buf_pos);
+        result = mac->sticky_pos + mac->buf_pos;
+        mac->buf_pos = 0;
+        mac->sticky_sent = mac->sticky_pos != 0;
     }
 
     return result;
@@ -28,6 +28,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#define CID_RESET 0x01
 #define CID_LINK_CHECK 0x02
 #define CID_LINK_ADR 0x03
 #define CID_DUTY_CYCLE 0x04
@@ -37,18 +38,61 @@
 #define CID_RX_TIMING_SETUP 0x08
 #define CID_TX_PARAM_SETUP 0x09
 #define CID_DI_CHANNEL 0x0A
+#define CID_REKEY 0x0B
+#define CID_ADR_PARAM_SETUP 0x0C
 #define CID_DEVICE_TIME 0x0D
+#define CID_FORCE_REJOIN 0x0E
+#define CID_REJOIN_PARAM_SETUP 0x0F
+#define CID_PING_SLOT_INFO 0x10
+#define CID_PING_SLOT_CHANNEL 0x11
+#define CID_BEACON_TIMING 0x12
+#define CID_BEACON_FREQ 0x13
+#define CID_DEVICE_MODE 0x20
+#define CID_DOWNLINK_MAX CID_DEVICE_MODE // 0x80 and above are proprietary
 
-void mac_init(void);
+#define MAC_FOPTS_SIZE 15
+#define MAC_BUF_SIZE 51 // FPort 0 payload at the lowest DR
+#define MAC_STICKY_BUF_SIZE 5 // CID and payload of each sticky answer
 
-void mac_handle_commands(const uint8_t *buf, uint8_t len);
+struct uwan_ctx;
 
-bool mac_enqueue(uint8_t cid, const uint8_t *data, uint8_t size);
+struct mac_state {
+    uint8_t buf[MAC_BUF_SIZE]; // answers sent once
+    uint8_t buf_pos;
+    uint8_t sticky_buf[MAC_STICKY_BUF_SIZE]; // answers sent until downlink
+    uint8_t sticky_pos;
+    bool sticky_sent; // sticky answers have been in an uplink
+    bool save_dev_time;
+    uint32_t dev_time;
+    uint32_t dev_time_ms; // local time of DeviceTimeReq, for class B
+    const struct uwan_mac_callbacks *cbs;
+};
 
-void mac_on_tx_complete(void);
+void mac_init(struct uwan_ctx *ctx);
 
-uint8_t mac_get_payload_size(void);
+void mac_handle_commands(struct uwan_ctx *ctx, const uint8_t *buf,
+    uint8_t len);
 
-uint8_t mac_get_payload(uint8_t *buf, uint8_t buf_size);
+bool mac_enqueue(struct uwan_ctx *ctx, uint8_t cid, const uint8_t *data,
+    uint8_t size);
+
+/**
+ * \brief Append CID to uplink MAC commands and reserve its payload
+ *
+ * \returns pointer to payload to fill in, NULL if there is no room
+ */
+uint8_t *mac_reserve(struct uwan_ctx *ctx, uint8_t cid, uint8_t size);
+
+void mac_on_tx_complete(struct uwan_ctx *ctx);
+
+/**
+ * \brief Drop sticky answers once class A downlink follows their uplink
+ */
+void mac_handle_downlink(struct uwan_ctx *ctx);
+
+uint8_t mac_get_payload_size(struct uwan_ctx *ctx);
+
+uint8_t mac_get_payload(struct uwan_ctx *ctx, uint8_t *buf,
+    uint8_t buf_size);
 
 #endif
@@ -0,0 +1,230 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <uwan/stack.h>
+#include "multicast.h"
+#include "stack.h"
+
+#define MC_KEY_BLOCK_ID 0x00
+#define MC_APP_S_KEY_ID 0x01
+#define MC_NWK_S_KEY_ID 0x02
+
+static void delete_contexts(struct uwan_ctx *ctx, struct mc_group *group)
+{
+    if (group->nwk_s_key_cmac)
+        ctx->stack_hal->crypto_cmac_delete_context(group->nwk_s_key_cmac);
+    if (group->app_s_key_aes)
+        ctx->stack_hal->crypto_aes_delete_context(group->app_s_key_aes);
+    group->nwk_s_key_cmac = NULL;
+    group->app_s_key_aes = NULL;
+}
+
+/* lookup keeps DevAddr of active groups in ascending order */
+static void update_lookup(struct uwan_ctx *ctx)
+{
+    struct multicast_state *mc = &ctx->multicast;
+
+    mc->lookup_len = 0;
+    for (uint8_t id = 0; id < UWAN_MC_GROUPS; id++) {
+        if (!mc->groups[id].active)
+            continue;
+
+        uint8_t pos = mc->lookup_len++;
+        while (pos > 0 &&
+            mc->lookup[pos - 1].dev_addr > mc->groups[id].dev_addr) {
+            mc->lookup[pos] = mc->lookup[pos - 1];
+            pos--;
+        }
+        mc->lookup[pos].dev_addr = mc->groups[id].dev_addr;
+        mc->lookup[pos].id = id;
+    }
+}
+
+/* key = aes128_encrypt(root, id | DevAddr | pad16) */
+static void derive_key(struct uwan_ctx *ctx, uint8_t *key, void *aes_ctx,
+    uint8_t id, uint32_t dev_addr)
+{
+    uint8_t block[UWAN_AES_BLOCK_SIZE] = {
+        id, dev_addr, dev_addr >> 8, dev_addr >> 16, dev_addr >> 24,
+    };
+
+    ctx->stack_hal->crypto_aes_encrypt(aes_ctx, key, block);
+}
+
+void multicast_init(struct uwan_ctx *ctx)
+{
+    memset(&ctx->multicast, 0, sizeof(ctx->multicast));
+}
+
+void multicast_deinit(struct uwan_ctx *ctx)
+{
+    struct multicast_state *mc = &ctx->multicast;
+
+    for (uint8_t id = 0; id < UWAN_MC_GROUPS; id++)
+        delete_contexts(ctx, &mc->groups[id]);
+
+    if (mc->ke_key_aes)
+        ctx->stack_hal->crypto_aes_delete_context(mc->ke_key_aes);
+
+    multicast_init(ctx);
+}
+
+struct mc_group *multicast_find(struct uwan_ctx *ctx, uint32_t dev_addr,
+    uint8_t *id)
+{
+    struct multicast_state *mc = &ctx->multicast;
+    uint8_t lo = 0;
+    uint8_t hi = mc->lookup_len;
+
+    while (lo < hi) {
+        uint8_t mid = (lo + hi) / 2;
+
+        if (mc->lookup[mid].dev_addr == dev_addr) {
+            *id = mc->lookup[mid].id;
+            return &mc->groups[*id];
+        }
+
+        if (mc->lookup[mid].dev_addr < dev_addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return NULL;
+}
+
+bool uwan_mc_set_group(struct uwan_ctx *ctx, uint8_t id, uint32_t mc_addr,
+    const uint8_t *mc_nwk_s_key, const uint8_t *mc_app_s_key,
+    uint32_t f_cnt_min, uint32_t f_cnt_max)
+{
+    uint8_t other_id;
+
+    if (id >= UWAN_MC_GROUPS || mc_addr == ctx->session.dev_addr)
+        return false;
+
+    if (multicast_find(ctx, mc_addr, &other_id) && other_id != id)
+        return false;
+
+    struct mc_group *group = &ctx->multicast.groups[id];
+
+    delete_contexts(ctx, group);
+    group->dev_addr = mc_addr;
+    // 0 accepts any initial value, see handle_data_msg
+    group->f_cnt_down = f_cnt_min ? f_cnt_min - 1 : 0;
+    group->f_cnt_max = f_cnt_max;
+    init_blocks(group->a_block, group->b0_block, mc_addr);
+
+    memcpy(group->nwk_s_key, mc_nwk_s_key, UWAN_NWK_S_KEY_SIZE);
+    if (ctx->stack_hal->crypto_cmac_reset) {
+        group->nwk_s_key_cmac =
+            ctx->stack_hal->crypto_cmac_create_context(mc_nwk_s_key);
+    }
+    group->app_s_key_aes =
+        ctx->stack_hal->crypto_aes_create_context(mc_app_s_key);
+
+    // group with old keys would be accepted by the lookup
+    group->active = group->app_s_key_aes && (group->nwk_s_key_cmac ||
+        !ctx->stack_hal->crypto_cmac_reset);
+    if (!group->active)
+        delete_contexts(ctx, group);
+    update_lookup(ctx);
+
+    return group->active;
+}
+
+bool uwan_mc_set_gen_app_key(struct uwan_ctx *ctx, const uint8_t *gen_app_key)
+{
+    struct multicast_state *mc = &ctx->multicast;
+    uint8_t block[UWAN_AES_BLOCK_SIZE] = {MC_KEY_BLOCK_ID};
+    uint8_t key[UWAN_AES_BLOCK_SIZE];
+
+    if (mc->ke_key_aes)
+        ctx->stack_hal->crypto_aes_delete_context(mc->ke_key_aes);
+    mc->ke_key_aes = NULL;
+
+    // McRootKey and then McKEKey
+    memcpy(key, gen_app_key, UWAN_AES_BLOCK_SIZE);
+    for (int i = 0; i < 2; i++) {
+        void *aes_ctx = ctx->stack_hal->crypto_aes_create_context(key);
+        if (!aes_ctx)
+            return false;
+
+        ctx->stack_hal->crypto_aes_encrypt(aes_ctx, key, block);
+        ctx->stack_hal->crypto_aes_delete_context(aes_ctx);
+    }
+
+    mc->ke_key_aes = ctx->stack_hal->crypto_aes_create_context(key);
+
+    return mc->ke_key_aes != NULL;
+}
+
+bool uwan_mc_setup_group(struct uwan_ctx *ctx, uint8_t id, uint32_t mc_addr,
+    const uint8_t *mc_key_encrypted, uint32_t f_cnt_min, uint32_t f_cnt_max)
+{
+    uint8_t mc_key[UWAN_AES_BLOCK_SIZE];
+    uint8_t nwk_s_key[UWAN_NWK_S_KEY_SIZE];
+    uint8_t app_s_key[UWAN_APP_S_KEY_SIZE];
+
+    if (!ctx->multicast.ke_key_aes)
+        return false;
+
+    ctx->stack_hal->crypto_aes_encrypt(ctx->multicast.ke_key_aes, mc_key,
+        mc_key_encrypted);
+
+    void *aes_ctx = ctx->stack_hal->crypto_aes_create_context(mc_key);
+    if (!aes_ctx) {
+        uwan_mc_delete_group(ctx, id);
+        return false;
+    }
+
+    derive_key(ctx, app_s_key, aes_ctx, MC_APP_S_KEY_ID, mc_addr);
+    derive_key(ctx, nwk_s_key, aes_ctx, MC_NWK_S_KEY_ID, mc_addr);
+    ctx->stack_hal->crypto_aes_delete_context(aes_ctx);
+
+    return uwan_mc_set_group(ctx, id, mc_addr, nwk_s_key, app_s_key,
+        f_cnt_min, f_cnt_max);
+}
+
+bool uwan_mc_delete_group(struct uwan_ctx *ctx, uint8_t id)
+{
+    if (id >= UWAN_MC_GROUPS || !ctx->multicast.groups[id].active)
+        return false;
+
+    delete_contexts(ctx, &ctx->multicast.groups[id]);
+    ctx->multicast.groups[id].active = false;
+    update_lookup(ctx);
+
+    return true;
+}
+
+bool uwan_mc_get_group(struct uwan_ctx *ctx, uint8_t id, uint32_t *mc_addr)
+{
+    if (id >= UWAN_MC_GROUPS || !ctx->multicast.groups[id].active)
+        return false;
+
+    *mc_addr = ctx->multicast.groups[id].dev_addr;
+    return true;
+}
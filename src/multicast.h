@@ -0,0 +1,71 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __MULTICAST_H__
+#define __MULTICAST_H__
+
+#include <uwan/stack.h>
+
+#ifndef UWAN_MC_GROUPS
+#define UWAN_MC_GROUPS 4 // TS005 addresses up to 4 groups
+#endif
+
+struct mc_group {
+    bool active;
+    uint32_t dev_addr;
+    uint32_t f_cnt_down;
+    uint32_t f_cnt_max; // frames above it are rejected
+    uint8_t nwk_s_key[UWAN_NWK_S_KEY_SIZE];
+    void *nwk_s_key_cmac; // NULL if hal can't reset CMAC context
+    void *app_s_key_aes;
+    uint8_t a_block[UWAN_AES_BLOCK_SIZE];
+    uint8_t b0_block[UWAN_AES_BLOCK_SIZE];
+};
+
+struct mc_addr_entry {
+    uint32_t dev_addr;
+    uint8_t id;
+};
+
+struct multicast_state {
+    struct mc_group groups[UWAN_MC_GROUPS];
+    struct mc_addr_entry lookup[UWAN_MC_GROUPS]; // active groups by DevAddr
+    uint8_t lookup_len;
+    void *ke_key_aes; // McKEKey, NULL until GenAppKey is set
+};
+
+void multicast_init(struct uwan_ctx *ctx);
+
+void multicast_deinit(struct uwan_ctx *ctx);
+
+/**
+ * \brief Find active group by DevAddr, costs no crypto
+ *
+ * \param id group ID is returned here
+ * \returns NULL if DevAddr doesn't belong to any group
+ */
+struct mc_group *multicast_find(struct uwan_ctx *ctx, uint32_t dev_addr,
+    uint8_t *id);
+
+#endif
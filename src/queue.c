@@ -0,0 +1,205 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "mac.h"
+#include "queue.h"
+#include "stack.h"
+
+static bool is_expired(const struct queue_entry *entry, uint32_t now)
+{
+    return entry->has_deadline && (int32_t)(now - entry->deadline) >= 0;
+}
+
+/* higher priority first, then earliest deadline, then FIFO */
+static bool is_before(const struct queue_entry *a,
+    const struct queue_entry *b)
+{
+    if (a->priority != b->priority)
+        return a->priority > b->priority;
+
+    if (a->has_deadline != b->has_deadline)
+        return a->has_deadline;
+
+    if (a->has_deadline && a->deadline != b->deadline)
+        return (int32_t)(a->deadline - b->deadline) < 0;
+
+    return (int32_t)(a->seq - b->seq) < 0;
+}
+
+static void complete(struct uwan_ctx *ctx, struct queue_entry *entry,
+    enum uwan_errs err)
+{
+    entry->in_use = false;
+
+    if (ctx->stack_hal->uplink_callback)
+        ctx->stack_hal->uplink_callback(ctx, entry->id, err);
+}
+
+/* report expired uplinks and wake up at the next deadline */
+static void expire(struct uwan_ctx *ctx)
+{
+    struct queue_state *queue = &ctx->queue;
+    uint32_t wait = UINT32_MAX;
+    uint32_t now;
+
+    if (ctx->stack_hal->get_time_ms == NULL)
+        return;
+
+    now = ctx->stack_hal->get_time_ms(ctx);
+    for (uint8_t i = 0; i < UWAN_QUEUE_SIZE; i++) {
+        struct queue_entry *entry = &queue->entries[i];
+
+        if (entry->in_use && entry != queue->in_flight &&
+            is_expired(entry, now))
+            complete(ctx, entry, UWAN_ERR_DEADLINE);
+    }
+
+    // uplink callbacks might have queued new entries
+    for (uint8_t i = 0; i < UWAN_QUEUE_SIZE; i++) {
+        struct queue_entry *entry = &queue->entries[i];
+
+        if (entry->in_use && entry != queue->in_flight &&
+            entry->has_deadline && entry->deadline - now < wait)
+            wait = entry->deadline - now;
+    }
+
+    if (wait != UINT32_MAX)
+        ctx->stack_hal->start_timer(ctx, UWAN_TIMER_QUEUE, wait);
+    else
+        ctx->stack_hal->stop_timer(ctx, UWAN_TIMER_QUEUE);
+}
+
+static struct queue_entry *get_next(struct uwan_ctx *ctx)
+{
+    struct queue_state *queue = &ctx->queue;
+    struct queue_entry *next = NULL;
+
+    for (uint8_t i = 0; i < UWAN_QUEUE_SIZE; i++) {
+        struct queue_entry *entry = &queue->entries[i];
+
+        if (entry->in_use && (next == NULL || is_before(entry, next)))
+            next = entry;
+    }
+
+    return next;
+}
+
+void queue_init(struct uwan_ctx *ctx)
+{
+    memset(&ctx->queue, 0, sizeof(ctx->queue));
+}
+
+void queue_process(struct uwan_ctx *ctx)
+{
+    struct queue_state *queue = &ctx->queue;
+
+    expire(ctx);
+
+    // the uplink callback may enqueue or send another frame
+    while (ctx->state == UWAN_STATE_IDLE && queue->in_flight == NULL &&
+        uwan_is_joined(ctx)) {
+        struct queue_entry *entry = get_next(ctx);
+        if (entry == NULL)
+            break;
+
+        enum uwan_errs err = uwan_send_frame(ctx, entry->f_port,
+            entry->payload, entry->pld_len, entry->confirm);
+
+        if (err == UWAN_ERR_MSG_LEN && mac_get_payload_size(ctx) &&
+            entry->pld_len <= get_max_frm_payload_size(ctx)) {
+            // MAC answers don't fit together with payload, flush them first
+            err = uwan_send_frame(ctx, 0, NULL, 0, false);
+            if (err == UWAN_ERR_NO)
+                break;
+        }
+
+        if (err == UWAN_ERR_NO) {
+            queue->in_flight = entry;
+        }
+        else if (err == UWAN_ERR_DUTY_CYCLE) {
+            ctx->stack_hal->start_timer(ctx, UWAN_TIMER_TX,
+                uwan_get_next_tx_delay(ctx));
+            break;
+        }
+        else {
+            complete(ctx, entry, err);
+        }
+    }
+}
+
+void queue_on_rx_done(struct uwan_ctx *ctx, enum uwan_errs result)
+{
+    struct queue_entry *entry = ctx->queue.in_flight;
+
+    if (entry) {
+        ctx->queue.in_flight = NULL;
+        complete(ctx, entry, result);
+    }
+
+    queue_process(ctx);
+}
+
+enum uwan_errs uwan_queue_frame(struct uwan_ctx *ctx,
+    const struct uwan_uplink *uplink, uint8_t *id)
+{
+    struct queue_state *queue = &ctx->queue;
+    struct queue_entry *entry = NULL;
+
+    if (uplink->pld_len > UWAN_QUEUE_PLD_SIZE)
+        return UWAN_ERR_MSG_LEN;
+
+    for (uint8_t i = 0; i < UWAN_QUEUE_SIZE; i++) {
+        if (!queue->entries[i].in_use) {
+            entry = &queue->entries[i];
+            break;
+        }
+    }
+
+    if (entry == NULL)
+        return UWAN_ERR_QUEUE_FULL;
+
+    entry->in_use = true;
+    entry->confirm = uplink->confirm;
+    entry->id = queue->next_id++;
+    entry->f_port = uplink->f_port;
+    entry->priority = uplink->priority;
+    entry->pld_len = uplink->pld_len;
+    entry->seq = queue->seq++;
+    entry->has_deadline = uplink->lifetime_ms && ctx->stack_hal->get_time_ms;
+    if (entry->has_deadline) {
+        entry->deadline = ctx->stack_hal->get_time_ms(ctx) +
+            uplink->lifetime_ms;
+    }
+    if (uplink->pld_len)
+        memcpy(entry->payload, uplink->payload, uplink->pld_len);
+
+    if (id)
+        *id = entry->id;
+
+    queue_process(ctx);
+
+    return UWAN_ERR_NO;
+}
@@ -0,0 +1,72 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __QUEUE_H__
+#define __QUEUE_H__
+
+#include <uwan/stack.h>
+
+#ifndef UWAN_QUEUE_SIZE
+#define UWAN_QUEUE_SIZE 4
+#endif
+
+#ifndef UWAN_QUEUE_PLD_SIZE
+#define UWAN_QUEUE_PLD_SIZE 64
+#endif
+
+struct queue_entry {
+    bool in_use;
+    bool confirm;
+    bool has_deadline;
+    uint8_t id;
+    uint8_t f_port;
+    uint8_t priority;
+    uint8_t pld_len;
+    uint32_t seq; // order of enqueueing
+    uint32_t deadline; // ms
+    uint8_t payload[UWAN_QUEUE_PLD_SIZE];
+};
+
+struct queue_state {
+    struct queue_entry entries[UWAN_QUEUE_SIZE];
+    struct queue_entry *in_flight; // NULL if uplink isn't from the queue
+    uint32_t seq;
+    uint8_t next_id;
+};
+
+void queue_init(struct uwan_ctx *ctx);
+
+/**
+ * \brief Send the next queued uplink if the stack is idle
+ */
+void queue_process(struct uwan_ctx *ctx);
+
+/**
+ * \brief Complete uplink in flight once RX windows are closed
+ *
+ * \param result UWAN_ERR_NO_ACK if confirmed uplink hasn't been acknowledged
+ */
+void queue_on_rx_done(struct uwan_ctx *ctx, enum uwan_errs result);
+
+#endif
@@ -30,7 +30,8 @@
 #define CFLIST_CH_SIZE 3 // bytes
 #define CFLIST_FREQ_STEP 100 // Hz
 
-void region_86x_handle_cflist(const uint8_t *cflist, uint8_t ch_first)
+void region_86x_handle_cflist(struct uwan_ctx *ctx, const uint8_t *cflist,
+    uint8_t ch_first)
 {
     uint8_t cflist_type = cflist[LORAWAN_CFLIST_SIZE - 1];
 
@@ -40,14 +41,14 @@ void region_86x_handle_cflist(const uint8_t *cflist, uint8_t ch_first)
     for (int idx = 0; idx < CFLIST_CHANNELS; idx++, cflist += CFLIST_CH_SIZE) {
         uint32_t freq = cflist[0] | cflist[1] << 8 | cflist[2] << 16;
         if (freq == 0)
-            uwan_enable_channel(idx + ch_first, false);
+            uwan_enable_channel(ctx, idx + ch_first, false);
         else
-            uwan_set_channel(idx + ch_first, freq * CFLIST_FREQ_STEP);
+            uwan_set_channel(ctx, idx + ch_first, freq * CFLIST_FREQ_STEP);
     }
 }
 
-bool region_86x_handle_adr_ch_mask(uint16_t ch_mask, uint8_t ch_mask_cntl,
-    bool dry_run)
+bool region_86x_handle_adr_ch_mask(struct uwan_ctx *ctx, uint16_t ch_mask,
+    uint8_t ch_mask_cntl, bool dry_run)
 {
     switch (ch_mask_cntl) {
     case 0:
@@ -55,19 +56,19 @@ bool region_86x_handle_adr_ch_mask(uint16_t ch_mask, uint8_t ch_mask_cntl,
             bool enable = (ch_mask & (1 << i)) != 0;
             if (dry_run) {
                 // validate mask
-                if (enable && (channel_is_exist(i) == false))
+                if (enable && (channel_is_exist(ctx, i) == false))
                     return false;
             }
             else {
                 // apply mask
-                uwan_enable_channel(i, enable);
+                uwan_enable_channel(ctx, i, enable);
             }
         }
         return true;
 
     case 6:
         if (dry_run == false)
-            channels_enable_all();
+            channels_enable_all(ctx);
         return true;
 
     default:
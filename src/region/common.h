@@ -25,12 +25,12 @@
 #ifndef __REGION_COMMON_H__
 #define __REGION_COMMON_H__
 
-#include <stdbool.h>
-#include <stdint.h>
+#include <uwan/stack.h>
 
-void region_86x_handle_cflist(const uint8_t *cflist, uint8_t ch_first);
+void region_86x_handle_cflist(struct uwan_ctx *ctx, const uint8_t *cflist,
+    uint8_t ch_first);
 
-bool region_86x_handle_adr_ch_mask(uint16_t ch_mask, uint8_t ch_mask_cntl,
-    bool dry_run);
+bool region_86x_handle_adr_ch_mask(struct uwan_ctx *ctx, uint16_t ch_mask,
+    uint8_t ch_mask_cntl, bool dry_run);
 
 #endif
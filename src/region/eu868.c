@@ -27,26 +27,41 @@
 
 #define CFLIST_CH_FIRST 3
 
-static void eu868_init(void);
-static void eu868_handle_cflist(const uint8_t *cflist);
+static void eu868_init(struct uwan_ctx *ctx);
+static void eu868_handle_cflist(struct uwan_ctx *ctx, const uint8_t *cflist);
+
+/* See ETSI EN 300 220-2 and LoRaWAN Regional Parameters */
+static const struct uwan_band eu868_bands[] = {
+    {863000000, 865000000, 1000}, // 0.1%
+    {865000000, 868000000, 100}, // g, 1%
+    {868000000, 868600000, 100}, // g1, 1%
+    {868700000, 869200000, 1000}, // g2, 0.1%
+    {869400000, 869650000, 10}, // g3, 10%
+    {869700000, 870000000, 100}, // g4, 1%
+};
 
 const struct uwan_region region_eu868 = {
     .init = eu868_init,
     .handle_cflist = eu868_handle_cflist,
     .handle_adr_ch_mask = region_86x_handle_adr_ch_mask,
+    .bands = eu868_bands,
+    .bands_count = sizeof(eu868_bands) / sizeof(eu868_bands[0]),
+    .beacon_frequency = 869525000,
+    .ping_frequency = 869525000,
+    .beacon_dr = UWAN_DR_3,
 };
 
-void eu868_init()
+void eu868_init(struct uwan_ctx *ctx)
 {
-    uwan_set_channel(0, 868100000);
-    uwan_set_channel(1, 868300000);
-    uwan_set_channel(2, 868500000);
-    uwan_set_rx1_delay(1);
-    uwan_set_rx1_dr_offset(0);
-    uwan_set_rx2(868100000, UWAN_DR_0);
+    uwan_set_channel(ctx, 0, 868100000);
+    uwan_set_channel(ctx, 1, 868300000);
+    uwan_set_channel(ctx, 2, 868500000);
+    uwan_set_rx1_delay(ctx, 1);
+    uwan_set_rx1_dr_offset(ctx, 0);
+    uwan_set_rx2(ctx, 868100000, UWAN_DR_0);
 }
 
-static void eu868_handle_cflist(const uint8_t *cflist)
+static void eu868_handle_cflist(struct uwan_ctx *ctx, const uint8_t *cflist)
 {
-    region_86x_handle_cflist(cflist, CFLIST_CH_FIRST);
+    region_86x_handle_cflist(ctx, cflist, CFLIST_CH_FIRST);
 }
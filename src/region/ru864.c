@@ -27,25 +27,34 @@
 
 #define CFLIST_CH_FIRST 2
 
-static void ru864_init(void);
-static void ru864_handle_cflist(const uint8_t *cflist);
+static void ru864_init(struct uwan_ctx *ctx);
+static void ru864_handle_cflist(struct uwan_ctx *ctx, const uint8_t *cflist);
+
+static const struct uwan_band ru864_bands[] = {
+    {864000000, 870000000, 100}, // 1%
+};
 
 const struct uwan_region region_ru864 = {
     .init = ru864_init,
     .handle_cflist = ru864_handle_cflist,
     .handle_adr_ch_mask = region_86x_handle_adr_ch_mask,
+    .bands = ru864_bands,
+    .bands_count = sizeof(ru864_bands) / sizeof(ru864_bands[0]),
+    .beacon_frequency = 869100000,
+    .ping_frequency = 868900000,
+    .beacon_dr = UWAN_DR_3,
 };
 
-static void ru864_init()
+static void ru864_init(struct uwan_ctx *ctx)
 {
-    uwan_set_channel(0, 868900000);
-    uwan_set_channel(1, 869100000);
-    uwan_set_rx1_delay(1);
-    uwan_set_rx1_dr_offset(0);
-    uwan_set_rx2(869100000, UWAN_DR_0);
+    uwan_set_channel(ctx, 0, 868900000);
+    uwan_set_channel(ctx, 1, 869100000);
+    uwan_set_rx1_delay(ctx, 1);
+    uwan_set_rx1_dr_offset(ctx, 0);
+    uwan_set_rx2(ctx, 869100000, UWAN_DR_0);
 }
 
-static void ru864_handle_cflist(const uint8_t *cflist)
+static void ru864_handle_cflist(struct uwan_ctx *ctx, const uint8_t *cflist)
 {
-    region_86x_handle_cflist(cflist, CFLIST_CH_FIRST);
+    region_86x_handle_cflist(ctx, cflist, CFLIST_CH_FIRST);
 }
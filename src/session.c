@@ -0,0 +1,212 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <uwan/stack.h>
+#include "adr.h"
+#include "channels.h"
+#include "stack.h"
+#include "utils.h"
+
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_CRC_LEN 2
+#define SNAPSHOT_FLAG_ADR 0x1
+#define CHANNEL_MASK_LEN BYTES_FOR_BITS(MAX_CHANNELS)
+#define CHANNEL_FREQ_LEN 3 // frequency / 100 like in CFList
+#define CHANNEL_FREQ_STEP 100
+
+typedef char snapshot_size_check[
+    1 + 1 + 3 * 4 + UWAN_NWK_S_KEY_SIZE + UWAN_APP_S_KEY_SIZE + 15 +
+    CHANNEL_MASK_LEN + 2 * MAX_CHANNELS * CHANNEL_FREQ_LEN +
+    SNAPSHOT_CRC_LEN ==
+    UWAN_SESSION_SNAPSHOT_SIZE ? 1 : -1];
+
+static uint8_t put_u32(uint8_t *buf, uint32_t value, uint8_t len)
+{
+    for (uint8_t i = 0; i < len; i++)
+        buf[i] = (value >> (8 * i)) & 0xff;
+
+    return len;
+}
+
+static uint32_t get_u32(const uint8_t *buf, uint8_t len)
+{
+    uint32_t value = 0;
+
+    for (uint8_t i = 0; i < len; i++)
+        value |= (uint32_t)buf[i] << (8 * i);
+
+    return value;
+}
+
+/* CRC-16/CCITT-FALSE */
+static uint16_t calc_crc(const uint8_t *buf, size_t len)
+{
+    uint16_t crc = 0xffff;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)buf[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
+
+size_t uwan_session_save(struct uwan_ctx *ctx, uint8_t *buf, size_t size)
+{
+    const struct channels_state *chs = &ctx->channels;
+    size_t offset = 0;
+
+    if (!ctx->session.is_joined || size < UWAN_SESSION_SNAPSHOT_SIZE)
+        return 0;
+
+    buf[offset++] = SNAPSHOT_VERSION;
+    buf[offset++] = uwan_adr_is_enabled(ctx) ? SNAPSHOT_FLAG_ADR : 0;
+    offset += put_u32(&buf[offset], ctx->session.dev_addr, 4);
+    offset += put_u32(&buf[offset], ctx->session.f_cnt_up, 4);
+    offset += put_u32(&buf[offset], ctx->session.f_cnt_down, 4);
+    memcpy(&buf[offset], ctx->session.nwk_s_key, UWAN_NWK_S_KEY_SIZE);
+    offset += UWAN_NWK_S_KEY_SIZE;
+    memcpy(&buf[offset], ctx->session.app_s_key, UWAN_APP_S_KEY_SIZE);
+    offset += UWAN_APP_S_KEY_SIZE;
+
+    buf[offset++] = ctx->session.dr;
+    buf[offset++] = ctx->tx_power;
+    buf[offset++] = ctx->nb_trans;
+    buf[offset++] = ctx->default_rx1_delay / 1000;
+    buf[offset++] = ctx->rx1_offset;
+    offset += put_u32(&buf[offset], ctx->rx2_frequency, 4);
+    buf[offset++] = ctx->rx2_dr;
+    buf[offset++] = chs->max_dcycle;
+    offset += put_u32(&buf[offset], ctx->adr.ack_cnt, 4);
+
+    memcpy(&buf[offset], chs->mask, CHANNEL_MASK_LEN);
+    offset += CHANNEL_MASK_LEN;
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+        offset += put_u32(&buf[offset], chs->freqs[i] / CHANNEL_FREQ_STEP,
+            CHANNEL_FREQ_LEN);
+    }
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+        offset += put_u32(&buf[offset], chs->dl_freqs[i] / CHANNEL_FREQ_STEP,
+            CHANNEL_FREQ_LEN);
+    }
+
+    offset += put_u32(&buf[offset], calc_crc(buf, offset), SNAPSHOT_CRC_LEN);
+
+    return offset;
+}
+
+enum uwan_errs uwan_session_restore(struct uwan_ctx *ctx, const uint8_t *buf,
+    size_t len, uint32_t f_cnt_reserved)
+{
+    const size_t crc_offset = UWAN_SESSION_SNAPSHOT_SIZE - SNAPSHOT_CRC_LEN;
+    size_t offset = 0;
+
+    if (ctx->state != UWAN_STATE_IDLE)
+        return UWAN_ERR_STATE;
+
+    if (len != UWAN_SESSION_SNAPSHOT_SIZE)
+        return UWAN_ERR_MSG_LEN;
+
+    if (buf[0] != SNAPSHOT_VERSION ||
+        calc_crc(buf, crc_offset) != get_u32(&buf[crc_offset],
+            SNAPSHOT_CRC_LEN))
+        return UWAN_ERR_SNAPSHOT;
+
+    offset++;
+    uint8_t flags = buf[offset++];
+    uint32_t dev_addr = get_u32(&buf[offset], 4);
+    offset += 4;
+    uint32_t f_cnt_up = get_u32(&buf[offset], 4);
+    offset += 4;
+    uint32_t f_cnt_down = get_u32(&buf[offset], 4);
+    offset += 4;
+    const uint8_t *nwk_s_key = &buf[offset];
+    offset += UWAN_NWK_S_KEY_SIZE;
+    const uint8_t *app_s_key = &buf[offset];
+    offset += UWAN_APP_S_KEY_SIZE;
+
+    uint8_t dr = buf[offset++];
+    uint8_t tx_power = buf[offset++];
+    uint8_t nb_trans = buf[offset++];
+    uint8_t rx1_delay = buf[offset++];
+    uint8_t rx1_offset = buf[offset++];
+    uint32_t rx2_frequency = get_u32(&buf[offset], 4);
+    offset += 4;
+    uint8_t rx2_dr = buf[offset++];
+    uint8_t max_dcycle = buf[offset++];
+    uint32_t ack_cnt = get_u32(&buf[offset], 4);
+    offset += 4;
+
+    if (!is_valid_dr(dr) || !is_valid_dr(rx2_dr) ||
+        !is_valid_frequency(rx2_frequency))
+        return UWAN_ERR_SNAPSHOT;
+
+    // uplinks up to the reserved counter might have been sent before reset
+    enum uwan_errs err = uwan_set_session(ctx, dev_addr,
+        MAX(f_cnt_up, f_cnt_reserved), f_cnt_down, nwk_s_key, app_s_key);
+    if (err != UWAN_ERR_NO)
+        return err;
+    ctx->session.dr = (enum uwan_dr)dr;
+    if (!set_tx_power(ctx, tx_power))
+        set_tx_power(ctx, ctx->default_tx_power);
+    if (!set_nb_trans(ctx, nb_trans))
+        reset_nb_trans(ctx);
+    uwan_set_rx1_delay(ctx, rx1_delay);
+    uwan_set_rx1_dr_offset(ctx, rx1_offset);
+    uwan_set_rx2(ctx, rx2_frequency, (enum uwan_dr)rx2_dr);
+    channels_set_max_dcycle(ctx, max_dcycle);
+    uwan_adr_enable(ctx, flags & SNAPSHOT_FLAG_ADR);
+    ctx->adr.ack_cnt = ack_cnt;
+
+    // duty cycle state of sub-bands is kept
+    const uint8_t *mask = &buf[offset];
+    offset += CHANNEL_MASK_LEN;
+    ctx->channels.max_count = 0;
+    memset(ctx->channels.mask, 0, sizeof(ctx->channels.mask));
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+        uint32_t freq = get_u32(&buf[offset], CHANNEL_FREQ_LEN) *
+            CHANNEL_FREQ_STEP;
+        offset += CHANNEL_FREQ_LEN;
+
+        if (uwan_set_channel(ctx, i, freq) != UWAN_ERR_NO)
+            ctx->channels.freqs[i] = 0;
+        else if (!BIT_IS_SET(mask, i))
+            uwan_enable_channel(ctx, i, false);
+    }
+
+    // uwan_set_channel has reset DlChannelReq frequencies
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+        uint32_t freq = get_u32(&buf[offset], CHANNEL_FREQ_LEN) *
+            CHANNEL_FREQ_STEP;
+        offset += CHANNEL_FREQ_LEN;
+
+        if (freq)
+            uwan_set_dl_channel(ctx, i, freq);
+    }
+
+    return UWAN_ERR_NO;
+}
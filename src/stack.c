@@ -27,6 +27,7 @@
 #include <uwan/stack.h>
 #include "adr.h"
 #include "channels.h"
+#include "event.h"
 #include "mac.h"
 #include "stack.h"
 #include "utils.h"
@@ -46,26 +47,33 @@
 #define FCTRL_FOPTS_MASK 0xf
 
 #define RX1_DELAY 1000
+#define ACK_TIMEOUT_MIN 1000 // ACK_TIMEOUT is 2 s +/- 1 s
+#define ACK_TIMEOUT_SPREAD 2000
+#define CONFIRM_RETRIES 7 // 8 transmissions at most
 #define JOIN_DELAY 5000
 #define SECOND_RX_OFFSET 1000
+#define DEFAULT_MAX_EIRP 14
 
 #define B0_DIR_UPLINK 0
 #define B0_DIR_DOWNLINK 1
+#define A_BLOCK_ID 0x01
+#define B0_BLOCK_ID 0x49
+#define BLOCK_DIR_OFFSET 5
+#define BLOCK_DEV_ADDR_OFFSET 6
+#define BLOCK_FCNT_OFFSET 10
+#define BLOCK_LAST_OFFSET 15
 #define MIC_LEN 4
-#define FRAME_MAX_SIZE 255
-#define RX_SYMB_TIMEOUT 0x08
+#define DATA_HDR_SIZE 9 // MHDR, DevAddr, FCtrl, FCnt and FPort
+#define KEYSTREAM_BLOCKS (FRAME_MAX_SIZE / UWAN_AES_BLOCK_SIZE + 1)
+#define MIN_RX_SYMBOLS 6 // to detect preamble
+#define MAX_RX_SYMBOLS 255 // sx126x accepts 8 bits only
+#define TIMER_RESOLUTION_US 1000 // hal timers count ms
+
+#define PREAMBLE_LEN 8
 
 #define FREQ_MIN 860000000
 #define FREQ_MAX 870000000
 
-enum stack_states {
-    UWAN_STATE_NOT_INIT,
-    UWAN_STATE_IDLE,
-    UWAN_STATE_TX,
-    UWAN_STATE_RX1,
-    UWAN_STATE_RX2,
-};
-
 struct node_dr {
     enum uwan_sf sf;
     enum uwan_bw bw;
@@ -89,93 +97,168 @@ static const uint8_t uw_max_app_pld_size[] = {
     51, 51, 51, 115, 222, 222,
 };
 
-const struct uwan_region *uw_region;
-struct node_session uw_session;
+static struct uwan_ctx uw_ctx_pool[UWAN_MAX_CONTEXTS];
+
+static void apply_tx_power(struct uwan_ctx *ctx)
+{
+    int power = ctx->default_max_eirp - uw_tx_power_table[ctx->tx_power];
+    ctx->radio->set_power(power);
+}
+
+static enum uwan_dr get_current_dr(struct uwan_ctx *ctx)
+{
+    if (uwan_adr_is_enabled(ctx))
+        return ctx->session.dr;
+
+    return ctx->default_dr;
+}
+
+/*
+ * The window must cover MIN_RX_SYMBOLS of the 8 symbols preamble for any
+ * clock error, so it's centered on the 4th preamble symbol and widened by
+ * the error accumulated since TX done. The radio is woken up earlier by the
+ * wake-up time and TCXO startup.
+ */
+uint32_t calc_rx_window(struct uwan_ctx *ctx, enum uwan_dr dr,
+    uint32_t rx_delay, uint16_t *symb_timeout)
+{
+    const struct radio_dev *radio = ctx->radio;
+    const struct node_dr *node_dr = &uw_dr_table[dr];
+    uint32_t t_sym = UWAN_SYMBOL_TIME_US(node_dr->sf, node_dr->bw);
+    // class B delays of hours overflow 32 bits with large clock error
+    uint64_t rx_error = (uint64_t)rx_delay * ctx->clock_error_ppm / 1000 +
+        TIMER_RESOLUTION_US;
+
+    // wider error gives MAX_RX_SYMBOLS anyway
+    if (rx_error > MAX_RX_SYMBOLS * t_sym)
+        rx_error = MAX_RX_SYMBOLS * t_sym;
+
+    uint32_t symbols = ((2 * MIN_RX_SYMBOLS - 8) * t_sym +
+        2 * (uint32_t)rx_error + t_sym - 1) / t_sym;
+
+    if (symbols < MIN_RX_SYMBOLS)
+        symbols = MIN_RX_SYMBOLS;
+    else if (symbols > MAX_RX_SYMBOLS)
+        symbols = MAX_RX_SYMBOLS;
+    *symb_timeout = symbols;
+
+    uint32_t tcxo = radio->get_tcxo_timeout ? radio->get_tcxo_timeout() : 0;
+    int32_t offset = (int32_t)(4 * t_sym) - (int32_t)(symbols * t_sym / 2) -
+        (int32_t)(ctx->wakeup_time + tcxo * 1000);
+    // class B windows are up to hours away from the last beacon
+    int64_t open_time = (int64_t)rx_delay * 1000 + offset;
+
+    // rounding down opens the window earlier, it's covered by rx_error
+    return open_time > 0 ? (uint32_t)(open_time / 1000) : 0;
+}
+
+void set_dr_params(struct uwan_packet_params *params, enum uwan_dr dr)
+{
+    params->sf = uw_dr_table[dr].sf;
+    params->bw = uw_dr_table[dr].bw;
+}
+
+static enum uwan_errs get_channel_err(struct uwan_ctx *ctx)
+{
+    if (uwan_get_next_tx_delay(ctx))
+        return UWAN_ERR_DUTY_CYCLE;
+
+    return UWAN_ERR_CHANNEL;
+}
+
+/* returns false if a context for the key can't be created */
+static bool replace_aes_context(struct uwan_ctx *ctx, void **crypto_ctx,
+    const uint8_t *key)
+{
+    if (*crypto_ctx)
+        ctx->stack_hal->crypto_aes_delete_context(*crypto_ctx);
+    *crypto_ctx = key ? ctx->stack_hal->crypto_aes_create_context(key) : NULL;
+
+    return !key || *crypto_ctx;
+}
 
-static const struct radio_dev *uw_radio;
-static const struct stack_hal *uw_stack_hal;
-static struct uwan_packet_params pkt_params;
-static uint8_t uw_frame[FRAME_MAX_SIZE];
-static enum stack_states uw_state = UWAN_STATE_NOT_INIT;
-static uint32_t uw_rx1_delay;
-static uint8_t uw_rx1_offset;
-static uint32_t uw_rx2_delay;
-static bool uw_is_join_state;
-static uint32_t uw_dev_nonce;
-static uint8_t uw_dev_eui[UWAN_DEV_EUI_SIZE];
-static uint8_t uw_app_eui[UWAN_APP_EUI_SIZE];
-static uint8_t uw_app_key[UWAN_APP_KEY_SIZE];
+static bool replace_cmac_context(struct uwan_ctx *ctx, void **crypto_ctx,
+    const uint8_t *key)
+{
+    if (*crypto_ctx)
+        ctx->stack_hal->crypto_cmac_delete_context(*crypto_ctx);
+    *crypto_ctx = NULL;
 
-static uint32_t default_join_delay = JOIN_DELAY;
-static uint32_t default_rx1_delay = RX1_DELAY;
-static enum uwan_dr default_dr = UWAN_DR_0;
-static uint8_t default_nb_trans = NB_TRANS_MIN;
-static uint8_t uw_nb_trans = NB_TRANS_MIN;
-static uint8_t default_tx_power = 0;
-static uint8_t uw_tx_power = 0;
-static int8_t default_max_eirp = 14;
-static int8_t current_snr;
+    // without reset the context can't be reused, calc_mic creates a new one
+    if (!key || !ctx->stack_hal->crypto_cmac_reset)
+        return true;
 
-/* RX2 window settings */
-static uint32_t uw_rx2_frequency;
-static enum uwan_dr uw_rx2_dr;
+    *crypto_ctx = ctx->stack_hal->crypto_cmac_create_context(key);
+    return *crypto_ctx != NULL;
+}
 
-static void apply_tx_power(void)
+static void init_block(uint8_t *block, uint8_t id, uint32_t dev_addr)
 {
-    int power = default_max_eirp - uw_tx_power_table[uw_tx_power];
-    uw_radio->set_power(power);
+    uint8_t pos = BLOCK_DEV_ADDR_OFFSET;
+
+    memset(block, 0, UWAN_AES_BLOCK_SIZE);
+    block[0] = id;
+    block[pos++] = dev_addr & 0xff;
+    block[pos++] = (dev_addr >> 8) & 0xff;
+    block[pos++] = (dev_addr >> 16) & 0xff;
+    block[pos++] = (dev_addr >> 24) & 0xff;
 }
 
-static enum uwan_dr get_current_dr(void)
+void init_blocks(uint8_t *a_block, uint8_t *b0_block, uint32_t dev_addr)
 {
-    if (uwan_adr_is_enabled())
-        return uw_session.dr;
+    init_block(a_block, A_BLOCK_ID, dev_addr);
+    init_block(b0_block, B0_BLOCK_ID, dev_addr);
+}
 
-    return default_dr;
+static void patch_block(uint8_t *block, uint8_t dir, uint32_t f_cnt)
+{
+    uint8_t pos = BLOCK_FCNT_OFFSET;
+
+    block[BLOCK_DIR_OFFSET] = dir;
+    block[pos++] = f_cnt & 0xff;
+    block[pos++] = (f_cnt >> 8) & 0xff;
+    block[pos++] = (f_cnt >> 16) & 0xff;
+    block[pos++] = (f_cnt >> 24) & 0xff;
 }
 
-static uint32_t adjust_rx_delay(uint32_t rx_delay)
+/* whole keystream is generated by one hal call */
+static void encrypt_payload_batch(struct uwan_ctx *ctx, uint8_t *buf,
+    uint8_t size, void *crypto_ctx, const uint8_t *a_block)
 {
-    uint32_t timeout;
-    timeout = uw_radio->get_tcxo_timeout ? uw_radio->get_tcxo_timeout() : 0;
-    if (rx_delay > timeout)
-        rx_delay -= timeout;
-    return rx_delay;
+    uint8_t keystream[KEYSTREAM_BLOCKS * UWAN_AES_BLOCK_SIZE];
+    uint8_t count = (size + UWAN_AES_BLOCK_SIZE - 1) / UWAN_AES_BLOCK_SIZE;
+
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t *block = keystream + i * UWAN_AES_BLOCK_SIZE;
+        memcpy(block, a_block, UWAN_AES_BLOCK_SIZE);
+        block[BLOCK_LAST_OFFSET] = i + 1;
+    }
+
+    ctx->stack_hal->crypto_aes_encrypt_blocks(crypto_ctx, keystream,
+        keystream, count);
+
+    for (uint8_t i = 0; i < size; i++)
+        buf[i] ^= keystream[i];
 }
 
-static void encrypt_payload(uint8_t *buf, uint8_t size, const uint8_t *key,
-    uint8_t dir)
+static void encrypt_payload(struct uwan_ctx *ctx, uint8_t *buf, uint8_t size,
+    void *crypto_ctx, uint8_t *a_block, uint8_t dir, uint32_t f_cnt)
 {
-    uint8_t a_block[UWAN_AES_BLOCK_SIZE];
     uint8_t s_block[UWAN_AES_BLOCK_SIZE];
     uint8_t a_block_i = 1;
     uint8_t src_pos = 0;
-    uint32_t f_cnt = (dir) ? uw_session.f_cnt_down : uw_session.f_cnt_up;
-
-    // prepare Block Ai
-    uint8_t pos = 0;
-    a_block[pos++] = 0x01;
-    a_block[pos++] = 0x00;
-    a_block[pos++] = 0x00;
-    a_block[pos++] = 0x00;
-    a_block[pos++] = 0x00;
-    a_block[pos++] = dir;
-    a_block[pos++] = uw_session.dev_addr & 0xff;
-    a_block[pos++] = (uw_session.dev_addr >> 8) & 0xff;
-    a_block[pos++] = (uw_session.dev_addr >> 16) & 0xff;
-    a_block[pos++] = (uw_session.dev_addr >> 24) & 0xff;
-    a_block[pos++] = f_cnt & 0xff;
-    a_block[pos++] = (f_cnt >> 8) & 0xff;
-    a_block[pos++] = (f_cnt >> 16) & 0xff;
-    a_block[pos++] = (f_cnt >> 24) & 0xff;
-    a_block[pos++] = 0x00;
-
-    void *ctx = uw_stack_hal->crypto_aes_create_context(key);
+
+    patch_block(a_block, dir, f_cnt);
+
+    if (ctx->stack_hal->crypto_aes_encrypt_blocks) {
+        encrypt_payload_batch(ctx, buf, size, crypto_ctx, a_block);
+        return;
+    }
 
     for (; size > 0; a_block_i++) {
-        a_block[pos] = a_block_i;
+        a_block[BLOCK_LAST_OFFSET] = a_block_i;
 
-        uw_stack_hal->crypto_aes_encrypt(ctx, s_block, a_block);
+        ctx->stack_hal->crypto_aes_encrypt(crypto_ctx, s_block, a_block);
 
         uint8_t chunk_size = size >= UWAN_AES_BLOCK_SIZE ? UWAN_AES_BLOCK_SIZE : size;
         for (uint8_t i = 0; i < chunk_size; i++, src_pos++) {
@@ -183,50 +266,44 @@ static void encrypt_payload(uint8_t *buf, uint8_t size, const uint8_t *key,
         }
         size -= chunk_size;
     }
-
-    uw_stack_hal->crypto_aes_delete_context(ctx);
 }
 
-static void calc_mic(uint8_t *mic, const uint8_t *msg, uint8_t msg_len,
-    const uint8_t *key, uint8_t dir, uint32_t f_cnt, bool b0)
+/* returns false if temporary CMAC context can't be created */
+static bool calc_mic(struct uwan_ctx *ctx, uint8_t *mic, const uint8_t *msg,
+    uint8_t msg_len, void *cmac_ctx, const uint8_t *key, uint8_t dir,
+    uint32_t f_cnt, uint8_t *block_b0)
 {
     uint8_t cmac_mic[UWAN_CMAC_DIGESTLEN];
+    void *crypto_ctx = cmac_ctx;
 
-    void *ctx = uw_stack_hal->crypto_cmac_create_context(key);
+    if (crypto_ctx)
+        ctx->stack_hal->crypto_cmac_reset(crypto_ctx);
+    else
+        crypto_ctx = ctx->stack_hal->crypto_cmac_create_context(key);
 
-    if (b0) {
-        uint8_t block_b0[UWAN_AES_BLOCK_SIZE];
-        uint8_t pos = 0;
+    if (!crypto_ctx)
+        return false;
 
-        block_b0[pos++] = 0x49;
-        block_b0[pos++] = 0x00;
-        block_b0[pos++] = 0x00;
-        block_b0[pos++] = 0x00;
-        block_b0[pos++] = 0x00;
-        block_b0[pos++] = dir;
-        block_b0[pos++] = uw_session.dev_addr & 0xff;
-        block_b0[pos++] = (uw_session.dev_addr >> 8) & 0xff;
-        block_b0[pos++] = (uw_session.dev_addr >> 16) & 0xff;
-        block_b0[pos++] = (uw_session.dev_addr >> 24) & 0xff;
-        block_b0[pos++] = f_cnt & 0xff;
-        block_b0[pos++] = (f_cnt >> 8) & 0xff;
-        block_b0[pos++] = (f_cnt >> 16) & 0xff;
-        block_b0[pos++] = (f_cnt >> 24) & 0xff;
-        block_b0[pos++] = 0x00;
-        block_b0[pos++] = msg_len;
+    if (block_b0) {
+        patch_block(block_b0, dir, f_cnt);
+        block_b0[BLOCK_LAST_OFFSET] = msg_len;
 
-        uw_stack_hal->crypto_cmac_update(ctx, block_b0, sizeof(block_b0));
+        ctx->stack_hal->crypto_cmac_update(crypto_ctx, block_b0,
+            UWAN_AES_BLOCK_SIZE);
     }
 
-    uw_stack_hal->crypto_cmac_update(ctx, msg, msg_len);
-    uw_stack_hal->crypto_cmac_finish(ctx, cmac_mic);
-    uw_stack_hal->crypto_cmac_delete_context(ctx);
+    ctx->stack_hal->crypto_cmac_update(crypto_ctx, msg, msg_len);
+    ctx->stack_hal->crypto_cmac_finish(crypto_ctx, cmac_mic);
+    if (crypto_ctx != cmac_ctx)
+        ctx->stack_hal->crypto_cmac_delete_context(crypto_ctx);
 
     memcpy(mic, cmac_mic, MIC_LEN);
+
+    return true;
 }
 
-static void derive_session_key(uint8_t *key, uint8_t key_type,
-    uint32_t app_nonce, uint32_t net_id)
+static void derive_session_key(struct uwan_ctx *ctx, uint8_t *key,
+    uint8_t key_type, uint32_t app_nonce, uint32_t net_id)
 {
     uint8_t offset = 0;
     key[offset++] = key_type;
@@ -236,17 +313,16 @@ static void derive_session_key(uint8_t *key, uint8_t key_type,
     key[offset++] = net_id & 0xff;
     key[offset++] = (net_id >> 8) & 0xff;
     key[offset++] = (net_id >> 16) & 0xff;
-    key[offset++] = uw_dev_nonce & 0xff;
-    key[offset++] = (uw_dev_nonce >> 8) & 0xff;
+    key[offset++] = ctx->dev_nonce & 0xff;
+    key[offset++] = (ctx->dev_nonce >> 8) & 0xff;
     while (offset < UWAN_AES_BLOCK_SIZE)
         key[offset++] = 0x00;
 
-    void *ctx = uw_stack_hal->crypto_aes_create_context(uw_app_key);
-    uw_stack_hal->crypto_aes_encrypt(ctx, key, key);
-    uw_stack_hal->crypto_aes_delete_context(ctx);
+    ctx->stack_hal->crypto_aes_encrypt(ctx->app_key_aes, key, key);
 }
 
-static enum uwan_errs handle_join_msg(struct uwan_dl_packet *pkt)
+static enum uwan_errs handle_join_msg(struct uwan_ctx *ctx,
+    struct uwan_dl_packet *pkt)
 {
     uint8_t *buf = pkt->data;
     uint8_t mhdr;
@@ -266,25 +342,32 @@ static enum uwan_errs handle_join_msg(struct uwan_dl_packet *pkt)
                  (MAJOR_LORAWAN_R1 << MAJOR_OFFSET)))
         return UWAN_ERR_MSG_MHDR;
 
-    void *ctx = uw_stack_hal->crypto_aes_create_context(uw_app_key);
-    uw_stack_hal->crypto_aes_encrypt(ctx, buf + sizeof(mhdr), buf + sizeof(mhdr));
+    ctx->stack_hal->crypto_aes_encrypt(ctx->app_key_aes, buf + sizeof(mhdr),
+        buf + sizeof(mhdr));
+
+    uint32_t app_nonce, net_id;
+
+    app_nonce = buf[offset++];
+    app_nonce |= buf[offset++] << 8;
+    app_nonce |= buf[offset++] << 16;
+
+    // replayed accept of a previous join is dropped before MIC
+    if (ctx->stack_hal->nvm_store_join_nonces &&
+        app_nonce < ctx->min_join_nonce)
+        return UWAN_ERR_JOIN_NONCE;
+
     if (cflist) {
-        uw_stack_hal->crypto_aes_encrypt(ctx,
+        ctx->stack_hal->crypto_aes_encrypt(ctx->app_key_aes,
             buf + sizeof(mhdr) + UWAN_AES_BLOCK_SIZE,
             buf + sizeof(mhdr) + UWAN_AES_BLOCK_SIZE);
     }
-    uw_stack_hal->crypto_aes_delete_context(ctx);
 
-    calc_mic(mic, buf, pkt->size - sizeof(mic), uw_app_key, 0, 0, false);
+    if (!calc_mic(ctx, mic, buf, pkt->size - sizeof(mic), ctx->app_key_cmac,
+            ctx->app_key, 0, 0, NULL))
+        return UWAN_ERR_CRYPTO;
     if (memcmp(buf + pkt->size - sizeof(mic), mic, sizeof(mic)))
         return UWAN_ERR_MSG_MIC;
 
-    uint32_t app_nonce, net_id;
-
-    app_nonce = buf[offset++];
-    app_nonce |= buf[offset++] << 8;
-    app_nonce |= buf[offset++] << 16;
-
     net_id = buf[offset++];
     net_id |= buf[offset++] << 8;
     net_id |= buf[offset++] << 16;
@@ -299,31 +382,42 @@ static enum uwan_errs handle_join_msg(struct uwan_dl_packet *pkt)
     uint8_t rx1_dr_offset = (dl_settings >> 4) & 7;
     uint8_t rx2_dr = dl_settings & 0xf;
     if (is_valid_dr(rx1_dr_offset))
-        uw_rx1_offset = rx1_dr_offset;
+        ctx->rx1_offset = rx1_dr_offset;
     if (is_valid_dr(rx2_dr))
-        uw_rx2_dr = (enum uwan_dr)rx2_dr;
+        ctx->rx2_dr = (enum uwan_dr)rx2_dr;
 
     // TODO duplicated code, see mac.c rx_timing_setup function
     uint8_t rx1_delay = buf[offset++] & 0xf;
     if (rx1_delay == 0)
         rx1_delay = 1;
-    default_rx1_delay = rx1_delay * 1000;
+    ctx->default_rx1_delay = rx1_delay * 1000;
 
     if (cflist)
-        uw_region->handle_cflist(buf + offset);
+        ctx->region->handle_cflist(ctx, buf + offset);
 
     const uint8_t nwk = 0x01;
     const uint8_t app = 0x02;
     uint8_t nwk_s_key[UWAN_NWK_S_KEY_SIZE];
     uint8_t app_s_key[UWAN_APP_S_KEY_SIZE];
-    derive_session_key(nwk_s_key, nwk, app_nonce, net_id);
-    derive_session_key(app_s_key, app, app_nonce, net_id);
-    uwan_set_session(dev_addr, 0, 0, nwk_s_key, app_s_key);
+    derive_session_key(ctx, nwk_s_key, nwk, app_nonce, net_id);
+    derive_session_key(ctx, app_s_key, app, app_nonce, net_id);
+    enum uwan_errs err = uwan_set_session(ctx, dev_addr, 0, 0, nwk_s_key,
+        app_s_key);
+    if (err != UWAN_ERR_NO)
+        return err;
+
+    if (ctx->stack_hal->nvm_store_join_nonces) {
+        ctx->min_join_nonce = app_nonce + 1;
+        ctx->stack_hal->nvm_store_join_nonces(ctx, ctx->next_dev_nonce,
+            ctx->min_join_nonce);
+    }
 
     return UWAN_ERR_NO;
 }
 
-static enum uwan_errs handle_data_msg(struct uwan_dl_packet *pkt)
+/* class_a is set for downlinks in RX1 and RX2 windows */
+static enum uwan_errs handle_data_msg(struct uwan_ctx *ctx,
+    struct uwan_dl_packet *pkt, bool class_a)
 {
     uint8_t mhdr;
     uint32_t dev_addr;
@@ -333,6 +427,8 @@ static enum uwan_errs handle_data_msg(struct uwan_dl_packet *pkt)
     uint8_t mic[MIC_LEN];
     uint8_t offset = 0;
     uint8_t *buf = pkt->data;
+    struct mc_group *group = NULL;
+    uint8_t group_id = 0;
     uint8_t msg_min_size = sizeof(mhdr) + sizeof(dev_addr) + sizeof(f_ctrl)
         + sizeof(f_cnt) + sizeof(mic);
 
@@ -347,47 +443,61 @@ static enum uwan_errs handle_data_msg(struct uwan_dl_packet *pkt)
     if (mtype != UWAN_MTYPE_UNCONF_DATA_DOWN && mtype != UWAN_MTYPE_CONF_DATA_DOWN)
         return UWAN_ERR_MSG_MHDR;
 
-    if (mtype == UWAN_MTYPE_CONF_DATA_DOWN)
-        uw_session.ack_required = true;
-
     dev_addr = buf[offset++];
     dev_addr |= buf[offset++] << 8;
     dev_addr |= buf[offset++] << 16;
     dev_addr |= buf[offset++] << 24;
 
-    if (uw_session.dev_addr != dev_addr)
-        return UWAN_ERR_DEV_ADDR;
+    // frames of other devices are dropped before any crypto
+    if (ctx->session.dev_addr != dev_addr) {
+        group = multicast_find(ctx, dev_addr, &group_id);
+        if (group == NULL)
+            return UWAN_ERR_DEV_ADDR;
+    }
+
+    if (mtype == UWAN_MTYPE_CONF_DATA_DOWN) {
+        if (group)
+            return UWAN_ERR_MSG_MHDR;
+        ctx->session.ack_required = true;
+    }
 
     f_ctrl = buf[offset++];
     f_opts_len = f_ctrl & FCTRL_FOPTS_MASK;
     if (pkt->size < (msg_min_size + f_opts_len))
         return UWAN_ERR_MSG_LEN;
 
+    if (group && (f_opts_len || (f_ctrl & FCTRL_ACK)))
+        return UWAN_ERR_MSG_FHDR;
+
     f_cnt = buf[offset++];
     f_cnt |= buf[offset++] << 8;
 
+    uint32_t f_cnt_down = group ? group->f_cnt_down : ctx->session.f_cnt_down;
     uint32_t new_f_cnt_down;
-    if (uw_session.f_cnt_down == 0) {
+    if (f_cnt_down == 0) {
         // accept initial value
         new_f_cnt_down = f_cnt;
     }
     else {
-        uint16_t f_cnt_prev = (uint16_t)uw_session.f_cnt_down;
+        uint16_t f_cnt_prev = (uint16_t)f_cnt_down;
         int32_t f_cnt_diff = f_cnt - f_cnt_prev;
 
         if (f_cnt_diff == 0)
             return UWAN_ERR_FCNT;
 
         if (f_cnt_diff > 0)
-            new_f_cnt_down = uw_session.f_cnt_down + f_cnt_diff;
+            new_f_cnt_down = f_cnt_down + f_cnt_diff;
         else {
             // considering counter rollover
-            uint32_t f_cnt_hi = uw_session.f_cnt_down & 0xffff0000;
+            uint32_t f_cnt_hi = f_cnt_down & 0xffff0000;
             new_f_cnt_down = f_cnt_hi + 0x10000 + f_cnt;
         }
     }
 
-    current_snr = pkt->snr;
+    if (group && new_f_cnt_down > group->f_cnt_max)
+        return UWAN_ERR_FCNT;
+
+    ctx->current_snr = pkt->snr;
 
     uint8_t *fopts_buf = buf + offset;
     offset += f_opts_len;
@@ -399,29 +509,62 @@ static enum uwan_errs handle_data_msg(struct uwan_dl_packet *pkt)
         pld = buf + offset;
         pld_size--;
 
-        if (f_opts_len && pkt->f_port == 0)
+        if ((f_opts_len || group) && pkt->f_port == 0)
             return UWAN_ERR_MSG_FHDR;
     }
 
-    calc_mic(mic, buf, pkt->size - sizeof(mic), uw_session.nwk_s_key,
-        B0_DIR_DOWNLINK, new_f_cnt_down, true);
+    if (group) {
+        if (!calc_mic(ctx, mic, buf, pkt->size - sizeof(mic),
+                group->nwk_s_key_cmac, group->nwk_s_key, B0_DIR_DOWNLINK,
+                new_f_cnt_down, group->b0_block))
+            return UWAN_ERR_CRYPTO;
+        if (memcmp(buf + pkt->size - sizeof(mic), mic, sizeof(mic)))
+            return UWAN_ERR_MSG_MIC;
+
+        group->f_cnt_down = new_f_cnt_down;
+        if (pld_size > 0) {
+            encrypt_payload(ctx, pld, pld_size, group->app_s_key_aes,
+                group->a_block, B0_DIR_DOWNLINK, new_f_cnt_down);
+        }
+
+        pkt->multicast = true;
+        pkt->mc_group = group_id;
+        pkt->data = pld;
+        pkt->size = pld_size;
+
+        return UWAN_ERR_NO;
+    }
+
+    if (!calc_mic(ctx, mic, buf, pkt->size - sizeof(mic),
+            ctx->session.nwk_s_key_cmac, ctx->session.nwk_s_key,
+            B0_DIR_DOWNLINK, new_f_cnt_down, ctx->session.b0_block))
+        return UWAN_ERR_CRYPTO;
     if (memcmp(buf + pkt->size - sizeof(mic), mic, sizeof(mic)))
         return UWAN_ERR_MSG_MIC;
 
-    uw_session.f_cnt_down = new_f_cnt_down; // accept new value if mic is ok
+    ctx->session.f_cnt_down = new_f_cnt_down; // accept new value if mic is ok
+
+    if (ctx->ack_pending && (f_ctrl & FCTRL_ACK))
+        pkt->ack = true;
 
     if (pld_size > 0) {
-        const uint8_t *key;
-        key = (pkt->f_port == 0) ? uw_session.nwk_s_key : uw_session.app_s_key;
-        encrypt_payload(pld, pld_size, key, B0_DIR_DOWNLINK);
+        void *aes_ctx;
+        aes_ctx = (pkt->f_port == 0) ? ctx->session.nwk_s_key_aes :
+            ctx->session.app_s_key_aes;
+        encrypt_payload(ctx, pld, pld_size, aes_ctx, ctx->session.a_block,
+            B0_DIR_DOWNLINK, new_f_cnt_down);
     }
 
+    // before new answers are added
+    if (class_a)
+        mac_handle_downlink(ctx);
+
     if (f_opts_len > 0)
-        mac_handle_commands(fopts_buf, f_opts_len);
+        mac_handle_commands(ctx, fopts_buf, f_opts_len);
     else if (pld_size && pkt->f_port == 0)
-        mac_handle_commands(pld, pld_size);
+        mac_handle_commands(ctx, pld, pld_size);
 
-    adr_handle_downlink();
+    adr_handle_downlink(ctx);
 
     pkt->data = pld;
     pkt->size = pld_size;
@@ -429,96 +572,306 @@ static enum uwan_errs handle_data_msg(struct uwan_dl_packet *pkt)
     return UWAN_ERR_NO;
 }
 
-static void handle_downlink(enum uwan_errs err)
+/* class C listens on RX2 parameters while nothing else uses the radio */
+static void start_class_c_rx(struct uwan_ctx *ctx)
+{
+    if (ctx->dev_class != UWAN_CLASS_C || ctx->rxc_on ||
+        ctx->state != UWAN_STATE_IDLE || !ctx->session.is_joined ||
+        ctx->frame_rsv_offset)
+        return;
+
+    const struct node_dr *dr = &uw_dr_table[ctx->rx2_dr];
+    ctx->pkt_params.sf = dr->sf;
+    ctx->pkt_params.bw = dr->bw;
+    ctx->pkt_params.inverted_iq = true;
+    ctx->radio->set_frequency(ctx->rx2_frequency);
+    ctx->radio->setup(&ctx->pkt_params);
+    ctx->radio->rx(FRAME_MAX_SIZE, 0, UWAN_RX_INFINITE);
+    ctx->rxc_on = true;
+}
+
+static void stop_class_c_rx(struct uwan_ctx *ctx)
+{
+    if (!ctx->rxc_on)
+        return;
+
+    ctx->rxc_on = false;
+    ctx->radio->sleep();
+}
+
+/* uplink of frame_len bytes is already placed into frame */
+static void transmit(struct uwan_ctx *ctx, uint32_t frequency,
+    enum uwan_dr dr_id)
+{
+    const struct node_dr *dr = &uw_dr_table[dr_id];
+
+    stop_class_c_rx(ctx);
+    class_b_preempt(ctx);
+
+    ctx->pkt_params.sf = dr->sf;
+    ctx->pkt_params.bw = dr->bw;
+    ctx->pkt_params.inverted_iq = false;
+    ctx->radio->set_frequency(frequency);
+    ctx->radio->setup(&ctx->pkt_params);
+    apply_tx_power(ctx);
+
+    ctx->tx_frequency = frequency;
+    ctx->tx_dr = dr_id;
+    ctx->trans_count++;
+    ctx->state = UWAN_STATE_TX;
+    ctx->radio->tx(ctx->frame, ctx->frame_len);
+    channels_on_tx(ctx, frequency,
+        uwan_time_on_air_params(&ctx->pkt_params, ctx->frame_len));
+}
+
+static uint8_t get_max_pld_size(enum uwan_dr dr)
+{
+    if (dr < sizeof(uw_max_app_pld_size) / sizeof(uw_max_app_pld_size[0]))
+        return uw_max_app_pld_size[dr];
+
+    return 0;
+}
+
+/*
+ * Confirmed uplink steps down one data rate every second transmission, but
+ * not below the data rate which still carries the frame
+ */
+static enum uwan_dr get_retrans_dr(struct uwan_ctx *ctx)
+{
+    enum uwan_dr dr = get_current_dr(ctx);
+    uint8_t step = ctx->ack_pending ? ctx->trans_count / 2 : 0;
+    enum uwan_dr retrans_dr = dr > step ? dr - step : UWAN_DR_0;
+
+    // FOpts reduce the maximum payload by their size
+    while (retrans_dr < dr && ctx->frame_len >
+        get_max_pld_size(retrans_dr) + DATA_HDR_SIZE + MIC_LEN)
+        retrans_dr++;
+
+    return retrans_dr;
+}
+
+/*
+ * Repeat uplink with the same FCnt after backoff or when duty cycle allows,
+ * returns false if repetitions are over
+ */
+static bool retransmit(struct uwan_ctx *ctx, uint32_t backoff)
+{
+    uint32_t frequency = 0;
+
+    if (!ctx->trans_left)
+        return false;
+
+    if (!backoff)
+        frequency = channels_get_next_except(ctx, ctx->tx_frequency);
+
+    if (frequency) {
+        ctx->trans_left--;
+        transmit(ctx, frequency, get_retrans_dr(ctx));
+        return true;
+    }
+
+    uint32_t delay = MAX(backoff, uwan_get_next_tx_delay(ctx));
+    if (!delay) {
+        ctx->trans_left = 0; // there are no channels
+        return false;
+    }
+
+    ctx->state = UWAN_STATE_TX_WAIT;
+    ctx->stack_hal->start_timer(ctx, UWAN_TIMER_TX, delay);
+
+    return true;
+}
+
+static uint32_t get_ack_timeout(struct uwan_ctx *ctx)
+{
+    return ACK_TIMEOUT_MIN +
+        utils_get_random(&ctx->random, ACK_TIMEOUT_SPREAD + 1);
+}
+
+static void finish_uplink(struct uwan_ctx *ctx, enum uwan_errs err,
+    enum uwan_mtypes mtype, const struct uwan_dl_packet *pkt)
+{
+    enum uwan_errs result = UWAN_ERR_NO;
+
+    if (ctx->ack_pending && !pkt->ack)
+        result = UWAN_ERR_NO_ACK;
+
+    ctx->ack_pending = false;
+    ctx->trans_left = 0;
+    ctx->is_join_state = false;
+    ctx->stack_hal->downlink_callback(ctx, err, mtype, pkt);
+
+    queue_on_rx_done(ctx, result);
+    start_class_c_rx(ctx);
+}
+
+/* read and check frame received in RX1 or RX2 */
+static enum uwan_errs receive_downlink(struct uwan_ctx *ctx,
+    struct uwan_dl_packet *pkt, uint8_t evt_mask)
+{
+    if (evt_mask & RADIO_IRQF_CRC_ERROR)
+        return UWAN_ERR_RX_CRC;
+
+    pkt->data = ctx->dl_frame;
+    pkt->size = sizeof(ctx->dl_frame);
+    ctx->radio->read_packet(pkt);
+
+    if (ctx->is_join_state)
+        return handle_join_msg(ctx, pkt);
+
+    return handle_data_msg(ctx, pkt, true);
+}
+
+static void handle_downlink(struct uwan_ctx *ctx, enum uwan_errs err,
+    const struct uwan_dl_packet *pkt)
 {
-    struct uwan_dl_packet pkt = {0};
     enum uwan_mtypes mtype = UWAN_MTYPE_JOIN_REQUEST;
 
-    if (err == UWAN_ERR_NO) {
-        pkt.data = uw_frame;
-        pkt.size = sizeof(uw_frame);
-        uw_radio->read_packet(&pkt);
+    ctx->radio->sleep();
+
+    // only a valid downlink for the device stops repetitions
+    if (err != UWAN_ERR_NO &&
+        retransmit(ctx, ctx->ack_pending ? get_ack_timeout(ctx) : 0))
+        return;
+
+    if (pkt->data) {
+        mtype = (enum uwan_mtypes)((ctx->dl_frame[0] >> MTYPE_OFFSET) &
+            MTYPE_MASK);
     }
 
-    uw_radio->sleep();
+    if (ctx->is_join_state) {
+        if (err != UWAN_ERR_NO && join_retry(ctx))
+            return;
+        ctx->join.attempts_left = 0;
+    }
 
-    if (err == UWAN_ERR_NO) {
-        mtype = (enum uwan_mtypes)((uw_frame[0] >> MTYPE_OFFSET) & MTYPE_MASK);
-        if (uw_is_join_state)
-            err = handle_join_msg(&pkt);
-        else
-            err = handle_data_msg(&pkt);
+    finish_uplink(ctx, err, mtype, pkt);
+}
+
+static uint32_t sub_elapsed(uint32_t timeout, uint32_t elapsed)
+{
+    return timeout > elapsed ? timeout - elapsed : 0;
+}
+
+/* class C reception or class B ping slot */
+static void handle_idle_rx_event(struct uwan_ctx *ctx, uint8_t evt_mask)
+{
+    if ((evt_mask & RADIO_IRQF_RX_DONE) &&
+        !(evt_mask & RADIO_IRQF_CRC_ERROR)) {
+        struct uwan_dl_packet pkt = {
+            .data = ctx->dl_frame,
+            .size = sizeof(ctx->dl_frame),
+        };
+
+        ctx->radio->read_packet(&pkt);
+        enum uwan_mtypes mtype = (enum uwan_mtypes)((ctx->dl_frame[0] >>
+            MTYPE_OFFSET) & MTYPE_MASK);
+
+        // frames of other devices and noise aren't reported
+        if (handle_data_msg(ctx, &pkt, false) == UWAN_ERR_NO)
+            ctx->stack_hal->downlink_callback(ctx, UWAN_ERR_NO, mtype, &pkt);
     }
 
-    uw_is_join_state = false;
-    uw_stack_hal->downlink_callback(err, mtype, &pkt);
+    // callback may have started an uplink
+    if (ctx->class_b.rx == CLASS_B_RX_PING) {
+        class_b_on_ping_end(ctx);
+    }
+    else if (ctx->rxc_on) {
+        ctx->rxc_on = false;
+        start_class_c_rx(ctx);
+    }
 }
 
-static void evt_handler(uint8_t evt_mask)
+/* elapsed is time in ms since the radio raised the event */
+static void handle_radio_event(struct uwan_ctx *ctx, uint8_t evt_mask,
+    uint32_t elapsed)
 {
-    if (uw_state <= UWAN_STATE_IDLE)
+    struct uwan_dl_packet pkt = {0};
+    enum uwan_errs err = UWAN_ERR_RX_TIMEOUT;
+
+    if (ctx->class_b.rx == CLASS_B_RX_BEACON) {
+        class_b_on_beacon(ctx, evt_mask, elapsed);
+        return;
+    }
+
+    if (ctx->rxc_on || ctx->class_b.rx == CLASS_B_RX_PING) {
+        handle_idle_rx_event(ctx, evt_mask);
         return;
+    }
 
-    switch (uw_state) {
+    if (ctx->state <= UWAN_STATE_IDLE)
+        return;
+
+    switch (ctx->state) {
     case UWAN_STATE_TX:
         if (evt_mask & RADIO_IRQF_TX_DONE) {
-            uw_state = UWAN_STATE_RX1;
-            uw_stack_hal->start_timer(UWAN_TIMER_RX1,
-                adjust_rx_delay(uw_rx1_delay));
-            uw_stack_hal->start_timer(UWAN_TIMER_RX2,
-                adjust_rx_delay(uw_rx2_delay));
-
-            if (uw_rx1_offset) {
-                enum uwan_dr dr_id = get_current_dr();
-                if (uw_rx1_offset > dr_id)
-                    dr_id = UWAN_DR_0;
-                else
-                    dr_id -= uw_rx1_offset;
+            enum uwan_dr dr_id = ctx->tx_dr;
+            if (ctx->rx1_offset > dr_id)
+                dr_id = UWAN_DR_0;
+            else
+                dr_id -= ctx->rx1_offset;
+
+            uint32_t rx1_timeout = sub_elapsed(calc_rx_window(ctx, dr_id,
+                ctx->rx1_delay, &ctx->rx1_symb_timeout), elapsed);
+            uint32_t rx2_timeout = sub_elapsed(calc_rx_window(ctx,
+                ctx->rx2_dr, ctx->rx2_delay, &ctx->rx2_symb_timeout), elapsed);
+
+            if (ctx->rx1_offset) {
                 const struct node_dr *dr = &uw_dr_table[dr_id];
-                pkt_params.sf = dr->sf;
-                pkt_params.bw = dr->bw;
+                ctx->pkt_params.sf = dr->sf;
+                ctx->pkt_params.bw = dr->bw;
             }
 
-            pkt_params.inverted_iq = true;
-            uw_radio->setup(&pkt_params);
+            uint32_t rx1_frequency = channels_get_rx1_frequency(ctx,
+                ctx->tx_frequency);
+            if (rx1_frequency != ctx->tx_frequency)
+                ctx->radio->set_frequency(rx1_frequency);
+
+            ctx->pkt_params.inverted_iq = true;
+            ctx->radio->setup(&ctx->pkt_params);
+
+            // timer interrupt opens the window once the radio is set up
+            UTILS_STORE_RELEASE(&ctx->state, UWAN_STATE_RX1);
+            ctx->stack_hal->start_timer(ctx, UWAN_TIMER_RX1, rx1_timeout);
+            ctx->stack_hal->start_timer(ctx, UWAN_TIMER_RX2, rx2_timeout);
 
             // notify MAC that TX completed
-            mac_on_tx_complete();
+            mac_on_tx_complete(ctx);
         }
         break;
 
     case UWAN_STATE_RX1:
-        if (evt_mask & RADIO_IRQF_RX_TIMEOUT) {
-            // prepare radio for RX2
-            uw_state = UWAN_STATE_RX2;
-            const struct node_dr *dr = &uw_dr_table[uw_rx2_dr];
-            pkt_params.sf = dr->sf;
-            pkt_params.bw = dr->bw;
-            pkt_params.inverted_iq = true;
-            uw_radio->set_frequency(uw_rx2_frequency);
-            uw_radio->setup(&pkt_params);
+        if (evt_mask & RADIO_IRQF_RX_DONE)
+            err = receive_downlink(ctx, &pkt, evt_mask);
+
+        if (err == UWAN_ERR_NO) {
+            ctx->stack_hal->stop_timer(ctx, UWAN_TIMER_RX2);
+            ctx->state = UWAN_STATE_IDLE;
+            handle_downlink(ctx, err, &pkt);
         }
-        else if (evt_mask & RADIO_IRQF_RX_DONE) {
-            uw_stack_hal->stop_timer(UWAN_TIMER_RX2);
-            uw_state = UWAN_STATE_IDLE;
-            if (evt_mask & RADIO_IRQF_CRC_ERROR)
-                handle_downlink(UWAN_ERR_RX_CRC);
-            else
-                handle_downlink(UWAN_ERR_NO);
+        else if (evt_mask & (RADIO_IRQF_RX_TIMEOUT | RADIO_IRQF_RX_DONE)) {
+            // RX2 is skipped only after valid downlink for the device
+            ctx->rx1_err = err;
+            const struct node_dr *dr = &uw_dr_table[ctx->rx2_dr];
+            ctx->pkt_params.sf = dr->sf;
+            ctx->pkt_params.bw = dr->bw;
+            ctx->pkt_params.inverted_iq = true;
+            ctx->radio->set_frequency(ctx->rx2_frequency);
+            ctx->radio->setup(&ctx->pkt_params);
+            // RX2 timer that fired earlier is queued and opens it then
+            UTILS_STORE_RELEASE(&ctx->state, UWAN_STATE_RX2);
         }
         break;
 
     case UWAN_STATE_RX2:
-        if (evt_mask & RADIO_IRQF_RX_TIMEOUT) {
-            uw_state = UWAN_STATE_IDLE;
-            handle_downlink(UWAN_ERR_RX_TIMEOUT);
-        }
-        else if (evt_mask & RADIO_IRQF_RX_DONE) {
-            uw_state = UWAN_STATE_IDLE;
-            if (evt_mask & RADIO_IRQF_CRC_ERROR)
-                handle_downlink(UWAN_ERR_RX_CRC);
-            else
-                handle_downlink(UWAN_ERR_NO);
+        if (evt_mask & RADIO_IRQF_RX_DONE)
+            err = receive_downlink(ctx, &pkt, evt_mask);
+        else
+            err = ctx->rx1_err;
+
+        if (evt_mask & (RADIO_IRQF_RX_TIMEOUT | RADIO_IRQF_RX_DONE)) {
+            ctx->state = UWAN_STATE_IDLE;
+            handle_downlink(ctx, err, &pkt);
         }
         break;
 
@@ -527,245 +880,675 @@ static void evt_handler(uint8_t evt_mask)
     }
 }
 
-void uwan_init(const struct radio_dev *radio, const struct stack_hal *stack,
-    const struct uwan_region *region)
+/*
+ * Called from the timer interrupt. The state of a window is published after
+ * the radio has been set up for it and doesn't change until the radio
+ * reports the window end.
+ */
+static bool open_rx_window(struct uwan_ctx *ctx,
+    enum uwan_timer_ids timer_id)
 {
-    uw_state = UWAN_STATE_IDLE;
-    uw_radio = radio;
-    uw_stack_hal = stack;
-    uw_region = region;
+    enum stack_states state = UTILS_LOAD_ACQUIRE(&ctx->state);
+
+    if (state == UWAN_STATE_RX1 && timer_id == UWAN_TIMER_RX1)
+        ctx->radio->rx(FRAME_MAX_SIZE, ctx->rx1_symb_timeout, 0);
+    else if (state == UWAN_STATE_RX2 && timer_id == UWAN_TIMER_RX2)
+        ctx->radio->rx(FRAME_MAX_SIZE, ctx->rx2_symb_timeout, 0);
+    else
+        return false;
+
+    return true;
+}
+
+static void handle_timer(struct uwan_ctx *ctx, enum uwan_timer_ids timer_id)
+{
+    // RX2 timer might come before the end of RX1 has been handled
+    if (open_rx_window(ctx, timer_id))
+        return;
+
+    if (timer_id == UWAN_TIMER_TX && ctx->state == UWAN_STATE_TX_WAIT) {
+        struct uwan_dl_packet pkt = {0};
+
+        ctx->state = UWAN_STATE_IDLE;
+        if (!retransmit(ctx, 0))
+            finish_uplink(ctx, UWAN_ERR_RX_TIMEOUT, UWAN_MTYPE_JOIN_REQUEST,
+                &pkt);
+    }
+    else if (timer_id == UWAN_TIMER_TX && ctx->state == UWAN_STATE_JOIN_WAIT) {
+        struct uwan_dl_packet pkt = {0};
+        enum uwan_errs err = join_on_timer(ctx);
+
+        if (err != UWAN_ERR_NO)
+            finish_uplink(ctx, err, UWAN_MTYPE_JOIN_REQUEST, &pkt);
+    }
+    else if (timer_id == UWAN_TIMER_TX || timer_id == UWAN_TIMER_QUEUE) {
+        queue_process(ctx);
+    }
+    else {
+        class_b_on_timer(ctx, timer_id);
+    }
+}
 
-    memset(&uw_session, 0, sizeof(uw_session));
+/* an event of each timer and a radio event are queued at most */
+typedef char event_ring_size_check[
+    UWAN_EVENT_RING_SIZE >= UWAN_TIMER_QUEUE + 2 ? 1 : -1];
 
-    radio->set_evt_handler(evt_handler);
+/* producer side, called from radio and timer interrupts */
+static void post_event(struct uwan_ctx *ctx, enum event_types type,
+    uint8_t data)
+{
+    const struct stack_hal *hal = ctx->stack_hal;
+    struct event evt = {
+        .type = type,
+        .data = data,
+        .time = hal->get_time_ms ? hal->get_time_ms(ctx) : 0,
+    };
+    uint8_t prev;
+
+    /*
+     * Class C reception and re-armed timers raise events faster than a
+     * late uwan_process takes them. They are merged into the one already
+     * queued, so the ring never drops the end of TX or RX.
+     */
+    if (type == EVENT_RADIO) {
+        prev = UTILS_FETCH_OR(&ctx->radio_pending, data);
+        evt.data = 0;
+    }
+    else {
+        prev = UTILS_FETCH_OR(&ctx->timers_pending, 1 << data) & (1 << data);
+    }
 
-    mac_init();
-    channels_init();
-    uw_region->init();
-    utils_random_init(radio->rand());
+    if (prev == 0)
+        event_push(&ctx->events, &evt);
 
-    pkt_params.cr = UWAN_CR_4_5;
-    pkt_params.preamble_len = 8;
-    pkt_params.crc_on = true;
-    pkt_params.implicit_header = false;
+    if (!ctx->deferred)
+        uwan_process(ctx);
+    else if (hal->event_callback)
+        hal->event_callback(ctx);
 }
 
-void uwan_set_otaa_keys(const uint8_t *dev_eui, const uint8_t *app_eui,
-    const uint8_t *app_key)
+static void evt_handler(void *arg, uint8_t evt_mask)
 {
-    memcpy(uw_dev_eui, dev_eui, UWAN_DEV_EUI_SIZE);
-    memcpy(uw_app_eui, app_eui, UWAN_APP_EUI_SIZE);
-    memcpy(uw_app_key, app_key, UWAN_APP_KEY_SIZE);
+    post_event(arg, EVENT_RADIO, evt_mask);
 }
 
-void uwan_set_session(uint32_t dev_addr, uint32_t f_cnt_up, uint32_t f_cnt_down,
-    const uint8_t *nwk_s_key, const uint8_t *app_s_key)
+struct uwan_ctx *uwan_init(const struct radio_dev *radio,
+    const struct stack_hal *stack, const struct uwan_region *region)
 {
-    uw_session.dev_addr = dev_addr;
-    uw_session.f_cnt_up = f_cnt_up;
-    uw_session.f_cnt_down = f_cnt_down;
-    uw_session.ack_required = false;
-    uw_session.dr = default_dr;
+    struct uwan_ctx *ctx = NULL;
 
-    memcpy(uw_session.nwk_s_key, nwk_s_key, UWAN_NWK_S_KEY_SIZE);
-    memcpy(uw_session.app_s_key, app_s_key, UWAN_APP_S_KEY_SIZE);
+    for (int i = 0; i < UWAN_MAX_CONTEXTS; i++) {
+        if (UTILS_CLAIM(&uw_ctx_pool[i].in_use)) {
+            ctx = &uw_ctx_pool[i];
+            break;
+        }
+    }
 
-    uw_session.is_joined = true;
+    if (ctx == NULL)
+        return NULL;
+
+    // in_use goes first and stays set, other threads skip the instance
+    memset(&ctx->user_data, 0,
+        sizeof(*ctx) - offsetof(struct uwan_ctx, user_data));
+    event_ring_init(&ctx->events);
+    ctx->state = UWAN_STATE_IDLE;
+    ctx->radio = radio;
+    ctx->stack_hal = stack;
+    ctx->region = region;
+
+    ctx->default_join_delay = JOIN_DELAY;
+    ctx->default_rx1_delay = RX1_DELAY;
+    ctx->default_dr = UWAN_DR_0;
+    ctx->default_nb_trans = ctx->nb_trans = NB_TRANS_MIN;
+    ctx->confirm_retries = CONFIRM_RETRIES;
+    ctx->default_max_eirp = DEFAULT_MAX_EIRP;
+
+    radio->set_evt_handler(evt_handler, ctx);
+
+    mac_init(ctx);
+    adr_init(ctx);
+    channels_init(ctx);
+    queue_init(ctx);
+    join_init(ctx);
+    class_b_init(ctx);
+    multicast_init(ctx);
+    ctx->region->init(ctx);
+    utils_random_init(&ctx->random, radio->rand());
+
+    ctx->pkt_params.cr = UWAN_CR_4_5;
+    ctx->pkt_params.preamble_len = PREAMBLE_LEN;
+    ctx->pkt_params.crc_on = true;
+    ctx->pkt_params.implicit_header = false;
+
+    return ctx;
 }
 
-bool uwan_is_joined()
+void uwan_deinit(struct uwan_ctx *ctx)
 {
-    return uw_session.is_joined;
+    replace_aes_context(ctx, &ctx->app_key_aes, NULL);
+    replace_cmac_context(ctx, &ctx->app_key_cmac, NULL);
+    replace_aes_context(ctx, &ctx->session.nwk_s_key_aes, NULL);
+    replace_cmac_context(ctx, &ctx->session.nwk_s_key_cmac, NULL);
+    replace_aes_context(ctx, &ctx->session.app_s_key_aes, NULL);
+    multicast_deinit(ctx);
+
+    stop_class_c_rx(ctx);
+    class_b_stop(ctx);
+    ctx->state = UWAN_STATE_NOT_INIT;
+    UTILS_RELEASE(&ctx->in_use);
 }
 
-enum uwan_errs uwan_join()
+void uwan_set_user_data(struct uwan_ctx *ctx, void *user_data)
 {
-    uint8_t offset = 0;
+    ctx->user_data = user_data;
+}
 
-    if (uw_state != UWAN_STATE_IDLE)
-        return UWAN_ERR_STATE;
+void *uwan_get_user_data(struct uwan_ctx *ctx)
+{
+    return ctx->user_data;
+}
 
-    uint32_t frequency = channels_get_next();
-    if (!frequency)
-        return UWAN_ERR_CHANNEL;
+enum uwan_errs uwan_set_otaa_keys(struct uwan_ctx *ctx,
+    const uint8_t *dev_eui, const uint8_t *app_eui, const uint8_t *app_key)
+{
+    memcpy(ctx->dev_eui, dev_eui, UWAN_DEV_EUI_SIZE);
+    memcpy(ctx->app_eui, app_eui, UWAN_APP_EUI_SIZE);
+    memcpy(ctx->app_key, app_key, UWAN_APP_KEY_SIZE);
+
+    // both calls run, each releases the old context
+    bool ok = replace_aes_context(ctx, &ctx->app_key_aes, ctx->app_key);
+    ok = replace_cmac_context(ctx, &ctx->app_key_cmac, ctx->app_key) && ok;
+    if (!ok) {
+        replace_aes_context(ctx, &ctx->app_key_aes, NULL);
+        replace_cmac_context(ctx, &ctx->app_key_cmac, NULL);
+        return UWAN_ERR_CRYPTO;
+    }
 
-    const struct node_dr *dr = &uw_dr_table[default_dr];
+    return UWAN_ERR_NO;
+}
+
+void uwan_set_join_nonces(struct uwan_ctx *ctx, uint32_t dev_nonce,
+    uint32_t join_nonce)
+{
+    ctx->next_dev_nonce = dev_nonce;
+    ctx->min_join_nonce = join_nonce;
+}
+
+enum uwan_errs uwan_set_session(struct uwan_ctx *ctx, uint32_t dev_addr,
+    uint32_t f_cnt_up, uint32_t f_cnt_down, const uint8_t *nwk_s_key,
+    const uint8_t *app_s_key)
+{
+    ctx->session.is_joined = false;
+    ctx->session.dev_addr = dev_addr;
+    ctx->session.f_cnt_up = f_cnt_up;
+    ctx->session.f_cnt_down = f_cnt_down;
+    ctx->session.f_cnt_reserved = f_cnt_up;
+    ctx->session.ack_required = false;
+    ctx->session.dr = ctx->default_dr;
+    init_blocks(ctx->session.a_block, ctx->session.b0_block, dev_addr);
+
+    memcpy(ctx->session.nwk_s_key, nwk_s_key, UWAN_NWK_S_KEY_SIZE);
+    memcpy(ctx->session.app_s_key, app_s_key, UWAN_APP_S_KEY_SIZE);
+
+    // all calls run, each releases the context of the previous session
+    bool ok = replace_aes_context(ctx, &ctx->session.nwk_s_key_aes,
+        ctx->session.nwk_s_key);
+    ok = replace_cmac_context(ctx, &ctx->session.nwk_s_key_cmac,
+        ctx->session.nwk_s_key) && ok;
+    ok = replace_aes_context(ctx, &ctx->session.app_s_key_aes,
+        ctx->session.app_s_key) && ok;
+    if (!ok) {
+        replace_aes_context(ctx, &ctx->session.nwk_s_key_aes, NULL);
+        replace_cmac_context(ctx, &ctx->session.nwk_s_key_cmac, NULL);
+        replace_aes_context(ctx, &ctx->session.app_s_key_aes, NULL);
+        return UWAN_ERR_CRYPTO;
+    }
 
-    pkt_params.sf = dr->sf;
-    pkt_params.bw = dr->bw;
-    pkt_params.inverted_iq = false;
-    uw_radio->set_frequency(frequency);
-    uw_radio->setup(&pkt_params);
-    apply_tx_power();
+    ctx->session.is_joined = true;
 
-    uw_session.is_joined = false;
-    uw_is_join_state = true;
-    uw_frame[offset++] = (UWAN_MTYPE_JOIN_REQUEST << MTYPE_OFFSET) | MAJOR_LORAWAN_R1;
+    return UWAN_ERR_NO;
+}
 
-    memcpy(&uw_frame[offset], uw_app_eui, UWAN_APP_EUI_SIZE);
+bool uwan_is_joined(struct uwan_ctx *ctx)
+{
+    return ctx->session.is_joined;
+}
+
+enum uwan_errs send_join_request(struct uwan_ctx *ctx, enum uwan_dr dr)
+{
+    uint8_t offset = 0;
+
+    if (join_get_backoff(ctx))
+        return UWAN_ERR_DUTY_CYCLE;
+
+    // the next attempt goes over another channel
+    uint32_t frequency = channels_get_next_except(ctx, ctx->tx_frequency);
+    if (!frequency)
+        return get_channel_err(ctx);
+
+    if (ctx->stack_hal->nvm_store_join_nonces) {
+        // DevNonce must never repeat, it's stored before it goes on air
+        if (ctx->next_dev_nonce > DEV_NONCE_MAX)
+            return UWAN_ERR_DEV_NONCE;
+        if (!ctx->stack_hal->nvm_store_join_nonces(ctx,
+                ctx->next_dev_nonce + 1, ctx->min_join_nonce))
+            return UWAN_ERR_NVM;
+        ctx->dev_nonce = ctx->next_dev_nonce++;
+    }
+    else
+        ctx->dev_nonce = utils_get_random(&ctx->random, 65536);
+
+    ctx->session.is_joined = false;
+    ctx->is_join_state = true;
+    ctx->frame_rsv_offset = 0;
+    ctx->trans_left = 0;
+    ctx->trans_count = 0;
+    ctx->ack_pending = false;
+    ctx->frame[offset++] = (UWAN_MTYPE_JOIN_REQUEST << MTYPE_OFFSET) |
+        MAJOR_LORAWAN_R1;
+
+    memcpy(&ctx->frame[offset], ctx->app_eui, UWAN_APP_EUI_SIZE);
     offset += UWAN_APP_EUI_SIZE;
     for (uint8_t i = UWAN_DEV_EUI_SIZE; i > 0; i--)
-        uw_frame[offset++] = uw_dev_eui[i - 1];
+        ctx->frame[offset++] = ctx->dev_eui[i - 1];
 
-    uw_dev_nonce = utils_get_random(65536);
-    uw_frame[offset++] = uw_dev_nonce & 0xff;
-    uw_frame[offset++] = (uw_dev_nonce >> 8) & 0xff;
+    ctx->frame[offset++] = ctx->dev_nonce & 0xff;
+    ctx->frame[offset++] = (ctx->dev_nonce >> 8) & 0xff;
 
-    calc_mic(&uw_frame[offset], uw_frame, offset, uw_app_key, B0_DIR_UPLINK, 0,
-        false);
+    if (!calc_mic(ctx, &ctx->frame[offset], ctx->frame, offset,
+            ctx->app_key_cmac, ctx->app_key, B0_DIR_UPLINK, 0, NULL))
+        return UWAN_ERR_CRYPTO;
     offset += MIC_LEN;
 
-    uw_rx1_delay = default_join_delay;
-    uw_rx2_delay = default_join_delay + SECOND_RX_OFFSET;
-    uw_state = UWAN_STATE_TX;
-    uw_radio->tx(uw_frame, offset);
+    ctx->rx1_delay = ctx->default_join_delay;
+    ctx->rx2_delay = ctx->default_join_delay + SECOND_RX_OFFSET;
+    ctx->frame_len = offset;
+    transmit(ctx, frequency, dr);
+    join_on_tx(ctx, uwan_time_on_air_params(&ctx->pkt_params, offset));
 
     return UWAN_ERR_NO;
 }
 
-uint8_t uwan_get_max_payload_size()
+enum uwan_errs uwan_join(struct uwan_ctx *ctx)
 {
-    uint8_t max_pld_size = 0;
-    enum uwan_dr dr = get_current_dr();
+    if (ctx->state != UWAN_STATE_IDLE || !ctx->app_key_aes)
+        return UWAN_ERR_STATE;
 
-    if (dr < sizeof(uw_max_app_pld_size) / sizeof(uw_max_app_pld_size[0]))
-        max_pld_size = uw_max_app_pld_size[dr];
+    return send_join_request(ctx, ctx->default_dr);
+}
 
-    if (max_pld_size >= mac_get_payload_size())
-        max_pld_size -= mac_get_payload_size();
-    else
-        max_pld_size = 0;
+uint8_t get_max_frm_payload_size(struct uwan_ctx *ctx)
+{
+    return get_max_pld_size(get_current_dr(ctx));
+}
+
+/* MAC answers that don't fit FOpts are sent alone on FPort 0 */
+static uint8_t get_f_opts_len(struct uwan_ctx *ctx)
+{
+    uint8_t mac_size = mac_get_payload_size(ctx);
 
-    return max_pld_size;
+    return mac_size > MAC_FOPTS_SIZE ? 0 : mac_size;
 }
 
-enum uwan_errs uwan_send_frame(uint8_t f_port, const uint8_t *payload,
-    uint8_t pld_len, bool confirm)
+uint8_t uwan_get_max_payload_size(struct uwan_ctx *ctx)
 {
-    uint8_t offset = 0;
+    uint8_t max_pld_size = get_max_frm_payload_size(ctx);
+    uint8_t mac_size = mac_get_payload_size(ctx);
 
-    if (uw_state != UWAN_STATE_IDLE)
-        return UWAN_ERR_STATE;
+    // FPort 0 uplink with MAC answers goes first
+    if (mac_size > MAC_FOPTS_SIZE || max_pld_size < mac_size)
+        return 0;
 
-    uint32_t frequency = channels_get_next();
-    if (!frequency)
-        return UWAN_ERR_CHANNEL;
+    return max_pld_size - mac_size;
+}
 
-    if (pld_len > uwan_get_max_payload_size())
+static uint8_t get_pld_offset(struct uwan_ctx *ctx)
+{
+    return DATA_HDR_SIZE + get_f_opts_len(ctx);
+}
+
+static enum uwan_errs check_uplink(struct uwan_ctx *ctx, uint16_t pld_len)
+{
+    if (ctx->state != UWAN_STATE_IDLE || !ctx->session.is_joined)
+        return UWAN_ERR_STATE;
+
+    if (pld_len > uwan_get_max_payload_size(ctx))
         return UWAN_ERR_MSG_LEN;
 
-    uint8_t mac_pld_size = mac_get_payload_size();
-    if (!pld_len && !mac_pld_size)
+    if (!pld_len && !mac_get_payload_size(ctx))
         return UWAN_ERR_MSG_LEN;
 
-    const struct node_dr *dr = &uw_dr_table[get_current_dr()];
-    pkt_params.sf = dr->sf;
-    pkt_params.bw = dr->bw;
-    pkt_params.inverted_iq = false;
-    uw_radio->set_frequency(frequency);
-    uw_radio->setup(&pkt_params);
-    apply_tx_power();
+    return UWAN_ERR_NO;
+}
+
+/* plain payload is already placed into frame at pld_offset */
+static enum uwan_errs send_frame(struct uwan_ctx *ctx, uint8_t f_port,
+    uint8_t pld_offset, uint8_t pld_len, bool confirm)
+{
+    uint8_t offset = 0;
+
+    ctx->frame_rsv_offset = 0;
+
+    uint32_t frequency = channels_get_next(ctx);
+    if (!frequency)
+        return get_channel_err(ctx);
+
+    // store counter ahead, one NVM write per UWAN_F_CNT_RESERVE uplinks
+    const struct stack_hal *hal = ctx->stack_hal;
+    if (hal->nvm_reserve_f_cnt &&
+        ctx->session.f_cnt_up >= ctx->session.f_cnt_reserved) {
+        uint32_t f_cnt_reserved = ctx->session.f_cnt_up + UWAN_F_CNT_RESERVE;
+        if (!hal->nvm_reserve_f_cnt(ctx, f_cnt_reserved))
+            return UWAN_ERR_NVM;
+        ctx->session.f_cnt_reserved = f_cnt_reserved;
+    }
+
+    // FOpts might have grown since the payload was placed
+    if (pld_len && pld_offset != get_pld_offset(ctx)) {
+        memmove(&ctx->frame[get_pld_offset(ctx)], &ctx->frame[pld_offset],
+            pld_len);
+    }
 
     uint8_t mtype;
     if (confirm)
         mtype = UWAN_MTYPE_CONF_DATA_UP;
     else
-        mtype = UWAN_MTYPE_UNCONF_DATA_UP; // TODO take into account nbTrans
+        mtype = UWAN_MTYPE_UNCONF_DATA_UP;
 
-    uw_frame[offset++] = (mtype << MTYPE_OFFSET) | MAJOR_LORAWAN_R1;
-    uw_frame[offset++] = uw_session.dev_addr & 0xff;
-    uw_frame[offset++] = (uw_session.dev_addr >> 8) & 0xff;
-    uw_frame[offset++] = (uw_session.dev_addr >> 16) & 0xff;
-    uw_frame[offset++] = (uw_session.dev_addr >> 24) & 0xff;
+    ctx->frame[offset++] = (mtype << MTYPE_OFFSET) | MAJOR_LORAWAN_R1;
+    ctx->frame[offset++] = ctx->session.dev_addr & 0xff;
+    ctx->frame[offset++] = (ctx->session.dev_addr >> 8) & 0xff;
+    ctx->frame[offset++] = (ctx->session.dev_addr >> 16) & 0xff;
+    ctx->frame[offset++] = (ctx->session.dev_addr >> 24) & 0xff;
 
     uint8_t f_ctrl = 0;
-    if (uwan_adr_is_enabled())
+    if (uwan_adr_is_enabled(ctx))
         f_ctrl |= FCTRL_ADR;
-    if (adr_get_req_bit())
+    if (adr_get_req_bit(ctx))
         f_ctrl |= FCTRL_UPLINK_ADR_ACK_REQ;
-    if (uw_session.ack_required) {
-        uw_session.ack_required = false;
+    if (ctx->session.ack_required) {
+        ctx->session.ack_required = false;
         f_ctrl |= FCTRL_ACK;
     }
-    f_ctrl |= mac_get_payload_size() & FCTRL_FOPTS_MASK;
-    uw_frame[offset++] = f_ctrl;
-    uw_frame[offset++] = uw_session.f_cnt_up & 0xff;
-    uw_frame[offset++] = (uw_session.f_cnt_up >> 8) & 0xff;
-    offset += mac_get_payload(uw_frame + offset, 15);
-
-    if (pld_len) {
-        uw_frame[offset++] = f_port; // optional
-        memcpy(&uw_frame[offset], payload, pld_len);
+    if (ctx->dev_class == UWAN_CLASS_B && ctx->class_b.locked)
+        f_ctrl |= FCTRL_UPLINK_CLASSB;
+    uint8_t f_opts_len = get_f_opts_len(ctx);
+    f_ctrl |= f_opts_len & FCTRL_FOPTS_MASK;
+    ctx->frame[offset++] = f_ctrl;
+    ctx->frame[offset++] = ctx->session.f_cnt_up & 0xff;
+    ctx->frame[offset++] = (ctx->session.f_cnt_up >> 8) & 0xff;
+    offset += mac_get_payload(ctx, ctx->frame + offset, f_opts_len);
+
+    if (!f_opts_len && mac_get_payload_size(ctx)) {
+        // check_uplink leaves no room for application payload here
+        ctx->frame[offset++] = 0;
+        pld_len = mac_get_payload(ctx, &ctx->frame[offset], MAC_BUF_SIZE);
+        encrypt_payload(ctx, &ctx->frame[offset], pld_len,
+            ctx->session.nwk_s_key_aes, ctx->session.a_block, B0_DIR_UPLINK,
+            ctx->session.f_cnt_up);
+        offset += pld_len;
+    }
+    else if (pld_len) {
+        ctx->frame[offset++] = f_port; // optional
         // Encrypt FRMPayload before MIC calculation
-        encrypt_payload(&uw_frame[offset], pld_len, uw_session.app_s_key,
-            B0_DIR_UPLINK);
+        encrypt_payload(ctx, &ctx->frame[offset], pld_len,
+            ctx->session.app_s_key_aes, ctx->session.a_block, B0_DIR_UPLINK,
+            ctx->session.f_cnt_up);
         offset += pld_len;
     }
 
-    calc_mic(&uw_frame[offset], uw_frame, offset, uw_session.nwk_s_key,
-        B0_DIR_UPLINK, uw_session.f_cnt_up, true);
+    if (!calc_mic(ctx, &ctx->frame[offset], ctx->frame, offset,
+            ctx->session.nwk_s_key_cmac, ctx->session.nwk_s_key,
+            B0_DIR_UPLINK, ctx->session.f_cnt_up, ctx->session.b0_block))
+        return UWAN_ERR_CRYPTO;
     offset += MIC_LEN;
 
-    uw_session.f_cnt_up++;
+    ctx->session.f_cnt_up++;
 
-    uw_rx1_delay = default_rx1_delay;
-    uw_rx2_delay = default_rx1_delay + SECOND_RX_OFFSET;
-    uw_state = UWAN_STATE_TX;
-    uw_radio->tx(uw_frame, offset);
+    ctx->rx1_delay = ctx->default_rx1_delay;
+    ctx->rx2_delay = ctx->default_rx1_delay + SECOND_RX_OFFSET;
+    ctx->frame_len = offset;
+    ctx->trans_count = 0;
+    ctx->ack_pending = confirm;
+    ctx->trans_left = confirm ? ctx->confirm_retries : ctx->nb_trans - 1;
+    transmit(ctx, frequency, get_current_dr(ctx));
 
-    adr_handle_uplink();
+    adr_handle_uplink(ctx);
 
     return UWAN_ERR_NO;
 }
 
-void uwan_timer_callback(enum uwan_timer_ids timer_id)
+enum uwan_errs uwan_send_frame(struct uwan_ctx *ctx, uint8_t f_port,
+    const uint8_t *payload, uint8_t pld_len, bool confirm)
+{
+    enum uwan_errs err = check_uplink(ctx, pld_len);
+    if (err != UWAN_ERR_NO)
+        return err;
+
+    uint8_t pld_offset = get_pld_offset(ctx);
+    if (pld_len)
+        memcpy(&ctx->frame[pld_offset], payload, pld_len);
+
+    return send_frame(ctx, f_port, pld_offset, pld_len, confirm);
+}
+
+enum uwan_errs uwan_send_frame_iov(struct uwan_ctx *ctx, uint8_t f_port,
+    const struct uwan_iovec *iov, uint8_t iov_cnt, bool confirm)
+{
+    uint16_t pld_len = 0;
+
+    for (uint8_t i = 0; i < iov_cnt; i++)
+        pld_len += iov[i].len;
+
+    enum uwan_errs err = check_uplink(ctx, pld_len);
+    if (err != UWAN_ERR_NO)
+        return err;
+
+    uint8_t pld_offset = get_pld_offset(ctx);
+    uint8_t pos = pld_offset;
+    for (uint8_t i = 0; i < iov_cnt; i++) {
+        memcpy(&ctx->frame[pos], iov[i].base, iov[i].len);
+        pos += iov[i].len;
+    }
+
+    return send_frame(ctx, f_port, pld_offset, pld_len, confirm);
+}
+
+uint8_t *uwan_frame_reserve(struct uwan_ctx *ctx, uint8_t pld_len)
+{
+    if (check_uplink(ctx, pld_len) != UWAN_ERR_NO)
+        return NULL;
+
+    // downlink callback might send another frame over the reserved one
+    stop_class_c_rx(ctx);
+    if (ctx->class_b.rx == CLASS_B_RX_PING)
+        class_b_on_ping_end(ctx);
+    ctx->frame_rsv_offset = get_pld_offset(ctx);
+    ctx->frame_rsv_len = pld_len;
+
+    return &ctx->frame[ctx->frame_rsv_offset];
+}
+
+enum uwan_errs uwan_frame_commit(struct uwan_ctx *ctx, uint8_t f_port,
+    uint8_t pld_len, bool confirm)
+{
+    if (!ctx->frame_rsv_offset)
+        return UWAN_ERR_STATE;
+
+    if (pld_len > ctx->frame_rsv_len)
+        return UWAN_ERR_MSG_LEN;
+
+    enum uwan_errs err = check_uplink(ctx, pld_len);
+    if (err != UWAN_ERR_NO)
+        return err;
+
+    return send_frame(ctx, f_port, ctx->frame_rsv_offset, pld_len, confirm);
+}
+
+bool uwan_set_class(struct uwan_ctx *ctx, enum uwan_class dev_class)
 {
-    if (uw_state == UWAN_STATE_RX1 && timer_id == UWAN_TIMER_RX1) {
-        uw_radio->rx(FRAME_MAX_SIZE, RX_SYMB_TIMEOUT, 0);
+    if (dev_class > UWAN_CLASS_C)
+        return false;
+
+    // ping slot offset depends on DevAddr
+    if (dev_class == UWAN_CLASS_B && (!ctx->stack_hal->get_time_ms ||
+            !ctx->session.is_joined))
+        return false;
+
+    stop_class_c_rx(ctx);
+    if (ctx->dev_class == UWAN_CLASS_B)
+        class_b_stop(ctx);
+
+    ctx->dev_class = dev_class;
+    if (dev_class == UWAN_CLASS_B && !class_b_start(ctx)) {
+        ctx->dev_class = UWAN_CLASS_A;
+        return false;
     }
-    else if (uw_state == UWAN_STATE_RX2 && timer_id == UWAN_TIMER_RX2) {
-        uw_radio->rx(FRAME_MAX_SIZE, RX_SYMB_TIMEOUT, 0);
+    else if (dev_class == UWAN_CLASS_C) {
+        start_class_c_rx(ctx);
     }
+
+    return true;
 }
 
-void uwan_get_f_cnt(uint32_t *f_cnt_up, uint32_t *f_cnt_down)
+void uwan_set_deferred(struct uwan_ctx *ctx, bool enable)
 {
-    *f_cnt_up = uw_session.f_cnt_up;
-    *f_cnt_down = uw_session.f_cnt_down;
+    ctx->deferred = enable;
+
+    if (!enable)
+        uwan_process(ctx);
 }
 
-void uwan_set_dr(enum uwan_dr dr)
+void uwan_process(struct uwan_ctx *ctx)
+{
+    const struct stack_hal *hal = ctx->stack_hal;
+    struct event evt;
+
+    /*
+     * Interrupts might process events while uwan_set_deferred(ctx, false)
+     * drains the ring, one of them consumes. Events pushed before the
+     * release are picked up by the check of the loop.
+     */
+    do {
+        if (!UTILS_CLAIM(&ctx->processing))
+            return;
+
+        while (event_pop(&ctx->events, &evt)) {
+            uint32_t elapsed = 0;
+
+            if (hal->get_time_ms)
+                elapsed = hal->get_time_ms(ctx) - evt.time;
+
+            // flags and timers raised meanwhile are taken with the event
+            if (evt.type == EVENT_RADIO) {
+                uint8_t evt_mask = UTILS_FETCH_AND(&ctx->radio_pending, 0);
+                handle_radio_event(ctx, evt_mask, elapsed);
+            }
+            else {
+                UTILS_FETCH_AND(&ctx->timers_pending, ~(1 << evt.data));
+                handle_timer(ctx, (enum uwan_timer_ids)evt.data);
+            }
+        }
+
+        UTILS_RELEASE(&ctx->processing);
+    } while (event_pending(&ctx->events));
+}
+
+uint32_t uwan_time_on_air(enum uwan_dr dr, uint8_t len)
+{
+    if (!is_valid_dr(dr))
+        return 0;
+
+    struct uwan_packet_params params = {
+        .sf = uw_dr_table[dr].sf,
+        .bw = uw_dr_table[dr].bw,
+        .cr = UWAN_CR_4_5,
+        .preamble_len = PREAMBLE_LEN,
+        .crc_on = true,
+        .implicit_header = false,
+    };
+
+    return uwan_time_on_air_params(&params, len);
+}
+
+uint32_t uwan_time_on_air_params(const struct uwan_packet_params *params,
+    uint8_t len)
+{
+    // see SX1276 datasheet, ch. 4.1.1.7
+    int32_t sf = params->sf - UWAN_SF_6 + 6;
+    int32_t de = (params->sf >= UWAN_SF_11) ? 1 : 0; // as radio drivers do
+    int32_t num = 8 * len - 4 * sf + 28 + (params->crc_on ? 16 : 0) -
+        (params->implicit_header ? 20 : 0);
+    int32_t den = 4 * (sf - 2 * de);
+    uint32_t symbols = params->preamble_len + 8;
+
+    if (num > 0)
+        symbols += (num + den - 1) / den * (params->cr - UWAN_CR_4_5 + 5);
+
+    // preamble takes 4.25 symbols more, symbol time is a multiple of 4 us
+    uint32_t t_sym = UWAN_SYMBOL_TIME_US(params->sf, params->bw);
+    return symbols * t_sym + 17 * (t_sym / 4);
+}
+
+void uwan_timer_callback(struct uwan_ctx *ctx, enum uwan_timer_ids timer_id)
+{
+    // latency of uwan_process would shift the window past the downlink
+    if (open_rx_window(ctx, timer_id))
+        return;
+
+    post_event(ctx, EVENT_TIMER, timer_id);
+}
+
+void uwan_get_f_cnt(struct uwan_ctx *ctx, uint32_t *f_cnt_up,
+    uint32_t *f_cnt_down)
+{
+    *f_cnt_up = ctx->session.f_cnt_up;
+    *f_cnt_down = ctx->session.f_cnt_down;
+}
+
+void uwan_set_dr(struct uwan_ctx *ctx, enum uwan_dr dr)
 {
     if (is_valid_dr(dr))
-        default_dr = uw_session.dr = dr;
+        ctx->default_dr = ctx->session.dr = dr;
 }
 
-bool uwan_set_nb_trans(uint8_t nb_trans)
+bool uwan_set_nb_trans(struct uwan_ctx *ctx, uint8_t nb_trans)
 {
-    if (set_nb_trans(nb_trans)) {
-        default_nb_trans = nb_trans;
+    if (set_nb_trans(ctx, nb_trans)) {
+        ctx->default_nb_trans = nb_trans;
         return true;
     }
 
     return false;
 }
 
-void uwan_set_max_eirp(int8_t max_eirp)
+bool uwan_set_confirm_retries(struct uwan_ctx *ctx, uint8_t retries)
 {
-    default_max_eirp = max_eirp;
+    if (retries > CONFIRM_RETRIES_MAX)
+        return false;
+
+    ctx->confirm_retries = retries;
+
+    return true;
 }
 
-bool uwan_set_tx_power(uint8_t tx_power)
+void uwan_set_max_eirp(struct uwan_ctx *ctx, int8_t max_eirp)
 {
-    if (set_tx_power(tx_power)) {
-        default_tx_power = tx_power;
+    ctx->default_max_eirp = max_eirp;
+}
+
+bool uwan_set_tx_power(struct uwan_ctx *ctx, uint8_t tx_power)
+{
+    if (set_tx_power(ctx, tx_power)) {
+        ctx->default_tx_power = tx_power;
         return true;
     }
 
     return false;
 }
 
-enum uwan_errs uwan_set_rx2(uint32_t frequency, enum uwan_dr dr)
+enum uwan_errs uwan_set_rx2(struct uwan_ctx *ctx, uint32_t frequency,
+    enum uwan_dr dr)
 {
     if (!is_valid_dr(dr))
         return UWAN_ERR_DATARATE;
@@ -773,26 +1556,33 @@ enum uwan_errs uwan_set_rx2(uint32_t frequency, enum uwan_dr dr)
     if (!is_valid_frequency(frequency))
         return UWAN_ERR_FREQUENCY;
 
-    uw_rx2_frequency = frequency;
-    uw_rx2_dr = dr;
+    ctx->rx2_frequency = frequency;
+    ctx->rx2_dr = dr;
 
     return UWAN_ERR_NO;
 }
 
-bool uwan_set_rx1_dr_offset(uint8_t rx1_dr_offset)
+bool uwan_set_rx1_dr_offset(struct uwan_ctx *ctx, uint8_t rx1_dr_offset)
 {
     if (is_valid_dr(rx1_dr_offset)) {
-        uw_rx1_offset = rx1_dr_offset;
+        ctx->rx1_offset = rx1_dr_offset;
         return true;
     }
 
     return false;
 }
 
-bool uwan_set_rx1_delay(uint8_t delay)
+void uwan_set_rx_timing(struct uwan_ctx *ctx, uint16_t clock_error_ppm,
+    uint32_t wakeup_time)
+{
+    ctx->clock_error_ppm = clock_error_ppm;
+    ctx->wakeup_time = wakeup_time;
+}
+
+bool uwan_set_rx1_delay(struct uwan_ctx *ctx, uint8_t delay)
 {
     if (delay >= 1 && delay <= 15) {
-        default_rx1_delay = delay * 1000;
+        ctx->default_rx1_delay = delay * 1000;
         return true;
     }
 
@@ -809,19 +1599,19 @@ bool is_valid_frequency(uint32_t freq)
     return (freq >= FREQ_MIN && freq <= FREQ_MAX);
 }
 
-bool set_nb_trans(uint8_t nb_trans)
+bool set_nb_trans(struct uwan_ctx *ctx, uint8_t nb_trans)
 {
     if (nb_trans >= NB_TRANS_MIN && nb_trans <= NB_TRANS_MAX) {
-        uw_nb_trans = nb_trans;
+        ctx->nb_trans = nb_trans;
         return true;
     }
 
     return false;
 }
 
-void reset_nb_trans()
+void reset_nb_trans(struct uwan_ctx *ctx)
 {
-    uw_nb_trans = default_nb_trans;
+    ctx->nb_trans = ctx->default_nb_trans;
 }
 
 bool is_valid_tx_power(uint8_t tx_power)
@@ -830,17 +1620,17 @@ bool is_valid_tx_power(uint8_t tx_power)
     return (tx_power < count);
 }
 
-bool set_tx_power(uint8_t tx_power)
+bool set_tx_power(struct uwan_ctx *ctx, uint8_t tx_power)
 {
     if (is_valid_tx_power(tx_power)) {
-        uw_tx_power = tx_power;
+        ctx->tx_power = tx_power;
         return true;
     }
 
     return false;
 }
 
-int8_t get_snr()
+int8_t get_snr(struct uwan_ctx *ctx)
 {
-    return current_snr;
+    return ctx->current_snr;
 }
@@ -26,10 +26,40 @@
 #define __STACK_H__
 
 #include <uwan/stack.h>
+#include "adr.h"
+#include "channels.h"
+#include "class_b.h"
+#include "event.h"
+#include "join.h"
+#include "mac.h"
+#include "multicast.h"
+#include "queue.h"
+
+#ifndef UWAN_MAX_CONTEXTS
+#define UWAN_MAX_CONTEXTS 1
+#endif
 
 #define NB_TRANS_MIN 1
 #define NB_TRANS_MAX 15
+#define CONFIRM_RETRIES_MAX 15
+
+#ifndef UWAN_F_CNT_RESERVE
+#define UWAN_F_CNT_RESERVE 64 // uplinks per NVM write
+#endif
 #define TX_POWER_MAX 15
+#define DEV_NONCE_MAX 0xffff
+
+#define FRAME_MAX_SIZE 255
+
+enum stack_states {
+    UWAN_STATE_NOT_INIT,
+    UWAN_STATE_IDLE,
+    UWAN_STATE_TX,
+    UWAN_STATE_RX1,
+    UWAN_STATE_RX2,
+    UWAN_STATE_TX_WAIT, // repetition waits for duty cycle
+    UWAN_STATE_JOIN_WAIT, // next join-request waits for backoff
+};
 
 struct node_session {
     bool is_joined;
@@ -38,19 +68,99 @@ struct node_session {
     uint32_t dev_addr;
     uint32_t f_cnt_up;
     uint32_t f_cnt_down;
+    uint32_t f_cnt_reserved; // uplinks below it might have been sent
     uint8_t nwk_s_key[UWAN_NWK_S_KEY_SIZE];
     uint8_t app_s_key[UWAN_APP_S_KEY_SIZE];
+    void *nwk_s_key_aes;
+    void *nwk_s_key_cmac; // NULL if hal can't reset CMAC context
+    void *app_s_key_aes;
+    uint8_t a_block[UWAN_AES_BLOCK_SIZE]; // DevAddr is filled in once
+    uint8_t b0_block[UWAN_AES_BLOCK_SIZE];
 };
 
-extern const struct uwan_region *uw_region;
-extern struct node_session uw_session;
+struct uwan_ctx {
+    bool in_use; // must be the first field, see uwan_init
+    void *user_data;
+    const struct radio_dev *radio;
+    const struct stack_hal *stack_hal;
+    const struct uwan_region *region;
+    struct uwan_packet_params pkt_params;
+    uint8_t frame[FRAME_MAX_SIZE];
+    uint8_t frame_len; // size of uplink kept in frame for repetitions
+    uint8_t dl_frame[FRAME_MAX_SIZE]; // received downlink
+    enum uwan_errs rx1_err; // reported if nothing valid comes in RX2
+    uint8_t frame_rsv_offset; // 0 if there is no reservation
+    uint8_t frame_rsv_len;
+    enum stack_states state;
+    uint32_t random;
+    bool deferred;
+    bool processing; // uwan_process is consuming events
+    enum uwan_class dev_class;
+    bool rxc_on; // class C reception is running
+    struct event_ring events; // radio and timer events for uwan_process
+    uint8_t radio_pending; // IRQ flags merged into the queued radio event
+    uint8_t timers_pending; // bits of timers with a queued event
+
+    /* OTAA */
+    bool is_join_state;
+    uint32_t dev_nonce;
+    uint32_t next_dev_nonce; // used with nvm_store_join_nonces
+    uint32_t min_join_nonce;
+    uint8_t dev_eui[UWAN_DEV_EUI_SIZE];
+    uint8_t app_eui[UWAN_APP_EUI_SIZE];
+    uint8_t app_key[UWAN_APP_KEY_SIZE];
+    void *app_key_aes;
+    void *app_key_cmac; // NULL if hal can't reset CMAC context
+
+    /* RX windows settings */
+    uint32_t rx1_delay;
+    uint8_t rx1_offset;
+    uint32_t rx2_delay;
+    uint32_t rx2_frequency;
+    enum uwan_dr rx2_dr;
+    uint16_t rx1_symb_timeout;
+    uint16_t rx2_symb_timeout;
+    uint16_t clock_error_ppm;
+    uint32_t wakeup_time; // us
+
+    uint32_t default_join_delay;
+    uint32_t default_rx1_delay;
+    enum uwan_dr default_dr;
+    uint8_t default_nb_trans;
+    uint8_t nb_trans;
+    uint8_t trans_left; // repetitions of current uplink
+    uint8_t trans_count; // transmissions of current uplink
+    bool ack_pending; // confirmed uplink waits for ACK
+    uint8_t confirm_retries;
+    uint32_t tx_frequency;
+    enum uwan_dr tx_dr;
+    uint8_t default_tx_power;
+    uint8_t tx_power;
+    int8_t default_max_eirp;
+    int8_t current_snr;
+
+    struct node_session session;
+    struct mac_state mac;
+    struct adr_state adr;
+    struct channels_state channels;
+    struct queue_state queue;
+    struct join_state join;
+    struct class_b_state class_b;
+    struct multicast_state multicast;
+};
 
 bool is_valid_dr(uint8_t dr);
 bool is_valid_frequency(uint32_t freq);
-bool set_nb_trans(uint8_t nb_trans);
-void reset_nb_trans(void);
+bool set_nb_trans(struct uwan_ctx *ctx, uint8_t nb_trans);
+void reset_nb_trans(struct uwan_ctx *ctx);
 bool is_valid_tx_power(uint8_t tx_power);
-bool set_tx_power(uint8_t tx_power);
-int8_t get_snr(void);
+bool set_tx_power(struct uwan_ctx *ctx, uint8_t tx_power);
+int8_t get_snr(struct uwan_ctx *ctx);
+enum uwan_errs send_join_request(struct uwan_ctx *ctx, enum uwan_dr dr);
+void init_blocks(uint8_t *a_block, uint8_t *b0_block, uint32_t dev_addr);
+uint8_t get_max_frm_payload_size(struct uwan_ctx *ctx);
+void set_dr_params(struct uwan_packet_params *params, enum uwan_dr dr);
+uint32_t calc_rx_window(struct uwan_ctx *ctx, enum uwan_dr dr,
+    uint32_t rx_delay, uint16_t *symb_timeout);
 
 #endif
@@ -22,20 +22,26 @@
  * SOFTWARE.
  */
 
-#include <stdlib.h>
 #include "utils.h"
 
 #define UNIX_GPS_EPOCH_OFFSET 315964800
 #define UNIX_LEAP_SECONDS 18
+#define RANDOM_DEFAULT_SEED 0x2545f491
 
-void utils_random_init(uint32_t seed)
+void utils_random_init(uint32_t *state, uint32_t seed)
 {
-    srand(seed);
+    *state = seed ? seed : RANDOM_DEFAULT_SEED;
 }
 
-uint32_t utils_get_random(uint32_t max)
+uint32_t utils_get_random(uint32_t *state, uint32_t max)
 {
-    return rand() % max;
+    // xorshift32, keeps generator state per stack instance unlike rand()
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x % max;
 }
 
 uint32_t utils_unix_to_gps(uint32_t timestamp)
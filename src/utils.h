@@ -25,6 +25,7 @@
 #ifndef __UTILS_H__
 #define __UTILS_H__
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -40,8 +41,34 @@
 
 #define MAX(x, y) ((x) < (y) ? (y) : (x))
 
-void utils_random_init(uint32_t seed);
-uint32_t utils_get_random(uint32_t max);
+/* Pool slot flags and stack state shared by threads and interrupts. GCC and
+ * Clang builtins, define them for other compilers.
+ */
+#ifndef UTILS_CLAIM
+#define UTILS_CLAIM(flag) \
+    (!__atomic_exchange_n((flag), true, __ATOMIC_ACQUIRE))
+#endif
+#ifndef UTILS_RELEASE
+#define UTILS_RELEASE(flag) __atomic_store_n((flag), false, __ATOMIC_RELEASE)
+#endif
+#ifndef UTILS_STORE_RELEASE
+#define UTILS_STORE_RELEASE(ptr, val) \
+    __atomic_store_n((ptr), (val), __ATOMIC_RELEASE)
+#endif
+#ifndef UTILS_LOAD_ACQUIRE
+#define UTILS_LOAD_ACQUIRE(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#endif
+#ifndef UTILS_FETCH_OR
+#define UTILS_FETCH_OR(ptr, val) \
+    __atomic_fetch_or((ptr), (val), __ATOMIC_ACQ_REL)
+#endif
+#ifndef UTILS_FETCH_AND
+#define UTILS_FETCH_AND(ptr, val) \
+    __atomic_fetch_and((ptr), (val), __ATOMIC_ACQ_REL)
+#endif
+
+void utils_random_init(uint32_t *state, uint32_t seed);
+uint32_t utils_get_random(uint32_t *state, uint32_t max);
 uint32_t utils_unix_to_gps(uint32_t timestamp);
 uint32_t utils_gps_to_unix(uint32_t timestamp);
 
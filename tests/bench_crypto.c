@@ -0,0 +1,115 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <time.h>
+#include <uwan/crypto.h>
+
+#define BENCH_BYTES (64 * 1024 * 1024)
+#define CMAC_MSG_SIZE 64
+
+static const char *impl_names[] = {
+    [UWAN_AES_IMPL_TABLE] = "table",
+    [UWAN_AES_IMPL_AESNI] = "aes-ni",
+    [UWAN_AES_IMPL_ARMV8] = "armv8-ce",
+};
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_aes(void)
+{
+    struct uwan_aes_ctx aes;
+    uint8_t key[UWAN_AES_BLOCK_SIZE] = {0};
+    uint8_t block[UWAN_AES_BLOCK_SIZE] = {0};
+
+    uwan_aes_init(&aes, key);
+
+    double start = now();
+    for (long i = 0; i < BENCH_BYTES / UWAN_AES_BLOCK_SIZE; i++)
+        uwan_aes_encrypt(&aes, block, block);
+    double elapsed = now() - start;
+
+    printf("  aes:        %8.1f MB/s (%02x)\n", BENCH_BYTES / elapsed / 1e6,
+        block[0]);
+}
+
+static void bench_aes_blocks(void)
+{
+    struct uwan_aes_ctx aes;
+    uint8_t key[UWAN_AES_BLOCK_SIZE] = {0};
+    static uint8_t frame[256];
+
+    uwan_aes_init(&aes, key);
+
+    double start = now();
+    for (size_t i = 0; i < BENCH_BYTES / sizeof(frame); i++)
+        uwan_aes_encrypt_blocks(&aes, frame, frame,
+            sizeof(frame) / UWAN_AES_BLOCK_SIZE);
+    double elapsed = now() - start;
+
+    printf("  aes blocks: %8.1f MB/s (%02x)\n",
+        BENCH_BYTES / elapsed / 1e6, frame[0]);
+}
+
+static void bench_cmac(void)
+{
+    struct uwan_cmac_ctx cmac;
+    uint8_t key[UWAN_AES_BLOCK_SIZE] = {0};
+    uint8_t msg[CMAC_MSG_SIZE] = {0};
+
+    uwan_cmac_init(&cmac, key);
+
+    double start = now();
+    for (long i = 0; i < BENCH_BYTES / CMAC_MSG_SIZE; i++) {
+        uwan_cmac_update(&cmac, msg, sizeof(msg));
+        uwan_cmac_finish(&cmac, msg);
+    }
+    double elapsed = now() - start;
+
+    printf("  cmac:       %8.1f MB/s, %.0f MICs/s (%d byte frames)\n",
+        BENCH_BYTES / elapsed / 1e6,
+        BENCH_BYTES / CMAC_MSG_SIZE / elapsed, CMAC_MSG_SIZE);
+}
+
+int main()
+{
+    for (int impl = UWAN_AES_IMPL_TABLE; impl <= UWAN_AES_IMPL_ARMV8; impl++) {
+        if (!uwan_aes_select_impl(impl))
+            continue;
+
+        printf("%s\n", impl_names[impl]);
+        bench_aes();
+        bench_aes_blocks();
+        bench_cmac();
+    }
+
+    return 0;
+}
@@ -2,16 +2,21 @@
 #include <stdlib.h>
 
 #include <uwan/stack.h>
+#include <uwan/region/eu868.h>
 #include "channels.h"
+#include "stack.h"
 #include "utils.h"
 
 uint32_t random_val;
+uint32_t time_ms;
 
-void utils_random_init(uint32_t seed)
+static struct uwan_ctx ctx;
+
+void utils_random_init(uint32_t *state, uint32_t seed)
 {
 }
 
-uint32_t utils_get_random(uint32_t max)
+uint32_t utils_get_random(uint32_t *state, uint32_t max)
 {
     return random_val;
 }
@@ -21,33 +26,108 @@ uint32_t utils_gps_to_unix(uint32_t timestamp)
     return timestamp;
 }
 
+static uint32_t get_time_ms(struct uwan_ctx *ctx)
+{
+    return time_ms;
+}
+
+static const struct stack_hal hal = {
+    .get_time_ms = get_time_ms,
+};
+
+void test_duty_cycle()
+{
+    channels_init(&ctx);
+    ctx.region = &region_eu868;
+    ctx.stack_hal = &hal;
+
+    assert(uwan_set_channel(&ctx, 0, 868100000) == UWAN_ERR_NO); // g1 1%
+    assert(uwan_set_channel(&ctx, 1, 868300000) == UWAN_ERR_NO); // g1 1%
+    assert(uwan_set_channel(&ctx, 2, 869525000) == UWAN_ERR_NO); // g3 10%
+
+    time_ms = 1000;
+    random_val = 0;
+    assert(channels_get_next(&ctx) == 868100000);
+    channels_on_tx(&ctx, 868100000, 49500);
+    assert(uwan_get_next_tx_delay(&ctx) == 0);
+
+    // whole g1 is off for 5 s
+    assert(channels_get_next(&ctx) == 869525000);
+    channels_on_tx(&ctx, 869525000, 50000);
+    assert(channels_get_next(&ctx) == 0);
+    assert(uwan_get_next_tx_delay(&ctx) == 500);
+
+    time_ms = 1500;
+    assert(uwan_get_next_tx_delay(&ctx) == 0);
+    assert(channels_get_next(&ctx) == 869525000);
+
+    // aggregated duty cycle 1/16
+    channels_set_max_dcycle(&ctx, 4);
+    channels_on_tx(&ctx, 869525000, 10000);
+    time_ms = 1600;
+    assert(channels_get_next(&ctx) == 0);
+    assert(uwan_get_next_tx_delay(&ctx) == 60);
+    time_ms = 1660;
+    assert(channels_get_next(&ctx) == 869525000);
+    channels_set_max_dcycle(&ctx, 0);
+
+    // time-off across timer overflow
+    time_ms = 0xfffffff0;
+    channels_on_tx(&ctx, 869525000, 10000);
+    time_ms = 0x10;
+    assert(uwan_enable_channel(&ctx, 0, false) == UWAN_ERR_NO);
+    assert(uwan_enable_channel(&ctx, 1, false) == UWAN_ERR_NO);
+    assert(uwan_get_next_tx_delay(&ctx) == 68);
+    time_ms = 0x54;
+    assert(uwan_get_next_tx_delay(&ctx) == 0);
+
+    // channel between g1 and g2 gets 0.1%
+    assert(uwan_enable_channel(&ctx, 2, false) == UWAN_ERR_NO);
+    assert(uwan_set_channel(&ctx, 3, 868650000) == UWAN_ERR_NO);
+    random_val = 3;
+    assert(channels_get_next(&ctx) == 868650000);
+    channels_on_tx(&ctx, 868650000, 10000);
+    assert(channels_get_next(&ctx) == 0);
+    assert(uwan_get_next_tx_delay(&ctx) == 10000);
+}
+
 int main()
 {
     uint32_t ch;
     enum uwan_errs result;
 
-    channels_init();
+    channels_init(&ctx);
 
     random_val = 5;
-    ch = channels_get_next();
+    ch = channels_get_next(&ctx);
     assert(ch == 0);
 
-    result = uwan_set_channel(3, 869100000);
+    result = uwan_set_channel(&ctx, 3, 869100000);
     assert(result == UWAN_ERR_NO);
 
-    result = uwan_set_channel(7, 868800000);
+    result = uwan_set_channel(&ctx, 7, 868800000);
     assert(result == UWAN_ERR_NO);
 
     random_val = 5;
-    ch = channels_get_next();
+    ch = channels_get_next(&ctx);
     assert(ch == 868800000);
 
     random_val = 8;
-    ch = channels_get_next();
+    ch = channels_get_next(&ctx);
     assert(ch == 869100000);
 
-    result = uwan_set_channel(16, 868800000);
+    result = uwan_set_channel(&ctx, 16, 868800000);
     assert(result == UWAN_ERR_CHANNEL);
 
+    // RX1 follows uplink frequency until DlChannelReq
+    assert(uwan_set_dl_channel(&ctx, 4, 869525000) == UWAN_ERR_CHANNEL);
+    assert(uwan_set_dl_channel(&ctx, 3, 869525000) == UWAN_ERR_NO);
+    assert(channels_get_rx1_frequency(&ctx, 869100000) == 869525000);
+    assert(channels_get_rx1_frequency(&ctx, 868800000) == 868800000);
+    assert(uwan_set_channel(&ctx, 3, 869100000) == UWAN_ERR_NO);
+    assert(channels_get_rx1_frequency(&ctx, 869100000) == 869100000);
+
+    test_duty_cycle();
+
     return 0;
 }
@@ -0,0 +1,222 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2026 Alexey Ryabov
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <uwan/crypto.h>
+
+static const enum uwan_aes_impl impls[] = {
+    UWAN_AES_IMPL_TABLE,
+    UWAN_AES_IMPL_AESNI,
+    UWAN_AES_IMPL_ARMV8,
+};
+
+/* RFC 4493 key, also used in FIPS-197 Appendix B */
+static const uint8_t key[] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+    0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c,
+};
+
+static const uint8_t msg[] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96,
+    0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c,
+    0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11,
+    0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17,
+    0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10,
+};
+
+static const struct {
+    size_t len;
+    uint8_t mac[UWAN_CMAC_DIGESTLEN];
+} cmac_vectors[] = {
+    {0, {
+        0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28,
+        0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46,
+    }},
+    {16, {
+        0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44,
+        0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c,
+    }},
+    {40, {
+        0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30,
+        0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27,
+    }},
+    {64, {
+        0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92,
+        0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe,
+    }},
+};
+
+void test_aes_fips197()
+{
+    struct uwan_aes_ctx aes;
+    uint8_t buf[UWAN_AES_BLOCK_SIZE];
+    const uint8_t key_c1[] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    };
+    const uint8_t plain_c1[] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+    };
+    const uint8_t cipher_c1[] = {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a,
+    };
+    const uint8_t plain_b[] = {
+        0x32, 0x43, 0xf6, 0xa8, 0x88, 0x5a, 0x30, 0x8d,
+        0x31, 0x31, 0x98, 0xa2, 0xe0, 0x37, 0x07, 0x34,
+    };
+    const uint8_t cipher_b[] = {
+        0x39, 0x25, 0x84, 0x1d, 0x02, 0xdc, 0x09, 0xfb,
+        0xdc, 0x11, 0x85, 0x97, 0x19, 0x6a, 0x0b, 0x32,
+    };
+
+    uwan_aes_init(&aes, key_c1);
+    uwan_aes_encrypt(&aes, buf, plain_c1);
+    assert(memcmp(buf, cipher_c1, sizeof(buf)) == 0);
+
+    // in place
+    uwan_aes_init(&aes, key);
+    memcpy(buf, plain_b, sizeof(buf));
+    uwan_aes_encrypt(&aes, buf, buf);
+    assert(memcmp(buf, cipher_b, sizeof(buf)) == 0);
+}
+
+void test_aes_blocks()
+{
+    struct uwan_aes_ctx aes;
+    uint8_t plain[7 * UWAN_AES_BLOCK_SIZE];
+    uint8_t cipher[sizeof(plain)];
+    uint8_t block[UWAN_AES_BLOCK_SIZE];
+
+    for (size_t i = 0; i < sizeof(plain); i++)
+        plain[i] = i * 37;
+
+    uwan_aes_init(&aes, key);
+    uwan_aes_encrypt_blocks(&aes, cipher, plain, 7);
+
+    for (int i = 0; i < 7; i++) {
+        uwan_aes_encrypt(&aes, block, plain + i * UWAN_AES_BLOCK_SIZE);
+        assert(memcmp(block, cipher + i * UWAN_AES_BLOCK_SIZE,
+            sizeof(block)) == 0);
+    }
+
+    // in place
+    uwan_aes_encrypt_blocks(&aes, plain, plain, 7);
+    assert(memcmp(plain, cipher, sizeof(cipher)) == 0);
+}
+
+void test_cmac_rfc4493()
+{
+    struct uwan_cmac_ctx cmac;
+    uint8_t digest[UWAN_CMAC_DIGESTLEN];
+    const uint8_t k1[] = {
+        0xfb, 0xee, 0xd6, 0x18, 0x35, 0x71, 0x33, 0x66,
+        0x7c, 0x85, 0xe0, 0x8f, 0x72, 0x36, 0xa8, 0xde,
+    };
+    const uint8_t k2[] = {
+        0xf7, 0xdd, 0xac, 0x30, 0x6a, 0xe2, 0x66, 0xcc,
+        0xf9, 0x0b, 0xc1, 0x1e, 0xe4, 0x6d, 0x51, 0x3b,
+    };
+
+    uwan_cmac_init(&cmac, key);
+    assert(memcmp(cmac.k1, k1, sizeof(k1)) == 0);
+    assert(memcmp(cmac.k2, k2, sizeof(k2)) == 0);
+
+    size_t count = sizeof(cmac_vectors) / sizeof(cmac_vectors[0]);
+
+    for (size_t i = 0; i < count; i++) {
+        size_t len = cmac_vectors[i].len;
+
+        uwan_cmac_update(&cmac, msg, len);
+        uwan_cmac_finish(&cmac, digest);
+        assert(memcmp(digest, cmac_vectors[i].mac, sizeof(digest)) == 0);
+
+        // split into uneven chunks, context is reused after reset
+        uwan_cmac_update(&cmac, msg, 3);
+        uwan_cmac_reset(&cmac);
+        for (size_t pos = 0; pos < len; pos += 7)
+            uwan_cmac_update(&cmac, msg + pos, len - pos < 7 ? len - pos : 7);
+        uwan_cmac_finish(&cmac, digest);
+        assert(memcmp(digest, cmac_vectors[i].mac, sizeof(digest)) == 0);
+    }
+}
+
+void test_hal_callbacks()
+{
+    const struct stack_hal hal = {
+        UWAN_CRYPTO_HAL,
+    };
+    uint8_t digest[UWAN_CMAC_DIGESTLEN];
+    void *aes[4];
+    void *cmac;
+
+    for (int i = 0; i < 4; i++) {
+        aes[i] = hal.crypto_aes_create_context(key);
+        assert(aes[i] != NULL);
+    }
+    assert(hal.crypto_aes_create_context(key) == NULL);
+    hal.crypto_aes_delete_context(aes[2]);
+    aes[2] = hal.crypto_aes_create_context(key);
+    assert(aes[2] != NULL);
+    for (int i = 0; i < 4; i++)
+        hal.crypto_aes_delete_context(aes[i]);
+
+    cmac = hal.crypto_cmac_create_context(key);
+    assert(cmac != NULL);
+    hal.crypto_cmac_update(cmac, msg, 40);
+    hal.crypto_cmac_finish(cmac, digest);
+    assert(memcmp(digest, cmac_vectors[2].mac, sizeof(digest)) == 0);
+    hal.crypto_cmac_reset(cmac);
+    hal.crypto_cmac_update(cmac, msg, 16);
+    hal.crypto_cmac_finish(cmac, digest);
+    assert(memcmp(digest, cmac_vectors[1].mac, sizeof(digest)) == 0);
+    hal.crypto_cmac_delete_context(cmac);
+}
+
+int main()
+{
+    int tested = 0;
+
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+        if (!uwan_aes_select_impl(impls[i]))
+            continue;
+
+        assert(uwan_aes_get_impl() == impls[i]);
+        test_aes_fips197();
+        test_aes_blocks();
+        test_cmac_rfc4493();
+        tested++;
+    }
+    assert(tested > 0);
+
+    assert(uwan_aes_select_impl(UWAN_AES_IMPL_AUTO));
+    test_hal_callbacks();
+
+    return 0;
+}
@@ -0,0 +1,40 @@
+#include <assert.h>
+
+#include "event.h"
+
+static struct event_ring ring;
+
+int main()
+{
+    struct event evt;
+
+    event_ring_init(&ring);
+    assert(event_pop(&ring, &evt) == false);
+    assert(!event_pending(&ring));
+
+    // indexes wrap around several times
+    for (int round = 0; round < 100; round++) {
+        for (int i = 0; i < UWAN_EVENT_RING_SIZE; i++) {
+            evt.type = EVENT_TIMER;
+            evt.data = i;
+            evt.time = round;
+            assert(event_push(&ring, &evt));
+        }
+
+        evt.type = EVENT_RADIO;
+        assert(event_push(&ring, &evt) == false);
+        assert(event_pending(&ring));
+
+        for (int i = 0; i < UWAN_EVENT_RING_SIZE; i++) {
+            assert(event_pop(&ring, &evt));
+            assert(evt.type == EVENT_TIMER);
+            assert(evt.data == i);
+            assert(evt.time == (uint32_t)round);
+        }
+
+        assert(event_pop(&ring, &evt) == false);
+        assert(!event_pending(&ring));
+    }
+
+    return 0;
+}
@@ -37,8 +37,8 @@ static void force_device_resync_req(void)
     force_device_resync_call_count++;
 }
 
-enum uwan_errs uwan_send_frame(uint8_t f_port, const uint8_t *payload,
-    uint8_t pld_len, bool confirm)
+enum uwan_errs uwan_send_frame(struct uwan_ctx *ctx, uint8_t f_port,
+    const uint8_t *payload, uint8_t pld_len, bool confirm)
 {
     if (pld_len < sizeof(frame))
     {
@@ -59,7 +59,7 @@ int main()
         .force_device_resync_req = force_device_resync_req,
     };
 
-    uwan_clock_sync_init(&cbs);
+    uwan_clock_sync_init(NULL, &cbs);
 
     assert(uwan_clock_sync_send_answ() == UWAN_ERR_STATE);
 
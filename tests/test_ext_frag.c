@@ -0,0 +1,227 @@
+#include <assert.h>
+#include <string.h>
+
+#include <uwan/stack.h>
+#include <uwan/ext/frag.h>
+
+#define CID_PACKAGE_VERSION 0
+#define CID_FRAG_SESSION_STATUS 1
+#define CID_FRAG_SESSION_SETUP 2
+#define CID_FRAG_SESSION_DELETE 3
+#define CID_DATA_FRAGMENT 8
+
+#define NB_FRAG 16
+#define FRAG_SIZE 8
+#define PADDING 3
+#define MATRIX_SIZE (NB_FRAG * 2)
+
+uint8_t frame[255];
+uint8_t frame_size;
+uint8_t frame_port;
+
+uint8_t storage[NB_FRAG * FRAG_SIZE + MATRIX_SIZE];
+uint8_t block[NB_FRAG * FRAG_SIZE];
+uint32_t done_size;
+uint32_t done_descriptor;
+int done_count;
+
+static void storage_read(uint32_t offset, uint8_t *buf, uint16_t len)
+{
+    assert(offset + len <= sizeof(storage));
+    memcpy(buf, &storage[offset], len);
+}
+
+static void storage_write(uint32_t offset, const uint8_t *buf, uint16_t len)
+{
+    assert(offset + len <= sizeof(storage));
+    memcpy(&storage[offset], buf, len);
+}
+
+static void session_done(uint32_t size, uint32_t descriptor)
+{
+    done_size = size;
+    done_descriptor = descriptor;
+    done_count++;
+}
+
+enum uwan_errs uwan_send_frame(struct uwan_ctx *ctx, uint8_t f_port,
+    const uint8_t *payload, uint8_t pld_len, bool confirm)
+{
+    (void)ctx;
+    (void)confirm;
+
+    if (pld_len < sizeof(frame))
+    {
+        memcpy(frame, payload, pld_len);
+        frame_size = pld_len;
+        frame_port = f_port;
+        return UWAN_ERR_NO;
+    }
+    return UWAN_ERR_MSG_LEN;
+}
+
+static void downlink(uint8_t *data, uint8_t size)
+{
+    struct uwan_dl_packet pkt = {
+        .f_port = UWAN_EXT_FRAG_PORT,
+        .data = data,
+        .size = size,
+    };
+
+    uwan_frag_handle_downlink(UWAN_ERR_NO, UWAN_MTYPE_UNCONF_DATA_DOWN, &pkt);
+}
+
+/* Encoder side of TS004 parity fragments */
+static uint32_t prbs23(uint32_t x)
+{
+    return (x >> 1) + (((x & 0x01) ^ ((x & 0x20) >> 5)) << 22);
+}
+
+static void encode_parity(uint16_t n, uint8_t *out)
+{
+    uint8_t line[NB_FRAG] = {0};
+    uint32_t x = 1 + 1001 * n;
+    uint32_t mod = NB_FRAG + 1; // power of two
+
+    for (int i = 0; i < NB_FRAG / 2; i++) {
+        uint32_t r = 1 << 16;
+        while (r >= NB_FRAG) {
+            x = prbs23(x);
+            r = x % mod;
+        }
+        line[r] = 1;
+    }
+
+    memset(out, 0, FRAG_SIZE);
+    for (int i = 0; i < NB_FRAG; i++) {
+        if (line[i]) {
+            for (int j = 0; j < FRAG_SIZE; j++)
+                out[j] ^= block[i * FRAG_SIZE + j];
+        }
+    }
+}
+
+static void send_fragment(uint16_t n)
+{
+    uint8_t buf[3 + FRAG_SIZE] = {CID_DATA_FRAGMENT, n, n >> 8};
+
+    if (n <= NB_FRAG)
+        memcpy(&buf[3], &block[(n - 1) * FRAG_SIZE], FRAG_SIZE);
+    else
+        encode_parity(n - NB_FRAG, &buf[3]);
+    downlink(buf, sizeof(buf));
+}
+
+static void setup_session(void)
+{
+    uint8_t setup_req[] = {
+        CID_FRAG_SESSION_SETUP, 0x00, NB_FRAG, 0x00, FRAG_SIZE, 0x00,
+        PADDING, 0x44, 0x33, 0x22, 0x11,
+    };
+    downlink(setup_req, sizeof(setup_req));
+    assert(uwan_frag_send_answ() == UWAN_ERR_NO);
+    uint8_t setup_ans[] = {CID_FRAG_SESSION_SETUP, 0x00};
+    assert(frame_size == sizeof(setup_ans));
+    assert(memcmp(frame, setup_ans, sizeof(setup_ans)) == 0);
+}
+
+int main()
+{
+    struct uwan_frag_callbacks cbs = {
+        .read = storage_read,
+        .write = storage_write,
+        .session_done = session_done,
+    };
+
+    for (size_t i = 0; i < sizeof(block); i++)
+        block[i] = i * 7 + 1;
+
+    uwan_frag_init(NULL, &cbs, sizeof(storage));
+    assert(uwan_frag_send_answ() == UWAN_ERR_STATE);
+
+    uint8_t version_req[] = {
+        CID_PACKAGE_VERSION,
+        CID_FRAG_SESSION_SETUP, 0x10, NB_FRAG, 0x00, FRAG_SIZE, 0x08, 0x00,
+        0x00, 0x00, 0x00, 0x00,
+    };
+    downlink(version_req, sizeof(version_req));
+    assert(uwan_frag_is_answ_pending());
+    assert(uwan_frag_send_answ() == UWAN_ERR_NO);
+    assert(!uwan_frag_is_answ_pending());
+
+    // Index 1 and matrix 1 are not supported
+    uint8_t version_ans[] = {
+        CID_PACKAGE_VERSION, 0x03, 0x01,
+        CID_FRAG_SESSION_SETUP, 0x45,
+    };
+    assert(frame_port == UWAN_EXT_FRAG_PORT);
+    assert(frame_size == sizeof(version_ans));
+    assert(memcmp(frame, version_ans, sizeof(version_ans)) == 0);
+
+    setup_session();
+
+    // Uncoded fragments only
+    for (int n = 1; n <= NB_FRAG; n++)
+        send_fragment(n);
+    assert(done_count == 1);
+    assert(done_size == sizeof(block) - PADDING);
+    assert(done_descriptor == 0x11223344);
+    assert(memcmp(storage, block, sizeof(block)) == 0);
+    assert(!uwan_frag_is_answ_pending());
+
+    // Lost fragments are recovered from parity ones
+    memset(storage, 0, sizeof(storage));
+    setup_session();
+
+    const uint16_t lost[] = {1, 4, 5, 11, 16};
+    for (int n = 1; n <= NB_FRAG; n++) {
+        bool is_lost = false;
+        for (size_t i = 0; i < sizeof(lost) / sizeof(lost[0]); i++)
+            is_lost |= lost[i] == n;
+        if (!is_lost)
+            send_fragment(n);
+    }
+
+    uint8_t status_req[] = {CID_FRAG_SESSION_STATUS, 0x00};
+    downlink(status_req, sizeof(status_req));
+    assert(uwan_frag_send_answ() == UWAN_ERR_NO);
+    uint8_t status_ans[] = {CID_FRAG_SESSION_STATUS, 11, 0x00, 5, 0x00};
+    assert(frame_size == sizeof(status_ans));
+    assert(memcmp(frame, status_ans, sizeof(status_ans)) == 0);
+
+    uint16_t n = NB_FRAG + 1;
+    while (done_count == 1) {
+        assert(n <= 2 * NB_FRAG);
+        send_fragment(n++);
+    }
+    assert(done_size == sizeof(block) - PADDING);
+    assert(memcmp(storage, block, sizeof(block)) == 0);
+
+    // Only participants answer when nothing is missing
+    downlink(status_req, sizeof(status_req));
+    assert(!uwan_frag_is_answ_pending());
+    status_req[1] = 0x01;
+    downlink(status_req, sizeof(status_req));
+    assert(uwan_frag_send_answ() == UWAN_ERR_NO);
+    assert(frame[3] == 0);
+
+    // Matrix doesn't fit into storage
+    uwan_frag_init(NULL, &cbs, NB_FRAG * FRAG_SIZE);
+    setup_session();
+    send_fragment(1);
+    send_fragment(NB_FRAG + 1);
+    status_req[1] = 0x00;
+    downlink(status_req, sizeof(status_req));
+    assert(uwan_frag_send_answ() == UWAN_ERR_NO);
+    uint8_t no_mem_ans[] = {CID_FRAG_SESSION_STATUS, 2, 0x00, 15, 0x01};
+    assert(memcmp(frame, no_mem_ans, sizeof(no_mem_ans)) == 0);
+
+    uint8_t delete_req[] = {CID_FRAG_SESSION_DELETE, 0x00};
+    downlink(delete_req, sizeof(delete_req));
+    downlink(delete_req, sizeof(delete_req));
+    assert(uwan_frag_send_answ() == UWAN_ERR_NO);
+    uint8_t delete_ans[] = {CID_FRAG_SESSION_DELETE, 0x04};
+    assert(memcmp(frame, delete_ans, sizeof(delete_ans)) == 0);
+
+    return 0;
+}
@@ -0,0 +1,204 @@
+#include <assert.h>
+#include <string.h>
+
+#include <uwan/stack.h>
+#include <uwan/ext/mc_setup.h>
+
+#define CID_PACKAGE_VERSION 0
+#define CID_MC_GROUP_STATUS 1
+#define CID_MC_GROUP_SETUP 2
+#define CID_MC_GROUP_DELETE 3
+#define CID_MC_CLASS_C_SESSION 4
+#define CID_MC_CLASS_B_SESSION 5
+
+uint8_t frame[255];
+uint8_t frame_size;
+uint8_t frame_port;
+
+bool groups[4];
+uint32_t group_addr[4];
+uint8_t group_key[16];
+uint32_t group_f_cnt_min;
+uint32_t group_f_cnt_max;
+
+uint32_t test_unixtime;
+uint8_t session_id;
+uint32_t session_time_to_start;
+uint32_t session_duration;
+uint32_t session_frequency;
+enum uwan_dr session_dr;
+uint8_t session_periodicity;
+
+static uint32_t get_unixtime(void)
+{
+    return test_unixtime;
+}
+
+static bool class_c_session(uint8_t id, uint32_t time_to_start,
+    uint32_t duration_s, uint32_t frequency, enum uwan_dr dr)
+{
+    session_id = id;
+    session_time_to_start = time_to_start;
+    session_duration = duration_s;
+    session_frequency = frequency;
+    session_dr = dr;
+    return frequency == 869525000;
+}
+
+static bool class_b_session(uint8_t id, uint32_t time_to_start,
+    uint32_t duration_s, uint32_t frequency, enum uwan_dr dr,
+    uint8_t periodicity)
+{
+    session_periodicity = periodicity;
+    return class_c_session(id, time_to_start, duration_s, frequency, dr);
+}
+
+bool uwan_mc_setup_group(struct uwan_ctx *ctx, uint8_t id, uint32_t mc_addr,
+    const uint8_t *mc_key_encrypted, uint32_t f_cnt_min, uint32_t f_cnt_max)
+{
+    if (id >= 2)
+        return false;
+
+    groups[id] = true;
+    group_addr[id] = mc_addr;
+    memcpy(group_key, mc_key_encrypted, sizeof(group_key));
+    group_f_cnt_min = f_cnt_min;
+    group_f_cnt_max = f_cnt_max;
+    return true;
+}
+
+bool uwan_mc_delete_group(struct uwan_ctx *ctx, uint8_t id)
+{
+    if (!groups[id])
+        return false;
+
+    groups[id] = false;
+    return true;
+}
+
+bool uwan_mc_get_group(struct uwan_ctx *ctx, uint8_t id, uint32_t *mc_addr)
+{
+    *mc_addr = group_addr[id];
+    return groups[id];
+}
+
+enum uwan_errs uwan_send_frame(struct uwan_ctx *ctx, uint8_t f_port,
+    const uint8_t *payload, uint8_t pld_len, bool confirm)
+{
+    if (pld_len < sizeof(frame))
+    {
+        memcpy(frame, payload, pld_len);
+        frame_size = pld_len;
+        frame_port = f_port;
+        return UWAN_ERR_NO;
+    }
+    return UWAN_ERR_MSG_LEN;
+}
+
+static void downlink(uint8_t *data, uint8_t size)
+{
+    struct uwan_dl_packet pkt = {
+        .f_port = UWAN_EXT_MC_SETUP_PORT,
+        .data = data,
+        .size = size,
+    };
+
+    uwan_mc_setup_handle_downlink(UWAN_ERR_NO, UWAN_MTYPE_UNCONF_DATA_DOWN,
+        &pkt);
+}
+
+static void check_answer(const uint8_t *ans, uint8_t size)
+{
+    assert(uwan_mc_setup_send_answ() == UWAN_ERR_NO);
+    assert(frame_port == UWAN_EXT_MC_SETUP_PORT);
+    assert(frame_size == size);
+    assert(memcmp(frame, ans, size) == 0);
+}
+
+int main()
+{
+    struct uwan_mc_setup_callbacks cbs = {
+        .get_unixtime = get_unixtime,
+        .class_c_session = class_c_session,
+    };
+
+    uwan_mc_setup_init(NULL, &cbs);
+    assert(uwan_mc_setup_send_answ() == UWAN_ERR_STATE);
+
+    uint8_t setup_req[] = {
+        CID_PACKAGE_VERSION,
+        CID_MC_GROUP_SETUP, 0x01, // McGroupIDHeader
+        0x44, 0x33, 0x22, 0x11, // McAddr
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, // McKey_encrypted
+        0x00, 0x00, 0x00, 0x00, // minMcFCount
+        0xff, 0x00, 0x00, 0x00, // maxMcFCount
+        CID_MC_GROUP_STATUS, 0x0f,
+    };
+    downlink(setup_req, sizeof(setup_req));
+    assert(groups[1] && group_addr[1] == 0x11223344);
+    assert(group_key[15] == 0x0f);
+    assert(group_f_cnt_min == 0 && group_f_cnt_max == 0xff);
+
+    const uint8_t setup_ans[] = {
+        CID_PACKAGE_VERSION, 0x02, 0x01,
+        CID_MC_GROUP_SETUP, 0x01,
+        CID_MC_GROUP_STATUS, 0x12, 0x01, 0x44, 0x33, 0x22, 0x11,
+    };
+    check_answer(setup_ans, sizeof(setup_ans));
+    assert(!uwan_mc_setup_is_answ_pending());
+
+    // Group 2 isn't supported
+    setup_req[2] = 0x02;
+    downlink(&setup_req[1], 30);
+    const uint8_t setup_err_ans[] = {CID_MC_GROUP_SETUP, 0x06};
+    check_answer(setup_err_ans, sizeof(setup_err_ans));
+
+    // Session starts in 10 s for 2^3 s
+    test_unixtime = 1722419302;
+    uint32_t session_time = 1722419302 - 315964800 + 18 + 10;
+    uint8_t session_req[] = {
+        CID_MC_CLASS_C_SESSION, 0x01,
+        session_time, session_time >> 8, session_time >> 16,
+        session_time >> 24, 0x03,
+        0xd2, 0xad, 0x84, // 869525000 Hz
+        UWAN_DR_3,
+        CID_MC_CLASS_B_SESSION, 0x01,
+        session_time, session_time >> 8, session_time >> 16,
+        session_time >> 24, 0x53,
+        0xd2, 0xad, 0x84,
+        UWAN_DR_3,
+    };
+    downlink(session_req, sizeof(session_req));
+    assert(session_id == 1);
+    assert(session_time_to_start == 10);
+    assert(session_duration == 8);
+    assert(session_frequency == 869525000);
+    assert(session_dr == UWAN_DR_3);
+
+    // Class B session isn't handled without callback
+    const uint8_t session_ans[] = {CID_MC_CLASS_C_SESSION, 0x01, 10, 0, 0};
+    check_answer(session_ans, sizeof(session_ans));
+
+    cbs.class_b_session = class_b_session;
+    session_req[18] = 0x00; // unsupported frequency
+    downlink(&session_req[11], 11);
+    assert(session_periodicity == 5);
+    const uint8_t freq_err_ans[] = {CID_MC_CLASS_B_SESSION, 0x09};
+    check_answer(freq_err_ans, sizeof(freq_err_ans));
+
+    session_req[1] = 0x00;
+    session_req[10] = UWAN_DR_COUNT;
+    downlink(session_req, 11);
+    const uint8_t dr_err_ans[] = {CID_MC_CLASS_C_SESSION, 0x14};
+    check_answer(dr_err_ans, sizeof(dr_err_ans));
+
+    uint8_t delete_req[] = {CID_MC_GROUP_DELETE, 0x01};
+    downlink(delete_req, sizeof(delete_req));
+    downlink(delete_req, sizeof(delete_req));
+    const uint8_t delete_ans[] = {CID_MC_GROUP_DELETE, 0x05};
+    check_answer(delete_ans, sizeof(delete_ans));
+    assert(!groups[1]);
+
+    return 0;
+}
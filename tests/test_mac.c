@@ -5,6 +5,7 @@
 #include "adr.h"
 #include "channels.h"
 #include "mac.h"
+#include "stack.h"
 
 uint8_t rx1_delay;
 uint8_t rx1_dr_offset;
@@ -16,9 +17,17 @@ uint8_t test_link_check_gw_cnt;
 uint32_t test_device_time_unixtime;
 uint8_t test_device_time_fraq;
 
-bool adr_handle_link_req(uint8_t dr_txpow,uint16_t ch_mask, uint8_t redundancy)
+uint32_t test_ping_freq;
+enum uwan_dr test_ping_dr;
+uint32_t test_beacon_freq;
+
+static struct uwan_ctx ctx;
+static const struct stack_hal hal;
+
+uint8_t adr_handle_link_req(struct uwan_ctx *ctx, uint8_t dr_txpow,
+    uint16_t ch_mask, uint8_t redundancy)
 {
-    return true;
+    return 0x07;
 }
 
 bool is_valid_dr(uint8_t dr)
@@ -31,26 +40,44 @@ bool is_valid_frequency(uint32_t freq)
     return true;
 }
 
-bool uwan_set_rx1_dr_offset(uint8_t offset)
+bool uwan_set_rx1_dr_offset(struct uwan_ctx *ctx, uint8_t offset)
 {
     rx1_dr_offset = offset;
     return true;
 }
 
-bool uwan_set_rx1_delay(uint8_t delay)
+bool uwan_set_rx1_delay(struct uwan_ctx *ctx, uint8_t delay)
 {
     rx1_delay = delay;
     return true;
 }
 
-enum uwan_errs uwan_set_rx2(uint32_t frequency, enum uwan_dr dr)
+enum uwan_errs uwan_set_rx2(struct uwan_ctx *ctx, uint32_t frequency,
+    enum uwan_dr dr)
 {
     rx2_freq = frequency;
     rx2_dr = dr;
     return true;
 }
 
-int8_t get_snr()
+void class_b_set_time(struct uwan_ctx *ctx, uint32_t gps_time,
+    uint32_t ref_ms)
+{
+}
+
+void class_b_set_ping_channel(struct uwan_ctx *ctx, uint32_t frequency,
+    enum uwan_dr dr)
+{
+    test_ping_freq = frequency;
+    test_ping_dr = dr;
+}
+
+void class_b_set_beacon_frequency(struct uwan_ctx *ctx, uint32_t frequency)
+{
+    test_beacon_freq = frequency;
+}
+
+int8_t get_snr(struct uwan_ctx *ctx)
 {
     return -10;
 }
@@ -79,8 +106,9 @@ static void device_time_result(uint32_t dev_time, uint32_t unixtime, uint8_t fra
 
 int main()
 {
-    mac_init();
-    channels_init();
+    ctx.stack_hal = &hal;
+    mac_init(&ctx);
+    channels_init(&ctx);
 
     struct uwan_mac_callbacks cbs = {
         .get_battery_level = get_battery_level,
@@ -89,52 +117,145 @@ int main()
         .device_time_result = device_time_result,
     };
 
-    uwan_mac_set_handlers(&cbs);
+    uwan_mac_set_handlers(&ctx, &cbs);
 
     const uint8_t mac_down_pld[] = {
         CID_LINK_CHECK, 0x0a, 0x01,
         CID_LINK_ADR, 0x31, 0x07, 0x00, 0x01,
-        CID_DUTY_CYCLE, 0x00,
+        CID_DUTY_CYCLE, 0xf3,
         CID_RX_PARAM_SETUP, 0x12, 0x40, 0x72, 0x84,
         CID_DEV_STATUS,
         CID_NEW_CHANNEL, 0x03, 0x40, 0x72, 0x84, 0x50,
         CID_NEW_CHANNEL, 0x04, 0x40, 0x72, 0x84, 0x41,
         CID_RX_TIMING_SETUP, 0x00,
         CID_TX_PARAM_SETUP, 0x00,
-        CID_DI_CHANNEL, 0x00, 0x40, 0x72, 0x84,
+        CID_DI_CHANNEL, 0x03, 0xd2, 0xad, 0x84,
         CID_DEVICE_TIME, 0xf8, 0xca, 0xd4, 0x53, 0xaa,
     };
-    mac_handle_commands(mac_down_pld, sizeof(mac_down_pld));
+    mac_handle_commands(&ctx, mac_down_pld, sizeof(mac_down_pld));
 
     assert(rx1_dr_offset == 1);
     assert(rx1_delay == 1);
     assert(rx2_freq == 868000000);
     assert(rx2_dr == UWAN_DR_2);
+    assert(ctx.channels.max_dcycle == 3);
+    assert(channels_get_rx1_frequency(&ctx, 868000000) == 869525000);
 
     assert(test_link_check_margin == 0x0a);
     assert(test_link_check_gw_cnt == 0x01);
     assert(test_device_time_unixtime == 1722419302);
     assert(test_device_time_fraq == 0xaa);
 
-    assert(uwan_mac_link_check_req());
-    assert(uwan_mac_device_time_req());
+    assert(uwan_mac_link_check_req(&ctx));
+    assert(uwan_mac_device_time_req(&ctx));
 
     const uint8_t mac_up_pld[] = {
-        // CID_LINK_ADR, 0x07,
-        CID_DUTY_CYCLE,
         CID_RX_PARAM_SETUP, 0x07,
+        CID_RX_TIMING_SETUP,
+        CID_DI_CHANNEL, 0x03,
+        CID_LINK_ADR, 0x07,
+        CID_DUTY_CYCLE,
         CID_DEV_STATUS, 0x64, 0x36,
         CID_NEW_CHANNEL, 0x03,
         CID_NEW_CHANNEL, 0x01,
-        CID_RX_TIMING_SETUP,
         CID_LINK_CHECK,
         CID_DEVICE_TIME,
     };
-    assert(mac_get_payload_size() == sizeof(mac_up_pld));
+    assert(mac_get_payload_size(&ctx) == sizeof(mac_up_pld));
+
+    uint8_t mac_buf[MAC_FOPTS_SIZE];
+    uint8_t mac_frm_buf[MAC_BUF_SIZE];
+    mac_get_payload(&ctx, mac_frm_buf, sizeof(mac_frm_buf));
+    assert(memcmp(mac_up_pld, mac_frm_buf, sizeof(mac_up_pld)) == 0);
+
+    // sticky answers are repeated until class A downlink
+    assert(mac_get_payload(&ctx, mac_buf, sizeof(mac_buf)) == 5);
+    assert(memcmp(mac_up_pld, mac_buf, 5) == 0);
+
+    const uint8_t rx_timing_down_pld[] = {CID_RX_TIMING_SETUP, 0x02};
+    mac_handle_commands(&ctx, rx_timing_down_pld,
+        sizeof(rx_timing_down_pld));
+    mac_handle_downlink(&ctx);
+    assert(mac_get_payload_size(&ctx) == 5);
+
+    const uint8_t sticky_up_pld[] = {
+        CID_RX_PARAM_SETUP, 0x07,
+        CID_DI_CHANNEL, 0x03,
+        CID_RX_TIMING_SETUP,
+    };
+    assert(mac_get_payload(&ctx, mac_buf, sizeof(mac_buf)) == 5);
+    assert(memcmp(sticky_up_pld, mac_buf, sizeof(sticky_up_pld)) == 0);
+    mac_handle_downlink(&ctx);
+    assert(mac_get_payload_size(&ctx) == 0);
+
+    const uint8_t class_b_down_pld[] = {
+        CID_PING_SLOT_INFO,
+        CID_PING_SLOT_CHANNEL, 0x40, 0x72, 0x84, 0x03,
+        CID_BEACON_FREQ, 0x00, 0x00, 0x00,
+    };
+    mac_handle_commands(&ctx, class_b_down_pld, sizeof(class_b_down_pld));
+
+    assert(test_ping_freq == 868000000);
+    assert(test_ping_dr == UWAN_DR_3);
+    assert(test_beacon_freq == 0);
+
+    ctx.class_b.periodicity = 5;
+    assert(uwan_mac_ping_slot_info_req(&ctx));
 
-    uint8_t mac_buf[15];
-    mac_get_payload(mac_buf, sizeof(mac_buf));
-    assert(memcmp(mac_up_pld, mac_buf, sizeof(mac_up_pld)) == 0);
+    const uint8_t class_b_up_pld[] = {
+        CID_PING_SLOT_CHANNEL, 0x03,
+        CID_BEACON_FREQ, 0x01,
+        CID_PING_SLOT_INFO, 0x05,
+    };
+    assert(mac_get_payload(&ctx, mac_buf, sizeof(mac_buf)) ==
+        sizeof(class_b_up_pld));
+    assert(memcmp(class_b_up_pld, mac_buf, sizeof(class_b_up_pld)) == 0);
+
+    // commands without handler are skipped, proprietary ones stop parsing
+    const uint8_t skip_down_pld[] = {
+        CID_FORCE_REJOIN, 0x00, 0x00,
+        CID_TX_PARAM_SETUP, 0x00,
+        CID_DEV_STATUS,
+        0x80, CID_DUTY_CYCLE, 0x00,
+    };
+    mac_handle_commands(&ctx, skip_down_pld, sizeof(skip_down_pld));
+
+    const uint8_t skip_up_pld[] = {CID_DEV_STATUS, 0x64, 0x36};
+    assert(mac_get_payload(&ctx, mac_buf, sizeof(mac_buf)) ==
+        sizeof(skip_up_pld));
+    assert(memcmp(skip_up_pld, mac_buf, sizeof(skip_up_pld)) == 0);
+
+    // answers beyond FOpts are kept for FPort 0 until the buffer is full
+    uint8_t dev_status_down_pld[20];
+    memset(dev_status_down_pld, CID_DEV_STATUS, sizeof(dev_status_down_pld));
+    mac_handle_commands(&ctx, dev_status_down_pld,
+        sizeof(dev_status_down_pld));
+    assert(mac_get_payload_size(&ctx) == MAC_BUF_SIZE);
+    assert(mac_get_payload(&ctx, mac_buf, sizeof(mac_buf)) == 0);
+
+    assert(mac_get_payload(&ctx, mac_frm_buf, sizeof(mac_frm_buf)) ==
+        MAC_BUF_SIZE);
+    assert(memcmp(skip_up_pld, &mac_frm_buf[MAC_BUF_SIZE - 3], 3) == 0);
+
+    // a command without room for its answer doesn't stop the next ones
+    uint8_t full_down_pld[16 + 5 + 1 + 2];
+    memset(full_down_pld, CID_DEV_STATUS, 16);
+    const uint8_t full_tail_pld[] = {
+        CID_LINK_ADR, 0x31, 0x07, 0x00, 0x01,
+        CID_DEV_STATUS,
+        CID_DUTY_CYCLE, 0x05,
+    };
+    memcpy(&full_down_pld[16], full_tail_pld, sizeof(full_tail_pld));
+    mac_handle_commands(&ctx, full_down_pld, sizeof(full_down_pld));
+    assert(ctx.channels.max_dcycle == 5);
+
+    const uint8_t full_up_pld[] = {
+        CID_LINK_ADR, 0x07,
+        CID_DUTY_CYCLE,
+    };
+    assert(mac_get_payload(&ctx, mac_frm_buf, sizeof(mac_frm_buf)) ==
+        MAC_BUF_SIZE);
+    assert(memcmp(full_up_pld, &mac_frm_buf[MAC_BUF_SIZE - 3], 3) == 0);
 
     return 0;
 }
@@ -26,6 +26,10 @@
 #include <string.h>
 #include <uwan/stack.h>
 #include <uwan/region/eu868.h>
+#ifdef UWAN_TEST_BUILTIN_CRYPTO
+#include <uwan/crypto.h>
+#endif
+#include "stack.h"
 #include "utils.h"
 
 #define RSSI -120
@@ -40,18 +44,62 @@ static enum uwan_sf radio_sf;
 static enum uwan_bw radio_bw;
 static enum uwan_cr radio_cr;
 static uint8_t radio_dio_irq;
+static uint16_t radio_symb_timeout;
+static uint32_t radio_rx_timeout;
+static uint32_t app_timer_timeout[6];
+static uint32_t app_time_ms;
 
 static enum uwan_errs app_err;
 static enum uwan_mtypes app_m_type;
 static int16_t app_snr;
 static int8_t app_rssi;
+static bool app_ack;
+static bool app_multicast;
+static uint8_t app_mc_group;
+static uint8_t app_pld[16];
 static int app_downlink_callback_call_count;
-static void (*app_evt_handler)(uint8_t evt_mask);
+static void (*app_evt_handler)(void *arg, uint8_t evt_mask);
+static void *app_evt_arg;
+static struct uwan_ctx *ctx;
+
+static uint8_t app_uplink_ids[4];
+static enum uwan_errs app_uplink_errs[4];
+static int app_uplink_callback_call_count;
+static int app_event_callback_call_count;
+static uint32_t app_nvm_f_cnt;
+static int app_nvm_call_count;
+static uint32_t app_nvm_dev_nonce;
+static int app_beacon_call_count;
+static enum uwan_errs app_beacon_err;
+static uint32_t app_beacon_time;
+static uint32_t app_nvm_join_nonce;
+
+static const uint8_t join_accept[] = {
+    0x20, // MHDR
+    // 0x01, 0x02, 0x03, // AppNonce
+    // 0xaa, 0xbb, 0xcc, // NetId
+    // 0x00, 0x01, 0x02, 0x03, // DevAddr
+    // 0x00, // DLSettings
+    // 0x01, // RxDelay
+    0x05, 0x07, 0x05, 0xad,
+    0xbf, 0xc9, 0x06, 0x06,
+    0x06, 0x06, 0x06, 0x06,
+    0x00, 0x00, 0x00, 0x00,
+};
+
+#define CRYPTO_CONTEXTS 8
 
 static struct crypto_context {
     bool in_use;
     uint8_t key[UWAN_AES_BLOCK_SIZE];
-} aes_context, cmac_context;
+} aes_contexts[CRYPTO_CONTEXTS], cmac_contexts[CRYPTO_CONTEXTS];
+
+static int crypto_create_call_count;
+static bool crypto_exhausted; // pools return no context
+static int aes_encrypt_blocks_call_count;
+
+static bool radio_inverted_iq;
+static void (*radio_setup_hook)(void); // interrupt in the middle of setup
 
 static const uint8_t dev_eui[] = {
     0x00, 0x01, 0x02, 0x03,
@@ -95,6 +143,10 @@ static void radio_setup(const struct uwan_packet_params *params)
     radio_sf = params->sf;
     radio_bw = params->bw;
     radio_cr = params->cr;
+    radio_inverted_iq = params->inverted_iq;
+
+    if (radio_setup_hook)
+        radio_setup_hook();
 }
 
 static void radio_tx(const uint8_t *buf, uint8_t len)
@@ -105,6 +157,8 @@ static void radio_tx(const uint8_t *buf, uint8_t len)
 
 static void radio_rx(uint8_t len, uint16_t symb_timeout, uint32_t timeout)
 {
+    radio_symb_timeout = symb_timeout;
+    radio_rx_timeout = timeout;
 }
 
 static void radio_read_packet(struct uwan_dl_packet *pkt)
@@ -121,11 +175,11 @@ static uint32_t radio_rand(void)
     return 0;
 }
 
-void utils_random_init(uint32_t seed)
+void utils_random_init(uint32_t *state, uint32_t seed)
 {
 }
 
-uint32_t utils_get_random(uint32_t max)
+uint32_t utils_get_random(uint32_t *state, uint32_t max)
 {
     return 0x01234567 % max;
 }
@@ -138,14 +192,16 @@ uint32_t utils_gps_to_unix(uint32_t timestamp)
 static uint8_t radio_irq_handler(void)
 {
     if (app_evt_handler)
-        app_evt_handler(radio_dio_irq);
+        app_evt_handler(app_evt_arg, radio_dio_irq);
 
     return radio_dio_irq;
 }
 
-static void radio_set_evt_handler(void (*handler)(uint8_t evt_mask))
+static void radio_set_evt_handler(void (*handler)(void *arg, uint8_t evt_mask),
+    void *arg)
 {
     app_evt_handler = handler;
+    app_evt_arg = arg;
 }
 
 static const struct radio_dev radio = {
@@ -161,78 +217,155 @@ static const struct radio_dev radio = {
     .set_evt_handler = radio_set_evt_handler,
 };
 
-void app_start_timer(enum uwan_timer_ids timer_id, uint32_t timeout_ms)
+void app_start_timer(struct uwan_ctx *ctx, enum uwan_timer_ids timer_id,
+    uint32_t timeout_ms)
 {
-
+    app_timer_timeout[timer_id] = timeout_ms;
 }
 
-void app_stop_timer(enum uwan_timer_ids timer_id)
+void app_stop_timer(struct uwan_ctx *ctx, enum uwan_timer_ids timer_id)
 {
 
 }
 
-void app_downlink_callback(enum uwan_errs err, enum uwan_mtypes m_type,
-    const struct uwan_dl_packet *pkt)
+void app_downlink_callback(struct uwan_ctx *ctx, enum uwan_errs err,
+    enum uwan_mtypes m_type, const struct uwan_dl_packet *pkt)
 {
     app_downlink_callback_call_count++;
     app_err = err;
     app_m_type = m_type;
     app_rssi = pkt->rssi;
     app_snr = pkt->snr;
+    app_ack = pkt->ack;
+    app_multicast = pkt->multicast;
+    app_mc_group = pkt->mc_group;
+    if (pkt->size <= sizeof(app_pld))
+        memcpy(app_pld, pkt->data, pkt->size);
+}
+
+static struct crypto_context *crypto_alloc(struct crypto_context *pool,
+    const uint8_t key[UWAN_AES_BLOCK_SIZE])
+{
+    if (crypto_exhausted)
+        return NULL;
+
+    for (int i = 0; i < CRYPTO_CONTEXTS; i++) {
+        if (pool[i].in_use == false) {
+            memcpy(pool[i].key, key, UWAN_AES_BLOCK_SIZE);
+            pool[i].in_use = true;
+            crypto_create_call_count++;
+            return &pool[i];
+        }
+    }
+
+    assert(false);
+    return NULL;
+}
+
+static void crypto_free(struct crypto_context *pool, void *ctx)
+{
+    struct crypto_context *context = ctx;
+    assert(context >= pool && context < pool + CRYPTO_CONTEXTS);
+    assert(context->in_use == true);
+    context->in_use = false;
 }
 
 void *app_crypto_aes_create_context(const uint8_t key[UWAN_AES_BLOCK_SIZE])
 {
-    memcpy(aes_context.key, key, UWAN_AES_BLOCK_SIZE);
-    assert(aes_context.in_use == false);
-    aes_context.in_use = true;
-    return &aes_context;
+    return crypto_alloc(aes_contexts, key);
 }
 
 void app_crypto_aes_encrypt(void *ctx, void *dst, const void *src)
 {
-    assert(ctx == &aes_context);
     struct crypto_context *context = ctx;
+    assert(context->in_use == true);
     for (int i = 0; i < UWAN_AES_BLOCK_SIZE; i++)
         ((uint8_t *)dst)[i] = ((const uint8_t *)src)[i] ^ context->key[i];
 }
 
+void app_crypto_aes_encrypt_blocks(void *ctx, void *dst, const void *src,
+    size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        app_crypto_aes_encrypt(ctx, (uint8_t *)dst + i * UWAN_AES_BLOCK_SIZE,
+            (const uint8_t *)src + i * UWAN_AES_BLOCK_SIZE);
+    }
+    aes_encrypt_blocks_call_count++;
+}
 
 void app_crypto_aes_delete_context(void *ctx)
 {
-    assert(ctx == &aes_context);
-    struct crypto_context *context = ctx;
-    assert(context->in_use == true);
-    context->in_use = false;
+    crypto_free(aes_contexts, ctx);
 }
 
 void *app_crypto_cmac_create_context(const uint8_t key[UWAN_AES_BLOCK_SIZE])
 {
-    memcpy(cmac_context.key, key, UWAN_AES_BLOCK_SIZE);
-    assert(cmac_context.in_use == false);
-    cmac_context.in_use = true;
-    return &cmac_context;
+    return crypto_alloc(cmac_contexts, key);
 }
 
 void app_crypto_cmac_update(void *ctx, const void *src, size_t len)
 {
-    assert(ctx == &cmac_context);
     struct crypto_context *context = ctx;
+    assert(context->in_use == true);
 }
 
 void app_crypto_cmac_finish(void *ctx, uint8_t digest[UWAN_CMAC_DIGESTLEN])
 {
-    assert(ctx == &cmac_context);
     struct crypto_context *context = ctx;
+    assert(context->in_use == true);
     memcpy(digest, context->key, UWAN_CMAC_DIGESTLEN);
 }
 
 void app_crypto_cmac_delete_context(void *ctx)
 {
-    assert(ctx == &cmac_context);
+    crypto_free(cmac_contexts, ctx);
+}
+
+void app_crypto_cmac_reset(void *ctx)
+{
     struct crypto_context *context = ctx;
     assert(context->in_use == true);
-    context->in_use = false;
+}
+
+uint32_t app_get_time_ms(struct uwan_ctx *ctx)
+{
+    return app_time_ms;
+}
+
+void app_uplink_callback(struct uwan_ctx *ctx, uint8_t id, enum uwan_errs err)
+{
+    assert(app_uplink_callback_call_count < 4);
+    app_uplink_ids[app_uplink_callback_call_count] = id;
+    app_uplink_errs[app_uplink_callback_call_count] = err;
+    app_uplink_callback_call_count++;
+}
+
+void app_event_callback(struct uwan_ctx *ctx)
+{
+    app_event_callback_call_count++;
+}
+
+bool app_nvm_reserve_f_cnt(struct uwan_ctx *ctx, uint32_t f_cnt_up)
+{
+    app_nvm_f_cnt = f_cnt_up;
+    app_nvm_call_count++;
+    return true;
+}
+
+bool app_nvm_store_join_nonces(struct uwan_ctx *ctx, uint32_t dev_nonce,
+    uint32_t join_nonce)
+{
+    app_nvm_dev_nonce = dev_nonce;
+    app_nvm_join_nonce = join_nonce;
+    return true;
+}
+
+void app_beacon_callback(struct uwan_ctx *ctx, enum uwan_errs err,
+    uint32_t gps_time)
+{
+    app_beacon_call_count++;
+    app_beacon_err = err;
+    app_beacon_time = gps_time;
 }
 
 static const struct stack_hal app_hal = {
@@ -246,6 +379,27 @@ static const struct stack_hal app_hal = {
     .crypto_cmac_update = app_crypto_cmac_update,
     .crypto_cmac_finish = app_crypto_cmac_finish,
     .crypto_cmac_delete_context = app_crypto_cmac_delete_context,
+    .crypto_cmac_reset = app_crypto_cmac_reset,
+    .crypto_aes_encrypt_blocks = app_crypto_aes_encrypt_blocks,
+};
+
+static const struct stack_hal app_hal_time = {
+    .start_timer = app_start_timer,
+    .stop_timer = app_stop_timer,
+    .downlink_callback = app_downlink_callback,
+    .crypto_aes_create_context = app_crypto_aes_create_context,
+    .crypto_aes_encrypt = app_crypto_aes_encrypt,
+    .crypto_aes_delete_context = app_crypto_aes_delete_context,
+    .crypto_cmac_create_context = app_crypto_cmac_create_context,
+    .crypto_cmac_update = app_crypto_cmac_update,
+    .crypto_cmac_finish = app_crypto_cmac_finish,
+    .crypto_cmac_delete_context = app_crypto_cmac_delete_context,
+    .get_time_ms = app_get_time_ms,
+    .uplink_callback = app_uplink_callback,
+    .event_callback = app_event_callback,
+    .nvm_reserve_f_cnt = app_nvm_reserve_f_cnt,
+    .nvm_store_join_nonces = app_nvm_store_join_nonces,
+    .beacon_callback = app_beacon_callback,
 };
 
 void test_join_successfull()
@@ -258,21 +412,9 @@ void test_join_successfull()
         0x67, 0x45, // DevNonce
         0x04, 0x05, 0x06, 0x07, // MIC
     };
-    const uint8_t join_accept[] = {
-        0x20, // MHDR
-        // 0x01, 0x02, 0x03, // AppNonce
-        // 0xaa, 0xbb, 0xcc, // NetId
-        // 0x00, 0x01, 0x02, 0x03, // DevAddr
-        // 0x00, // DLSettings
-        // 0x01, // RxDelay
-        0x05, 0x07, 0x05, 0xad,
-        0xbf, 0xc9, 0x06, 0x06,
-        0x06, 0x06, 0x06, 0x06,
-        0x00, 0x00, 0x00, 0x00,
-    };
 
-    uwan_set_otaa_keys(dev_eui, app_eui, app_key);
-    result = uwan_join();
+    uwan_set_otaa_keys(ctx, dev_eui, app_eui, app_key);
+    result = uwan_join(ctx);
     assert(result == UWAN_ERR_NO);
 
     assert(radio_frame_size == sizeof(join_request));
@@ -281,7 +423,12 @@ void test_join_successfull()
     radio_dio_irq = RADIO_IRQF_TX_DONE;
     radio.irq_handler();
 
-    uwan_timer_callback(UWAN_TIMER_RX1);
+    // SF7 window is centered on 4th symbol, SF12 window is opened later
+    assert(app_timer_timeout[UWAN_TIMER_RX1] == 5001);
+    assert(app_timer_timeout[UWAN_TIMER_RX2] == 6032);
+
+    uwan_timer_callback(ctx, UWAN_TIMER_RX1);
+    assert(radio_symb_timeout == 6);
 
     radio_frame_size = sizeof(join_accept);
     memcpy(radio_frame, join_accept, radio_frame_size);
@@ -293,7 +440,7 @@ void test_join_successfull()
     assert(app_downlink_callback_call_count == 1);
     assert(app_err == UWAN_ERR_NO);
     assert(app_m_type == UWAN_MTYPE_JOIN_ACCEPT);
-    assert(uwan_is_joined());
+    assert(uwan_is_joined(ctx));
 }
 
 void test_send_uplink_fail()
@@ -305,7 +452,7 @@ void test_send_uplink_fail()
 
     uint8_t pld[223];
 
-    result = uwan_send_frame(f_port, pld, sizeof(pld), confirm);
+    result = uwan_send_frame(ctx, f_port, pld, sizeof(pld), confirm);
     assert(result == UWAN_ERR_MSG_LEN);
 }
 
@@ -315,9 +462,12 @@ void test_send_uplink_successfull()
 
     const uint8_t f_port = 4;
     const bool confirm = false;
+    int blocks_call_count = aes_encrypt_blocks_call_count;
 
-    result = uwan_send_frame(f_port, tx_payload, sizeof(tx_payload), confirm);
+    result = uwan_send_frame(ctx, f_port, tx_payload, sizeof(tx_payload),
+        confirm);
     assert(result == UWAN_ERR_NO);
+    assert(aes_encrypt_blocks_call_count == blocks_call_count + 1);
 
     assert(radio_freq == 868300000);
     assert(radio_bw == UWAN_BW_125);
@@ -336,12 +486,1117 @@ void test_send_uplink_successfull()
     assert(memcmp(uplink, radio_frame, radio_frame_size) == 0);
 }
 
+static void skip_rx_windows(void)
+{
+    radio_dio_irq = RADIO_IRQF_TX_DONE;
+    radio.irq_handler();
+    uwan_timer_callback(ctx, UWAN_TIMER_RX1);
+    radio_dio_irq = RADIO_IRQF_RX_TIMEOUT;
+    radio.irq_handler();
+    uwan_timer_callback(ctx, UWAN_TIMER_RX2);
+    radio.irq_handler();
+}
+
+void test_send_uplink_iov()
+{
+    enum uwan_errs result;
+    const struct uwan_iovec iov[] = {
+        {tx_payload, 1},
+        {tx_payload + 1, 0},
+        {tx_payload + 1, 3},
+    };
+    const uint8_t uplink[] = {
+        0x40, // MHDR
+        0x00, 0x01, 0x02, 0x03, // DevAddr
+        0x00, 0x01, 0x00, // FHDR
+        0x04, // FPort
+        0x07, 0x05, 0x06, 0x07, // Payload
+        0x05, 0x04, 0x04, 0x04, // MIC
+    };
+
+    skip_rx_windows();
+
+    result = uwan_send_frame_iov(ctx, 4, iov, 3, false);
+    assert(result == UWAN_ERR_NO);
+    assert(radio_frame_size == sizeof(uplink));
+    assert(memcmp(uplink, radio_frame, radio_frame_size) == 0);
+}
+
+void test_send_uplink_reserved()
+{
+    enum uwan_errs result;
+    uint8_t *buf;
+    const uint8_t uplink[] = {
+        0x40, // MHDR
+        0x00, 0x01, 0x02, 0x03, // DevAddr
+        0x01, 0x02, 0x00, // FHDR
+        0x02, // FOpts
+        0x04, // FPort
+        0x07, 0x05, 0x06, 0x07, // Payload
+        0x05, 0x04, 0x04, 0x04, // MIC
+    };
+
+    assert(uwan_frame_reserve(ctx, sizeof(tx_payload)) == NULL);
+    assert(uwan_frame_commit(ctx, 4, 0, false) == UWAN_ERR_STATE);
+
+    skip_rx_windows();
+
+    buf = uwan_frame_reserve(ctx, sizeof(tx_payload));
+    assert(buf != NULL);
+    memcpy(buf, tx_payload, sizeof(tx_payload));
+
+    // FOpts grows after reservation, payload must be moved
+    assert(uwan_mac_link_check_req(ctx));
+
+    result = uwan_frame_commit(ctx, 4, sizeof(tx_payload) + 1, false);
+    assert(result == UWAN_ERR_MSG_LEN);
+    result = uwan_frame_commit(ctx, 4, sizeof(tx_payload), false);
+    assert(result == UWAN_ERR_NO);
+    assert(radio_frame_size == sizeof(uplink));
+    assert(memcmp(uplink, radio_frame, radio_frame_size) == 0);
+}
+
+void test_rx_window_clock_error()
+{
+    skip_rx_windows();
+    uwan_set_rx_timing(ctx, 1000, 3000);
+    assert(uwan_send_frame(ctx, 4, tx_payload, 4, false) == UWAN_ERR_NO);
+
+    radio_dio_irq = RADIO_IRQF_TX_DONE;
+    radio.irq_handler();
+
+    // 1 ms drift and 1 ms timer resolution widen SF7 window to 8 symbols
+    assert(app_timer_timeout[UWAN_TIMER_RX1] == 997);
+    uwan_timer_callback(ctx, UWAN_TIMER_RX1);
+    assert(radio_symb_timeout == 8);
+
+    // 2 ms drift doesn't change SF12 window, only wake-up time is applied
+    assert(app_timer_timeout[UWAN_TIMER_RX2] == 2029);
+    radio_dio_irq = RADIO_IRQF_RX_TIMEOUT;
+    radio.irq_handler();
+    uwan_timer_callback(ctx, UWAN_TIMER_RX2);
+    assert(radio_symb_timeout == 6);
+    radio.irq_handler();
+
+    // error over ping slot delay of 72 minutes would wrap around 32 bits
+    uint16_t symb_timeout;
+    uwan_set_rx_timing(ctx, 1000, 0);
+    assert(calc_rx_window(ctx, UWAN_DR_3, 4294968, &symb_timeout) <
+        4294968);
+    assert(symb_timeout == 255);
+
+    uwan_set_rx_timing(ctx, 0, 0);
+}
+
+void test_nb_trans()
+{
+    uint8_t uplink[sizeof(radio_frame)];
+    uint8_t uplink_size;
+    uint32_t f_cnt_up, f_cnt_down, f_cnt_up_prev;
+    int call_count = app_downlink_callback_call_count;
+
+    skip_rx_windows();
+    assert(uwan_set_nb_trans(ctx, 3));
+    uwan_get_f_cnt(ctx, &f_cnt_up_prev, &f_cnt_down);
+
+    assert(uwan_send_frame(ctx, 4, tx_payload, 4, false) == UWAN_ERR_NO);
+    memcpy(uplink, radio_frame, radio_frame_size);
+    uplink_size = radio_frame_size;
+
+    // repetitions are the same frame on another channel
+    for (int i = 0; i < 2; i++) {
+        uint32_t freq = radio_freq;
+        radio_frame_size = 0;
+        skip_rx_windows();
+        assert(app_downlink_callback_call_count == call_count);
+        assert(radio_frame_size == uplink_size);
+        assert(memcmp(uplink, radio_frame, uplink_size) == 0);
+        assert(radio_freq != freq);
+    }
+
+    skip_rx_windows();
+    assert(app_downlink_callback_call_count == call_count + 1);
+    assert(app_err == UWAN_ERR_RX_TIMEOUT);
+    uwan_get_f_cnt(ctx, &f_cnt_up, &f_cnt_down);
+    assert(f_cnt_up == f_cnt_up_prev + 1);
+
+    // the uplink heard back in RX1 isn't a downlink, RX2 is opened
+    assert(uwan_send_frame(ctx, 4, tx_payload, 4, false) == UWAN_ERR_NO);
+    memcpy(uplink, radio_frame, radio_frame_size);
+    radio_dio_irq = RADIO_IRQF_TX_DONE;
+    radio.irq_handler();
+    uwan_timer_callback(ctx, UWAN_TIMER_RX1);
+    radio_dio_irq = RADIO_IRQF_RX_DONE;
+    radio.irq_handler();
+    assert(app_downlink_callback_call_count == call_count + 1);
+    uwan_timer_callback(ctx, UWAN_TIMER_RX2);
+    radio_dio_irq = RADIO_IRQF_RX_TIMEOUT;
+    radio.irq_handler();
+    assert(app_downlink_callback_call_count == call_count + 1);
+    assert(memcmp(uplink, radio_frame, uplink_size) == 0);
+
+    // valid downlink stops repetitions
+    const uint8_t downlink[] = {
+        0x60, // MHDR
+        0x00, 0x01, 0x02, 0x03, // DevAddr
+        0x00, (f_cnt_down + 1) & 0xff, (f_cnt_down + 1) >> 8, // FCtrl, FCnt
+        0x05, 0x04, 0x04, 0x04, // MIC
+    };
+    radio_dio_irq = RADIO_IRQF_TX_DONE;
+    radio.irq_handler();
+    uwan_timer_callback(ctx, UWAN_TIMER_RX1);
+    memcpy(radio_frame, downlink, sizeof(downlink));
+    radio_frame_size = sizeof(downlink);
+    radio_dio_irq = RADIO_IRQF_RX_DONE;
+    radio.irq_handler();
+    assert(app_downlink_callback_call_count == call_count + 2);
+    assert(app_err == UWAN_ERR_NO);
+
+    assert(uwan_set_nb_trans(ctx, 1));
+}
+
+void test_crypto_contexts_reused()
+{
+    enum uwan_errs result;
+    int create_call_count = crypto_create_call_count;
+
+    skip_rx_windows();
+
+    result = uwan_send_frame(ctx, 4, tx_payload, sizeof(tx_payload), false);
+    assert(result == UWAN_ERR_NO);
+    assert(crypto_create_call_count == create_call_count);
+
+    uwan_deinit(ctx);
+    for (int i = 0; i < CRYPTO_CONTEXTS; i++) {
+        assert(aes_contexts[i].in_use == false);
+        assert(cmac_contexts[i].in_use == false);
+    }
+}
+
+void test_uplink_queue()
+{
+    struct uwan_uplink uplink = {
+        .payload = tx_payload,
+        .pld_len = sizeof(tx_payload),
+    };
+    uint8_t id[4];
+
+    ctx = uwan_init(&radio, &app_hal_time, &region_eu868);
+    assert(ctx != NULL);
+    uwan_set_dr(ctx, UWAN_DR_5);
+
+    // uplinks are kept until the stack is joined
+    uplink.f_port = 1;
+    assert(uwan_queue_frame(ctx, &uplink, &id[0]) == UWAN_ERR_NO);
+    assert(app_uplink_callback_call_count == 0);
+
+    // session without crypto contexts isn't usable
+    crypto_exhausted = true;
+    assert(uwan_set_session(ctx, 0x03020100, 0, 0, app_key, app_key) ==
+        UWAN_ERR_CRYPTO);
+    crypto_exhausted = false;
+    assert(!uwan_is_joined(ctx));
+    assert(app_uplink_callback_call_count == 0);
+
+    app_time_ms = 1000;
+    radio_frame_size = 0;
+    assert(uwan_set_session(ctx, 0x03020100, 0, 0, app_key, app_key) ==
+        UWAN_ERR_NO);
+    uplink.f_port = 2;
+    uplink.priority = 0;
+    assert(uwan_queue_frame(ctx, &uplink, &id[1]) == UWAN_ERR_NO);
+    assert(radio_frame_size != 0 && radio_frame[8] == 1);
+
+    uplink.f_port = 3;
+    uplink.priority = 2;
+    assert(uwan_queue_frame(ctx, &uplink, &id[2]) == UWAN_ERR_NO);
+    uplink.f_port = 4;
+    uplink.priority = 1;
+    uplink.lifetime_ms = 100;
+    assert(uwan_queue_frame(ctx, &uplink, &id[3]) == UWAN_ERR_NO);
+    assert(uwan_queue_frame(ctx, &uplink, NULL) == UWAN_ERR_QUEUE_FULL);
+
+    // the first uplink is done, the next one waits for duty cycle
+    app_time_ms += 1000;
+    skip_rx_windows();
+    assert(app_uplink_callback_call_count == 2);
+    assert(app_uplink_ids[0] == id[0] && app_uplink_errs[0] == UWAN_ERR_NO);
+    assert(app_uplink_ids[1] == id[3]);
+    assert(app_uplink_errs[1] == UWAN_ERR_DEADLINE);
+    assert(app_timer_timeout[UWAN_TIMER_TX] != 0);
+    assert(app_timer_timeout[UWAN_TIMER_TX] ==
+        uwan_get_next_tx_delay(ctx));
+
+    app_time_ms += app_timer_timeout[UWAN_TIMER_TX];
+    uwan_timer_callback(ctx, UWAN_TIMER_TX);
+    assert(radio_frame[8] == 3);
+
+    app_time_ms += 10000;
+    skip_rx_windows();
+    assert(app_uplink_callback_call_count == 3);
+    assert(app_uplink_ids[2] == id[2] && app_uplink_errs[2] == UWAN_ERR_NO);
+    assert(radio_frame[8] == 2);
+
+    app_time_ms += 10000;
+    skip_rx_windows();
+    assert(app_uplink_callback_call_count == 4);
+    assert(app_uplink_ids[3] == id[1] && app_uplink_errs[3] == UWAN_ERR_NO);
+
+    // repetition waits for duty cycle, the stack stays busy meanwhile
+    int call_count = app_downlink_callback_call_count;
+    assert(uwan_set_nb_trans(ctx, 2));
+    app_time_ms += 10000;
+    assert(uwan_send_frame(ctx, 5, tx_payload, 4, false) == UWAN_ERR_NO);
+    radio_frame_size = 0;
+    skip_rx_windows();
+    assert(radio_frame_size == 0);
+    assert(app_timer_timeout[UWAN_TIMER_TX] == uwan_get_next_tx_delay(ctx));
+    assert(uwan_send_frame(ctx, 5, tx_payload, 4, false) == UWAN_ERR_STATE);
+
+    app_time_ms += app_timer_timeout[UWAN_TIMER_TX];
+    uwan_timer_callback(ctx, UWAN_TIMER_TX);
+    assert(radio_frame_size != 0 && radio_frame[8] == 5);
+    skip_rx_windows();
+    assert(app_downlink_callback_call_count == call_count + 1);
+    assert(uwan_set_nb_trans(ctx, 1));
+
+    // lifetime ends while the stack is busy with another uplink
+    app_uplink_callback_call_count = 0;
+    app_time_ms += 10000;
+    assert(uwan_send_frame(ctx, 5, tx_payload, 4, false) == UWAN_ERR_NO);
+    uplink.lifetime_ms = 50;
+    assert(uwan_queue_frame(ctx, &uplink, &id[0]) == UWAN_ERR_NO);
+    assert(app_timer_timeout[UWAN_TIMER_QUEUE] == 50);
+    app_time_ms += 50;
+    uwan_timer_callback(ctx, UWAN_TIMER_QUEUE);
+    assert(app_uplink_callback_call_count == 1);
+    assert(app_uplink_ids[0] == id[0]);
+    assert(app_uplink_errs[0] == UWAN_ERR_DEADLINE);
+    skip_rx_windows();
+    assert(app_uplink_callback_call_count == 1);
+}
+
+void test_confirmed_retries()
+{
+    const uint8_t downlink_ack[] = {
+        0x60, // MHDR
+        0x00, 0x01, 0x02, 0x03, // DevAddr
+        0x20, 0x01, 0x00, // FCtrl with ACK, FCnt
+        0x04, 0x05, 0x06, 0x07, // MIC
+    };
+    const struct uwan_uplink uplink = {
+        .f_port = 6,
+        .payload = tx_payload,
+        .pld_len = sizeof(tx_payload),
+        .confirm = true,
+    };
+    int call_count = app_downlink_callback_call_count;
+
+    app_uplink_callback_call_count = 0;
+    assert(uwan_set_confirm_retries(ctx, 16) == false);
+    assert(uwan_set_confirm_retries(ctx, 2));
+
+    app_time_ms += 100000;
+    assert(uwan_queue_frame(ctx, &uplink, NULL) == UWAN_ERR_NO);
+    assert(radio_sf == UWAN_SF_7);
+
+    // the second attempt keeps DR, the third one steps it down
+    for (int i = 0; i < 2; i++) {
+        skip_rx_windows();
+        assert(app_downlink_callback_call_count == call_count);
+        assert(app_timer_timeout[UWAN_TIMER_TX] >= 1000);
+        app_time_ms += 100000;
+        uwan_timer_callback(ctx, UWAN_TIMER_TX);
+        assert(radio_frame[8] == 6);
+        assert(radio_sf == (i ? UWAN_SF_8 : UWAN_SF_7));
+    }
+
+    radio_dio_irq = RADIO_IRQF_TX_DONE;
+    radio.irq_handler();
+    uwan_timer_callback(ctx, UWAN_TIMER_RX1);
+    radio_frame_size = sizeof(downlink_ack);
+    memcpy(radio_frame, downlink_ack, radio_frame_size);
+    radio_dio_irq = RADIO_IRQF_RX_DONE;
+    radio.irq_handler();
+    assert(app_downlink_callback_call_count == call_count + 1);
+    assert(app_err == UWAN_ERR_NO && app_ack);
+    assert(app_uplink_callback_call_count == 1);
+    assert(app_uplink_errs[0] == UWAN_ERR_NO);
+
+    // all attempts are unanswered
+    assert(uwan_set_confirm_retries(ctx, 1));
+    app_time_ms += 100000;
+    assert(uwan_queue_frame(ctx, &uplink, NULL) == UWAN_ERR_NO);
+    skip_rx_windows();
+    app_time_ms += 100000;
+    uwan_timer_callback(ctx, UWAN_TIMER_TX);
+    skip_rx_windows();
+    assert(app_downlink_callback_call_count == call_count + 2);
+    assert(app_err == UWAN_ERR_RX_TIMEOUT && !app_ack);
+    assert(app_uplink_callback_call_count == 2);
+    assert(app_uplink_errs[1] == UWAN_ERR_NO_ACK);
+}
+
+void test_confirmed_retries_large()
+{
+    uint8_t payload[200] = {0};
+
+    // DR3 carries 115 bytes at most, the frame stays at DR4
+    assert(uwan_set_confirm_retries(ctx, 4));
+    app_time_ms += 100000;
+    assert(uwan_send_frame(ctx, 6, payload, sizeof(payload), true) ==
+        UWAN_ERR_NO);
+    assert(radio_sf == UWAN_SF_7);
+
+    for (int i = 0; i < 4; i++) {
+        skip_rx_windows();
+        app_time_ms += 100000;
+        uwan_timer_callback(ctx, UWAN_TIMER_TX);
+        assert(radio_frame_size == 8 + 1 + sizeof(payload) + 4);
+        assert(radio_sf == (i ? UWAN_SF_8 : UWAN_SF_7));
+    }
+
+    skip_rx_windows();
+    assert(app_err == UWAN_ERR_RX_TIMEOUT && !app_ack);
+    assert(uwan_set_confirm_retries(ctx, 1));
+}
+
+static void fire_rx1_timer(void)
+{
+    radio_setup_hook = NULL;
+    uwan_timer_callback(ctx, UWAN_TIMER_RX1);
+    // the window isn't opened before the radio is ready
+    assert(radio_symb_timeout == 0);
+}
+
+static void skip_rx_windows_deferred(void)
+{
+    radio_dio_irq = RADIO_IRQF_RX_TIMEOUT;
+    radio.irq_handler();
+    uwan_process(ctx);
+    uwan_timer_callback(ctx, UWAN_TIMER_RX2);
+    radio.irq_handler();
+    uwan_process(ctx);
+}
+
+void test_deferred()
+{
+    int call_count = app_downlink_callback_call_count;
+    int event_count = app_event_callback_call_count;
+
+    uwan_set_deferred(ctx, true);
+    app_time_ms += 100000;
+    assert(uwan_send_frame(ctx, 7, tx_payload, 4, false) == UWAN_ERR_NO);
+
+    app_timer_timeout[UWAN_TIMER_RX1] = 0;
+    radio_dio_irq = RADIO_IRQF_TX_DONE;
+    radio.irq_handler();
+    assert(app_event_callback_call_count == event_count + 1);
+    assert(app_timer_timeout[UWAN_TIMER_RX1] == 0);
+
+    // RX windows are still counted from TX done
+    app_time_ms += 300;
+    uwan_process(ctx);
+    assert(app_timer_timeout[UWAN_TIMER_RX1] == 1001 - 300);
+    assert(app_timer_timeout[UWAN_TIMER_RX2] == 2032 - 300);
+    uwan_process(ctx);
+
+    // RX windows are opened in the timer interrupt, uwan_process runs late
+    radio_symb_timeout = 0;
+    app_time_ms += 1001 - 300;
+    uwan_timer_callback(ctx, UWAN_TIMER_RX1);
+    assert(radio_symb_timeout != 0);
+    assert(app_event_callback_call_count == event_count + 1);
+
+    radio_dio_irq = RADIO_IRQF_RX_TIMEOUT;
+    radio.irq_handler();
+    radio_symb_timeout = 0;
+    app_time_ms += 1031;
+    uwan_timer_callback(ctx, UWAN_TIMER_RX2);
+    assert(radio_symb_timeout == 0);
+
+    // RX2 timer is queued behind the end of RX1 and opens the window then
+    uwan_process(ctx);
+    assert(radio_symb_timeout != 0);
+    radio.irq_handler();
+    assert(app_event_callback_call_count == event_count + 4);
+    assert(app_downlink_callback_call_count == call_count);
+    uwan_process(ctx);
+    assert(app_downlink_callback_call_count == call_count + 1);
+    assert(app_err == UWAN_ERR_RX_TIMEOUT);
+
+    // RX1 timer expires while late uwan_process still sets up the radio
+    app_time_ms += 100000;
+    assert(uwan_send_frame(ctx, 7, tx_payload, 4, false) == UWAN_ERR_NO);
+    radio_dio_irq = RADIO_IRQF_TX_DONE;
+    radio.irq_handler();
+    app_time_ms += 2000;
+    radio_symb_timeout = 0;
+    radio_inverted_iq = false;
+    radio_setup_hook = fire_rx1_timer;
+    uwan_process(ctx);
+    assert(radio_setup_hook == NULL);
+    assert(radio_symb_timeout != 0 && radio_inverted_iq);
+    skip_rx_windows_deferred();
+
+    // repeated events are merged, the end of TX doesn't overflow the ring
+    app_time_ms += 100000;
+    assert(uwan_send_frame(ctx, 7, tx_payload, 4, false) == UWAN_ERR_NO);
+    for (int i = 0; i < 2 * UWAN_EVENT_RING_SIZE; i++)
+        uwan_timer_callback(ctx, UWAN_TIMER_QUEUE);
+    radio_dio_irq = RADIO_IRQF_TX_DONE;
+    radio.irq_handler();
+    radio.irq_handler();
+    app_timer_timeout[UWAN_TIMER_RX1] = 0;
+    uwan_process(ctx);
+    assert(app_timer_timeout[UWAN_TIMER_RX1] == 1001);
+    skip_rx_windows_deferred();
+
+    uwan_set_deferred(ctx, false);
+}
+
+void test_session_snapshot()
+{
+    uint8_t snapshot[UWAN_SESSION_SNAPSHOT_SIZE];
+    uint32_t f_cnt_up, f_cnt_down;
+    const uint8_t uplink_hdr[] = {
+        0x40, // MHDR
+        0x00, 0x01, 0x02, 0x03, // DevAddr
+        0x00, 0x40, 0x00, // FCtrl, FCnt
+    };
+
+    // all uplinks so far fit into the first reservation
+    uwan_get_f_cnt(ctx, &f_cnt_up, &f_cnt_down);
+    assert(app_nvm_call_count == 1);
+    assert(app_nvm_f_cnt == 64 && f_cnt_up < app_nvm_f_cnt);
+
+    for (uint8_t i = 0; i < 3; i++)
+        assert(uwan_set_dl_channel(ctx, i, 868900000) == UWAN_ERR_NO);
+    assert(uwan_session_save(ctx, snapshot, sizeof(snapshot) - 1) == 0);
+    assert(uwan_session_save(ctx, snapshot, sizeof(snapshot)) ==
+        sizeof(snapshot));
+    for (uint8_t i = 0; i < 3; i++)
+        assert(uwan_set_channel(ctx, i, 868100000 + i * 200000) ==
+            UWAN_ERR_NO);
+
+    uwan_set_session(ctx, 0x11111111, 0, 0, dev_eui, dev_eui);
+    snapshot[2] ^= 1;
+    assert(uwan_session_restore(ctx, snapshot, sizeof(snapshot), 0) ==
+        UWAN_ERR_SNAPSHOT);
+    snapshot[2] ^= 1;
+    assert(uwan_session_restore(ctx, snapshot, 10, 0) == UWAN_ERR_MSG_LEN);
+
+    crypto_exhausted = true;
+    assert(uwan_session_restore(ctx, snapshot, sizeof(snapshot), 0) ==
+        UWAN_ERR_CRYPTO);
+    crypto_exhausted = false;
+    assert(!uwan_is_joined(ctx));
+
+    // device has been reset after the counter limit was stored
+    assert(uwan_session_restore(ctx, snapshot, sizeof(snapshot),
+        app_nvm_f_cnt) == UWAN_ERR_NO);
+    uwan_get_f_cnt(ctx, &f_cnt_up, &f_cnt_down);
+    assert(f_cnt_up == 64 && f_cnt_down == 1);
+
+    app_time_ms += 100000;
+    assert(uwan_send_frame(ctx, 4, tx_payload, 4, false) == UWAN_ERR_NO);
+    assert(memcmp(uplink_hdr, radio_frame, sizeof(uplink_hdr)) == 0);
+    assert(app_nvm_call_count == 2 && app_nvm_f_cnt == 128);
+
+    // RX1 frequencies of DlChannelReq are restored too
+    radio_dio_irq = RADIO_IRQF_TX_DONE;
+    radio.irq_handler();
+    assert(radio_freq == 868900000);
+    uwan_timer_callback(ctx, UWAN_TIMER_RX1);
+    radio_dio_irq = RADIO_IRQF_RX_TIMEOUT;
+    radio.irq_handler();
+    uwan_timer_callback(ctx, UWAN_TIMER_RX2);
+    radio.irq_handler();
+
+    for (uint8_t i = 0; i < 3; i++)
+        assert(uwan_set_channel(ctx, i, 868100000 + i * 200000) ==
+            UWAN_ERR_NO);
+}
+
+void test_class_c()
+{
+    const uint8_t downlink[] = {
+        0x60, // MHDR
+        0x00, 0x01, 0x02, 0x03, // DevAddr
+        0x00, 0x02, 0x00, // FCtrl, FCnt
+        0x04, 0x05, 0x06, 0x07, // MIC
+    };
+    int call_count = app_downlink_callback_call_count;
+    int sleep_count;
+
+    // RX2 is opened right away
+    radio_sf = UWAN_SF_7;
+    assert(uwan_set_class(ctx, UWAN_CLASS_C));
+    assert(radio_sf == UWAN_SF_12);
+    assert(radio_rx_timeout == UWAN_RX_INFINITE);
+
+    radio_rx_timeout = 0;
+    radio_frame_size = sizeof(downlink);
+    memcpy(radio_frame, downlink, radio_frame_size);
+    radio_dio_irq = RADIO_IRQF_RX_DONE;
+    radio.irq_handler();
+    assert(app_downlink_callback_call_count == call_count + 1);
+    assert(app_err == UWAN_ERR_NO);
+    assert(app_m_type == UWAN_MTYPE_UNCONF_DATA_DOWN);
+    assert(radio_rx_timeout == UWAN_RX_INFINITE);
+
+    // noise and replayed frames aren't reported
+    radio.irq_handler();
+    radio_dio_irq = RADIO_IRQF_RX_DONE | RADIO_IRQF_CRC_ERROR;
+    radio.irq_handler();
+    assert(app_downlink_callback_call_count == call_count + 1);
+
+    // uplink preempts reception, it's resumed after RX2
+    sleep_count = radio_sleep_call_count;
+    app_time_ms += 100000;
+    assert(uwan_send_frame(ctx, 4, tx_payload, 4, false) == UWAN_ERR_NO);
+    assert(radio_sleep_call_count == sleep_count + 1);
+    assert(radio_sf == UWAN_SF_7);
+    skip_rx_windows();
+    assert(app_downlink_callback_call_count == call_count + 2);
+    assert(radio_sf == UWAN_SF_12);
+    assert(radio_rx_timeout == UWAN_RX_INFINITE);
+
+    sleep_count = radio_sleep_call_count;
+    assert(uwan_set_class(ctx, UWAN_CLASS_A));
+    assert(radio_sleep_call_count == sleep_count + 1);
+}
+
+static void receive_frame(const uint8_t *frame, uint8_t size)
+{
+    radio_frame_size = size;
+    memcpy(radio_frame, frame, size);
+    radio_dio_irq = RADIO_IRQF_RX_DONE;
+    radio.irq_handler();
+}
+
+/* test AES is XOR with key, so FRMPayload is plain text XOR A block XOR key */
+static void encrypt_downlink(uint8_t *pld, uint8_t size, uint32_t dev_addr,
+    uint32_t f_cnt, const uint8_t *key)
+{
+    uint8_t a_block[16] = {
+        0x01, 0x00, 0x00, 0x00, 0x00, 0x01,
+        dev_addr, dev_addr >> 8, dev_addr >> 16, dev_addr >> 24,
+        f_cnt, f_cnt >> 8, f_cnt >> 16, f_cnt >> 24, 0x00, 0x01,
+    };
+
+    for (int i = 0; i < size; i++)
+        pld[i] ^= a_block[i] ^ key[i];
+}
+
+void test_multicast()
+{
+    const uint8_t mc_nwk_s_key[16] = {0xa0, 0xa1, 0xa2, 0xa3};
+    const uint8_t mc_app_s_key[16] = {0xb0, 0xb1, 0xb2, 0xb3};
+    const uint8_t gen_app_key[16] = {0x11, 0x22, 0x33, 0x44, 0x55};
+    const uint8_t mc_key_encrypted[16] = {0x01, 0x02, 0x03, 0x04, 0x05};
+    uint8_t downlink[] = {
+        0x60, // MHDR
+        0x44, 0x33, 0x22, 0x11, // DevAddr
+        0x00, 0x05, 0x00, // FCtrl, FCnt
+        0x02, 0x01, 0x02, 0x03, // FPort, FRMPayload
+        0xa0, 0xa1, 0xa2, 0xa3, // MIC
+    };
+    const uint8_t plain[] = {0x01, 0x02, 0x03};
+    int call_count = app_downlink_callback_call_count;
+    uint32_t mc_addr;
+
+    assert(!uwan_mc_set_group(ctx, 4, 0x11223344, mc_nwk_s_key,
+        mc_app_s_key, 0, 10));
+    assert(!uwan_mc_set_group(ctx, 0, 0x03020100, mc_nwk_s_key,
+        mc_app_s_key, 0, 10));
+    assert(uwan_mc_set_group(ctx, 2, 0x11223344, mc_nwk_s_key,
+        mc_app_s_key, 5, 10));
+    assert(uwan_mc_set_group(ctx, 0, 0x01000000, mc_nwk_s_key,
+        mc_app_s_key, 0, 10));
+    assert(!uwan_mc_set_group(ctx, 1, 0x11223344, mc_nwk_s_key,
+        mc_app_s_key, 0, 10));
+    assert(uwan_mc_get_group(ctx, 2, &mc_addr) && mc_addr == 0x11223344);
+    assert(!uwan_mc_get_group(ctx, 1, &mc_addr));
+
+    // group isn't left with the keys of its previous session
+    crypto_exhausted = true;
+    assert(!uwan_mc_set_group(ctx, 0, 0x01000000, mc_nwk_s_key,
+        mc_app_s_key, 0, 10));
+    assert(!uwan_mc_set_gen_app_key(ctx, gen_app_key));
+    crypto_exhausted = false;
+    assert(!uwan_mc_get_group(ctx, 0, &mc_addr));
+    assert(uwan_mc_set_group(ctx, 0, 0x01000000, mc_nwk_s_key,
+        mc_app_s_key, 0, 10));
+
+    assert(uwan_set_class(ctx, UWAN_CLASS_C));
+
+    encrypt_downlink(&downlink[9], 3, 0x11223344, 5, mc_app_s_key);
+    receive_frame(downlink, sizeof(downlink));
+    assert(app_downlink_callback_call_count == call_count + 1);
+    assert(app_multicast && app_mc_group == 2);
+    assert(memcmp(app_pld, plain, sizeof(plain)) == 0);
+
+    // replayed frame, frame above FCnt range and unknown address
+    receive_frame(downlink, sizeof(downlink));
+    downlink[6] = 0x0b;
+    receive_frame(downlink, sizeof(downlink));
+    downlink[1] = 0x45;
+    receive_frame(downlink, sizeof(downlink));
+    assert(app_downlink_callback_call_count == call_count + 1);
+
+    // confirmed frames aren't accepted by groups
+    downlink[0] = 0xa0;
+    downlink[1] = 0x44;
+    downlink[6] = 0x06;
+    receive_frame(downlink, sizeof(downlink));
+    assert(app_downlink_callback_call_count == call_count + 1);
+
+    // unicast frames are still received
+    const uint8_t unicast[] = {
+        0x60, // MHDR
+        0x00, 0x01, 0x02, 0x03, // DevAddr
+        0x00, 0x10, 0x00, // FCtrl, FCnt
+        0x04, 0x05, 0x06, 0x07, // MIC
+    };
+    receive_frame(unicast, sizeof(unicast));
+    assert(app_downlink_callback_call_count == call_count + 2);
+    assert(!app_multicast);
+
+    // test AES makes McKEKey equal to GenAppKey
+    assert(!uwan_mc_setup_group(ctx, 2, 0x11223344, mc_key_encrypted, 0, 10));
+    assert(uwan_mc_set_gen_app_key(ctx, gen_app_key));
+    assert(uwan_mc_setup_group(ctx, 2, 0x11223344, mc_key_encrypted, 0, 10));
+
+    uint8_t mc_key[16];
+    uint8_t nwk_s_key[16] = {0x02, 0x44, 0x33, 0x22, 0x11};
+    uint8_t app_s_key[16] = {0x01, 0x44, 0x33, 0x22, 0x11};
+    for (int i = 0; i < 16; i++) {
+        mc_key[i] = mc_key_encrypted[i] ^ gen_app_key[i];
+        nwk_s_key[i] ^= mc_key[i];
+        app_s_key[i] ^= mc_key[i];
+    }
+
+    downlink[0] = 0x60;
+    downlink[6] = 0x01;
+    memcpy(&downlink[9], plain, sizeof(plain));
+    encrypt_downlink(&downlink[9], 3, 0x11223344, 1, app_s_key);
+    memcpy(&downlink[12], nwk_s_key, 4);
+    receive_frame(downlink, sizeof(downlink));
+    assert(app_downlink_callback_call_count == call_count + 3);
+    assert(app_multicast && app_mc_group == 2);
+    assert(memcmp(app_pld, plain, sizeof(plain)) == 0);
+
+    assert(uwan_mc_delete_group(ctx, 2));
+    assert(!uwan_mc_delete_group(ctx, 2));
+    downlink[6] = 0x02;
+    receive_frame(downlink, sizeof(downlink));
+    assert(app_downlink_callback_call_count == call_count + 3);
+
+    assert(uwan_mc_delete_group(ctx, 0));
+    assert(uwan_set_class(ctx, UWAN_CLASS_A));
+}
+
+void test_dl_channel()
+{
+    for (uint8_t i = 0; i < 3; i++)
+        assert(uwan_set_dl_channel(ctx, i, 868900000) == UWAN_ERR_NO);
+    assert(uwan_set_dl_channel(ctx, 3, 868900000) == UWAN_ERR_CHANNEL);
+
+    // RX1 is tuned to the downlink frequency, RX2 keeps its own
+    app_time_ms += 100000;
+    assert(uwan_send_frame(ctx, 4, tx_payload, 4, false) == UWAN_ERR_NO);
+    assert(radio_freq != 868900000);
+    radio_dio_irq = RADIO_IRQF_TX_DONE;
+    radio.irq_handler();
+    assert(radio_freq == 868900000);
+    uwan_timer_callback(ctx, UWAN_TIMER_RX1);
+    radio_dio_irq = RADIO_IRQF_RX_TIMEOUT;
+    radio.irq_handler();
+    assert(radio_freq != 868900000);
+    uwan_timer_callback(ctx, UWAN_TIMER_RX2);
+    radio.irq_handler();
+
+    assert(uwan_set_channel(ctx, 0, 868100000) == UWAN_ERR_NO);
+    assert(uwan_set_channel(ctx, 1, 868300000) == UWAN_ERR_NO);
+    assert(uwan_set_channel(ctx, 2, 868500000) == UWAN_ERR_NO);
+}
+
+void test_mac_overflow()
+{
+    uint8_t downlink[] = {
+        0x60, // MHDR
+        0x00, 0x01, 0x02, 0x03, // DevAddr
+        0x0f, 0x11, 0x00, // FCtrl, FCnt
+        0x06, 0x06, 0x06, 0x06, 0x06, // FOpts with DevStatusReq
+        0x06, 0x06, 0x06, 0x06, 0x06,
+        0x06, 0x06, 0x06, 0x06, 0x06,
+        0x04, 0x05, 0x06, 0x07, // MIC
+    };
+    const struct uwan_uplink uplink = {
+        .f_port = 4,
+        .payload = tx_payload,
+        .pld_len = sizeof(tx_payload),
+    };
+
+    app_time_ms += 100000;
+    assert(uwan_send_frame(ctx, 4, tx_payload, 4, false) == UWAN_ERR_NO);
+    radio_dio_irq = RADIO_IRQF_TX_DONE;
+    radio.irq_handler();
+    uwan_timer_callback(ctx, UWAN_TIMER_RX1);
+    receive_frame(downlink, sizeof(downlink));
+
+    // 45 bytes of answers don't fit FOpts, application has to wait
+    assert(uwan_get_max_payload_size(ctx) == 0);
+    app_time_ms += 100000;
+    assert(uwan_send_frame(ctx, 4, tx_payload, 4, false) ==
+        UWAN_ERR_MSG_LEN);
+    assert(uwan_send_frame(ctx, 0, NULL, 0, false) == UWAN_ERR_NO);
+    assert(radio_frame_size == 8 + 1 + 45 + 4);
+    assert((radio_frame[5] & 0x0f) == 0 && radio_frame[8] == 0);
+    // NwkSKey starts with 04 05 06 07, DevStatusAns with CID 06
+    assert(radio_frame[9] == (0x06 ^ 0x01 ^ 0x04));
+    assert(radio_frame[12] == (0x06 ^ 0x00 ^ 0x07));
+    assert(uwan_get_max_payload_size(ctx) != 0);
+
+    // queued uplink flushes answers first and follows them
+    skip_rx_windows();
+    downlink[6] = 0x12;
+    app_time_ms += 100000;
+    assert(uwan_send_frame(ctx, 4, tx_payload, 4, false) == UWAN_ERR_NO);
+    radio_dio_irq = RADIO_IRQF_TX_DONE;
+    radio.irq_handler();
+    uwan_timer_callback(ctx, UWAN_TIMER_RX1);
+    receive_frame(downlink, sizeof(downlink));
+
+    app_uplink_callback_call_count = 0;
+    app_time_ms += 100000;
+    assert(uwan_queue_frame(ctx, &uplink, NULL) == UWAN_ERR_NO);
+    assert(radio_frame[8] == 0);
+    app_time_ms += 100000;
+    skip_rx_windows();
+    assert(app_uplink_callback_call_count == 0);
+    assert(radio_frame[8] == 4 && (radio_frame[5] & 0x0f) == 0);
+    skip_rx_windows();
+    assert(app_uplink_callback_call_count == 1);
+    assert(app_uplink_errs[0] == UWAN_ERR_NO);
+}
+
+void test_class_b()
+{
+    const uint8_t beacon[17] = {
+        0x00, 0x00, // RFU
+        0x00, 0x05, 0x00, 0x00, // Time
+        0xf0, 0xeb, // CRC
+    };
+    const uint8_t downlink[] = {
+        0x60, // MHDR
+        0x00, 0x01, 0x02, 0x03, // DevAddr
+        0x00, 0x03, 0x00, // FCtrl, FCnt
+        0x04, 0x05, 0x06, 0x07, // MIC
+    };
+    const struct uwan_packet_params beacon_params = {
+        .sf = UWAN_SF_9,
+        .bw = UWAN_BW_125,
+        .cr = UWAN_CR_4_5,
+        .preamble_len = 10,
+        .crc_on = false,
+        .implicit_header = true,
+    };
+    uint32_t beacon_toa = uwan_time_on_air_params(&beacon_params, 17) / 1000;
+    int call_count = app_downlink_callback_call_count;
+    uint32_t beacon_start;
+    uint16_t symb_timeout;
+
+    assert(uwan_set_ping_slot_periodicity(ctx, 8) == false);
+    assert(uwan_set_ping_slot_periodicity(ctx, 7));
+    uwan_set_rx_timing(ctx, 100, 0);
+
+    // ping slot offset needs AES context
+    crypto_exhausted = true;
+    assert(uwan_set_class(ctx, UWAN_CLASS_B) == false);
+    crypto_exhausted = false;
+
+    // without network time a whole beacon period is searched
+    assert(uwan_set_class(ctx, UWAN_CLASS_B));
+    assert(app_timer_timeout[UWAN_TIMER_BEACON] == 0);
+    uwan_timer_callback(ctx, UWAN_TIMER_BEACON);
+    assert(radio_freq == 869525000 && radio_sf == UWAN_SF_9);
+    assert(radio_rx_timeout == UWAN_RX_INFINITE);
+    assert(app_timer_timeout[UWAN_TIMER_BEACON] > 128000);
+
+    app_time_ms += 50000;
+    receive_frame(beacon, sizeof(beacon));
+    beacon_start = app_time_ms - beacon_toa;
+    assert(app_beacon_call_count == 1);
+    assert(app_beacon_err == UWAN_ERR_NO && app_beacon_time == 1280);
+
+    // zero key of the stub keeps the block, offset is 1280 slots, windows
+    // are centered on the 4th preamble symbol
+    uint32_t ping_slot = 2120 + 1280 * 30 - beacon_toa;
+    assert(app_timer_timeout[UWAN_TIMER_PING_SLOT] <= ping_slot + 5);
+    assert(app_timer_timeout[UWAN_TIMER_PING_SLOT] > ping_slot - 100);
+    assert(app_timer_timeout[UWAN_TIMER_BEACON] <= 128005 - beacon_toa);
+
+    app_time_ms += app_timer_timeout[UWAN_TIMER_PING_SLOT];
+    uwan_timer_callback(ctx, UWAN_TIMER_PING_SLOT);
+    assert(radio_rx_timeout == 0 && radio_symb_timeout >= 6);
+    receive_frame(downlink, sizeof(downlink));
+    assert(app_downlink_callback_call_count == call_count + 1);
+    assert(app_err == UWAN_ERR_NO);
+
+    // uplinks carry Class B bit
+    assert(uwan_send_frame(ctx, 4, tx_payload, 4, false) == UWAN_ERR_NO);
+    assert(radio_frame[5] & 0x10);
+    skip_rx_windows();
+
+    // window is widened with every missed beacon
+    app_time_ms = beacon_start + 128000 - 200;
+    uwan_timer_callback(ctx, UWAN_TIMER_BEACON);
+    assert(radio_rx_timeout == 0);
+    symb_timeout = radio_symb_timeout;
+    radio_dio_irq = RADIO_IRQF_RX_TIMEOUT;
+    radio.irq_handler();
+    assert(app_beacon_err == UWAN_ERR_RX_TIMEOUT);
+    assert(app_beacon_time == 1280 + 128);
+
+    app_time_ms += app_timer_timeout[UWAN_TIMER_BEACON];
+    uwan_timer_callback(ctx, UWAN_TIMER_BEACON);
+    assert(radio_symb_timeout > symb_timeout);
+
+    // class A is back after 2 hours without beacon
+    for (int i = 0; i < 55; i++) {
+        radio.irq_handler();
+        app_time_ms += app_timer_timeout[UWAN_TIMER_BEACON];
+        uwan_timer_callback(ctx, UWAN_TIMER_BEACON);
+    }
+    assert(app_beacon_call_count == 57);
+    assert(app_beacon_err == UWAN_ERR_RX_TIMEOUT);
+    radio.irq_handler();
+    assert(app_beacon_err == UWAN_ERR_NO_BEACON);
+
+    app_time_ms += 100000;
+    assert(uwan_send_frame(ctx, 4, tx_payload, 4, false) == UWAN_ERR_NO);
+    assert((radio_frame[5] & 0x10) == 0);
+    skip_rx_windows();
+
+    // network time is known from the last beacon
+    assert(uwan_set_class(ctx, UWAN_CLASS_B));
+    assert((app_time_ms + app_timer_timeout[UWAN_TIMER_BEACON] + 100 -
+        beacon_start) % 128000 == 0);
+    app_time_ms += app_timer_timeout[UWAN_TIMER_BEACON];
+    uwan_timer_callback(ctx, UWAN_TIMER_BEACON);
+    assert(radio_rx_timeout == UWAN_RX_INFINITE);
+    assert(app_timer_timeout[UWAN_TIMER_BEACON] == 200 + beacon_toa);
+    uwan_timer_callback(ctx, UWAN_TIMER_BEACON);
+    assert(app_beacon_err == UWAN_ERR_NO_BEACON);
+
+    uwan_set_rx_timing(ctx, 0, 0);
+}
+
+void test_join_procedure()
+{
+    int call_count = app_downlink_callback_call_count;
+
+    ctx = uwan_init(&radio, &app_hal_time, &region_eu868);
+    assert(ctx != NULL);
+    uwan_set_dr(ctx, UWAN_DR_5);
+    assert(uwan_join_start(ctx, 3) == UWAN_ERR_STATE);
+
+    uwan_set_otaa_keys(ctx, dev_eui, app_eui, app_key);
+    assert(uwan_join_start(ctx, 3) == UWAN_ERR_NO);
+    assert(radio_sf == UWAN_SF_7);
+    assert(uwan_join(ctx) == UWAN_ERR_STATE);
+
+    // the next attempts go slower over another channel
+    for (int i = 0; i < 2; i++) {
+        uint32_t freq = radio_freq;
+
+        skip_rx_windows();
+        assert(app_downlink_callback_call_count == call_count);
+        // 1% during the first hour
+        assert(app_timer_timeout[UWAN_TIMER_TX] >=
+            uwan_time_on_air(UWAN_DR_5 - i, 23) / 10);
+        app_time_ms += app_timer_timeout[UWAN_TIMER_TX];
+        uwan_timer_callback(ctx, UWAN_TIMER_TX);
+        assert(radio_sf == UWAN_SF_8 + i);
+        assert(radio_freq != freq);
+    }
+
+    skip_rx_windows();
+    assert(app_downlink_callback_call_count == call_count + 1);
+    assert(app_err == UWAN_ERR_RX_TIMEOUT);
+    assert(!uwan_is_joined(ctx));
+
+    // 0.1% during the next 10 hours
+    app_time_ms += 2 * 3600000;
+    assert(uwan_join_start(ctx, 2) == UWAN_ERR_NO);
+    skip_rx_windows();
+    assert(app_timer_timeout[UWAN_TIMER_TX] >=
+        uwan_time_on_air(UWAN_DR_5, 23));
+    assert(uwan_join(ctx) == UWAN_ERR_STATE);
+
+    app_time_ms += app_timer_timeout[UWAN_TIMER_TX];
+    uwan_timer_callback(ctx, UWAN_TIMER_TX);
+    skip_rx_windows();
+    assert(app_downlink_callback_call_count == call_count + 2);
+
+    uwan_deinit(ctx);
+}
+
+static void receive_join_accept()
+{
+    radio_dio_irq = RADIO_IRQF_TX_DONE;
+    radio.irq_handler();
+    uwan_timer_callback(ctx, UWAN_TIMER_RX1);
+
+    radio_frame_size = sizeof(join_accept);
+    memcpy(radio_frame, join_accept, radio_frame_size);
+    radio_dio_irq = RADIO_IRQF_RX_DONE;
+    radio.irq_handler();
+
+    // rejected frame doesn't close the receive windows
+    if (!uwan_is_joined(ctx)) {
+        uwan_timer_callback(ctx, UWAN_TIMER_RX2);
+        radio_dio_irq = RADIO_IRQF_RX_TIMEOUT;
+        radio.irq_handler();
+    }
+}
+
+void test_join_nonces()
+{
+    ctx = uwan_init(&radio, &app_hal_time, &region_eu868);
+    assert(ctx != NULL);
+    uwan_set_dr(ctx, UWAN_DR_5);
+    uwan_set_otaa_keys(ctx, dev_eui, app_eui, app_key);
+
+    // DevNonce is stored before it goes on air
+    uwan_set_join_nonces(ctx, 0x1234, 0x030202);
+    assert(uwan_join(ctx) == UWAN_ERR_NO);
+    assert(radio_frame[17] == 0x34 && radio_frame[18] == 0x12);
+    assert(app_nvm_dev_nonce == 0x1235);
+    assert(app_nvm_join_nonce == 0x030202);
+
+    // JoinNonce 0x030201 has been used already
+    receive_join_accept();
+    assert(app_err == UWAN_ERR_JOIN_NONCE);
+    assert(!uwan_is_joined(ctx));
+
+    // accept can't be checked without CMAC context, JoinNonce isn't used
+    app_time_ms += 60000;
+    uwan_set_join_nonces(ctx, app_nvm_dev_nonce, 0x030201);
+    assert(uwan_join(ctx) == UWAN_ERR_NO);
+    crypto_exhausted = true;
+    receive_join_accept();
+    crypto_exhausted = false;
+    assert(app_err == UWAN_ERR_CRYPTO);
+    assert(!uwan_is_joined(ctx));
+    assert(app_nvm_join_nonce == 0x030201);
+
+    app_time_ms += 60000;
+    assert(uwan_join(ctx) == UWAN_ERR_NO);
+    assert(radio_frame[17] == 0x36 && radio_frame[18] == 0x12);
+    receive_join_accept();
+    assert(app_err == UWAN_ERR_NO);
+    assert(uwan_is_joined(ctx));
+    assert(app_nvm_dev_nonce == 0x1237);
+    assert(app_nvm_join_nonce == 0x030202);
+
+    // all DevNonces are used up
+    app_time_ms += 60000;
+    uwan_set_join_nonces(ctx, 0x10000, app_nvm_join_nonce);
+    assert(uwan_join(ctx) == UWAN_ERR_DEV_NONCE);
+
+    uwan_deinit(ctx);
+}
+
+void test_time_on_air()
+{
+    enum {
+        T_SYM_SF7 = UWAN_SYMBOL_TIME_US(UWAN_SF_7, UWAN_BW_125),
+        T_SYM_SF12 = UWAN_SYMBOL_TIME_US(UWAN_SF_12, UWAN_BW_125),
+    };
+    struct uwan_packet_params params = {
+        .sf = UWAN_SF_9,
+        .bw = UWAN_BW_500,
+        .cr = UWAN_CR_4_8,
+        .preamble_len = 8,
+        .crc_on = false,
+        .implicit_header = true,
+    };
+
+    assert(T_SYM_SF7 == 1024);
+    assert(T_SYM_SF12 == 32768);
+
+    // 10 bytes of application payload plus 13 bytes of overhead
+    assert(uwan_time_on_air(UWAN_DR_5, 23) == 61696);
+    assert(uwan_time_on_air(UWAN_DR_0, 18) == 1318912);
+    assert(uwan_time_on_air(UWAN_DR_0, 23) == 1482752);
+    assert(uwan_time_on_air(UWAN_DR_COUNT, 23) == 0);
+
+    assert(uwan_time_on_air_params(&params, 0) == 20736);
+    assert(uwan_time_on_air_params(&params, 10) == 37120);
+}
+
+#ifdef UWAN_TEST_BUILTIN_CRYPTO
+static const struct stack_hal builtin_crypto_hal = {
+    .start_timer = app_start_timer,
+    .stop_timer = app_stop_timer,
+    .downlink_callback = app_downlink_callback,
+    .get_time_ms = app_get_time_ms,
+    UWAN_CRYPTO_HAL,
+};
+
+/* built-in pools fit the session, all groups and class B of an instance */
+void test_builtin_crypto()
+{
+    const uint8_t mc_key[16] = {0xa0, 0xa1, 0xa2, 0xa3};
+    void *spare[64];
+    int spare_count = 0;
+    uint32_t mc_addr;
+
+    ctx = uwan_init(&radio, &builtin_crypto_hal, &region_eu868);
+    assert(ctx != NULL);
+    uwan_set_otaa_keys(ctx, dev_eui, app_eui, app_key);
+    uwan_set_session(ctx, 0x03020100, 0, 0, app_key, app_key);
+
+    assert(uwan_mc_set_group(ctx, 0, 0x01000000, mc_key, mc_key, 0, 10));
+    assert(uwan_mc_set_gen_app_key(ctx, app_key));
+    for (uint8_t id = 1; id < 4; id++) {
+        assert(uwan_mc_setup_group(ctx, id, 0x01000000 + id, mc_key, 0,
+            10));
+    }
+    assert(uwan_set_class(ctx, UWAN_CLASS_B));
+    assert(uwan_set_class(ctx, UWAN_CLASS_A));
+    assert(uwan_set_class(ctx, UWAN_CLASS_B));
+
+    // the spare contexts are taken by someone else
+    while (spare_count < 64 &&
+        (spare[spare_count] = uwan_crypto_aes_create_context(mc_key)))
+        spare_count++;
+    assert(spare_count > 0 && spare_count < 64);
+    assert(!uwan_mc_setup_group(ctx, 3, 0x01000003, mc_key, 0, 10));
+    assert(!uwan_mc_get_group(ctx, 3, &mc_addr));
+    while (spare_count > 0)
+        uwan_crypto_aes_delete_context(spare[--spare_count]);
+
+    assert(uwan_mc_set_gen_app_key(ctx, app_key));
+    assert(uwan_mc_setup_group(ctx, 3, 0x01000003, mc_key, 0, 10));
+    assert(uwan_mc_get_group(ctx, 3, &mc_addr) && mc_addr == 0x01000003);
+
+    uwan_deinit(ctx);
+}
+#endif
+
 int main()
 {
-    uwan_init(&radio, &app_hal, &region_eu868);
-    uwan_set_dr(UWAN_DR_5);
-    uwan_set_tx_power(1);
+    ctx = uwan_init(&radio, &app_hal, &region_eu868);
+    assert(ctx != NULL);
+    assert(uwan_init(&radio, &app_hal, &region_eu868) == NULL);
+    uwan_set_dr(ctx, UWAN_DR_5);
+    uwan_set_tx_power(ctx, 1);
 
+    test_time_on_air();
     test_join_successfull();
     test_send_uplink_fail();
     test_send_uplink_successfull();
@@ -350,5 +1605,28 @@ int main()
     assert(SNR == app_snr);
     assert(12 == radio_power);
 
+    test_send_uplink_iov();
+    test_send_uplink_reserved();
+    test_rx_window_clock_error();
+    test_nb_trans();
+    test_crypto_contexts_reused();
+    test_uplink_queue();
+    test_confirmed_retries();
+    test_confirmed_retries_large();
+    test_deferred();
+    test_session_snapshot();
+    test_class_c();
+    test_multicast();
+    test_dl_channel();
+    test_mac_overflow();
+    test_class_b();
+    uwan_deinit(ctx);
+
+    test_join_procedure();
+    test_join_nonces();
+#ifdef UWAN_TEST_BUILTIN_CRYPTO
+    test_builtin_crypto();
+#endif
+
     return 0;
 }